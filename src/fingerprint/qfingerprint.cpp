@@ -24,13 +24,70 @@
 ****************************************************************************/
 
 #include "qfingerprint.h"
+#include "qfingerprinttemplatecache.h"
+#include "qfingerprintcapture.h"
+#include "qfingerprintdiscovery.h"
+#include "qfingerprintcancellation.h"
+#include "qfingerprintbus.h"
+#include "qfingerprinttrace.h"
+#include "qfingerprintimagewriter.h"
 #include <QByteArray>
 #include <QBitArray>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
 #include <QImage>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 #include <QDebug>
+#include <algorithm>
+
+// A cancellation token is polled, a blocking QIODevice can not be woken up
+// from another thread
+static const qint64 QFINGERPRINT_CANCELLATION_POLL = 10;
+
+// How long a sensor may work on a command before it answers, on top of the
+// timeout. Searching and deleting go through the templates one by one.
+static const qint64 QFINGERPRINT_READIMAGE_MSECS = 1000;
+static const qint64 QFINGERPRINT_SEARCH_MSECS_PER_TEMPLATE = 2;
+static const qint64 QFINGERPRINT_DELETE_MSECS_PER_TEMPLATE = 10;
+static const qint64 QFINGERPRINT_CLEARDATABASE_MSECS = 5000;
+
+static quint16 payloadWord(const QByteArray& packetPayload, int index) {
+    if (packetPayload.size() < index + 2) {
+        return 0;
+    }
+    return quint16((quint16(uint8_t(packetPayload[index])) << 8) | uint8_t(packetPayload[index + 1]));
+}
+
+static qint64 replyWorkMsecs(const QByteArray& packetPayload) {
+    uint8_t instruction = packetPayload.isEmpty() ? 0 : (uint8_t)packetPayload[0];
+    switch (instruction) {
+    case FINGERPRINT_READIMAGE:
+        return QFINGERPRINT_READIMAGE_MSECS;
+    case FINGERPRINT_SEARCHTEMPLATE:
+        return payloadWord(packetPayload, 4) * QFINGERPRINT_SEARCH_MSECS_PER_TEMPLATE;
+    case FINGERPRINT_DELETETEMPLATE:
+        return payloadWord(packetPayload, 3) * QFINGERPRINT_DELETE_MSECS_PER_TEMPLATE;
+    case FINGERPRINT_CLEARDATABASE:
+        return QFINGERPRINT_CLEARDATABASE_MSECS;
+    default:
+        return 0;
+    }
+}
+
+static const char* packetSpanName(const QFingerprintResult<QByteArray>& packet) {
+    if (!packet) {
+        return packet.error() == QFingerprintError::Timeout ? "timeout"
+             : packet.error() == QFingerprintError::Cancelled ? "cancelled"
+             : "bad packet";
+    }
+    uint8_t packetType = packet.value()[0];
+    return packetType == FINGERPRINT_ACKPACKET ? "ack"
+         : packetType == FINGERPRINT_DATAPACKET ? "data packet"
+         : packetType == FINGERPRINT_ENDDATAPACKET ? "end packet"
+         : "packet";
+}
 
 
 QFingerprintException::QFingerprintException(const std::string& message) : message_(message) {
@@ -84,9 +141,102 @@ QSerialPort* QFingerprint::serial() const {
 
 void QFingerprint::setSerial(QSerialPort* serial) {
     m_serial = serial;
+    this->setDevice(serial);
     emit serialChanged();
 }
 
+QIODevice* QFingerprint::device() const {
+    return m_device;
+}
+
+void QFingerprint::setDevice(QIODevice* device) {
+    m_device = device;
+    this->m_decoder.clear();
+    this->m_pendingReply = NoReply;
+    if (m_serial != device) {
+        m_serial = nullptr;
+    }
+}
+
+QFingerprintModel QFingerprint::model() const {
+    return m_model;
+}
+
+void QFingerprint::setModel(const QFingerprintModel& model) {
+    m_model = model;
+    this->m_storageCapacity = model.capacity;
+    this->m_maxPacketSize = model.packetSize;
+}
+
+bool QFingerprint::progressiveImage() const {
+    return m_progressiveImage;
+}
+
+void QFingerprint::setProgressiveImage(bool progressive) {
+    m_progressiveImage = progressive;
+}
+
+QFingerprint::UploadVerification QFingerprint::uploadVerification() const {
+    return m_uploadVerification;
+}
+
+void QFingerprint::setUploadVerification(UploadVerification verification) {
+    m_uploadVerification = verification;
+}
+
+QFingerprintCapture* QFingerprint::capture() const {
+    return m_capture;
+}
+
+void QFingerprint::setCapture(QFingerprintCapture* capture) {
+    m_capture = capture;
+}
+
+QFingerprintTrace* QFingerprint::trace() const {
+    return m_trace;
+}
+
+void QFingerprint::setTrace(QFingerprintTrace* trace) {
+    m_trace = trace;
+}
+
+QFingerprintImageWriter* QFingerprint::imageWriter() const {
+    return m_imageWriter;
+}
+
+void QFingerprint::setImageWriter(QFingerprintImageWriter* writer) {
+    m_imageWriter = writer;
+}
+
+QFingerprintTemplateCache* QFingerprint::templateCache() const {
+    return m_templateCache;
+}
+
+void QFingerprint::setTemplateCache(QFingerprintTemplateCache* cache) {
+    m_templateCache = cache;
+    this->m_bufferCharacteristics.clear();
+}
+
+QFingerprintCancellation* QFingerprint::cancellation() const {
+    return m_cancellation;
+}
+
+void QFingerprint::setCancellation(QFingerprintCancellation* cancellation) {
+    m_cancellation = cancellation;
+}
+
+QDeadlineTimer QFingerprint::deadline() const {
+    return m_deadline;
+}
+
+qint64 QFingerprint::lastCommandTime() const {
+    return m_lastCommandTime.loadRelaxed();
+}
+
+void QFingerprint::setDeadline(QDeadlineTimer deadline) {
+    m_deadline = deadline;
+}
+
 uint8_t QFingerprint::rightShift(ulong n, int x) {
     return (n >> x & 0xFF);
 }
@@ -116,9 +266,7 @@ void QFingerprint::initialize_device(QString port, quint32 baudRate, quint32 add
 
     // this->setAddress(address);
     // this->setPassword(password);
-    this->m_address = address;
-    this->m_password = password;
-    this->setTimeout(500);
+    this->resetSession(address, password);
 
     QSerialPort* serialPort = new QSerialPort(this);
     this->setSerial(serialPort);
@@ -138,6 +286,38 @@ void QFingerprint::initialize_device(QString port, quint32 baudRate, quint32 add
     }
 }
 
+void QFingerprint::initialize_device(QFingerprintBusChannel* channel, quint32 password) {
+    this->resetSession(channel->address(), password);
+    this->setDevice(channel);
+}
+
+void QFingerprint::resetSession(quint32 address, quint32 password) {
+    this->m_address = address;
+    this->m_password = password;
+    this->m_maxPacketSize = this->m_model.packetSize;
+    this->m_storageCapacity = this->m_model.capacity;
+    this->m_decoder.clear();
+    this->m_pendingBufferDigests.clear();
+    this->m_pendingPositionDigests.clear();
+    this->m_bufferPositions.clear();
+    this->m_bufferCharacteristics.clear();
+    this->m_bufferDigests.clear();
+    if (this->templateCache()) {
+        this->templateCache()->clear();
+    }
+    this->setTimeout(500);
+}
+
+void QFingerprint::initialize_device(const QFingerprintDeviceProfile& profile) {
+    this->initialize_device(profile.portName, quint32(profile.baudRate), profile.address, profile.password);
+    if (profile.packetSize) {
+        this->m_maxPacketSize = profile.packetSize;
+    }
+    if (profile.capacity) {
+        this->m_storageCapacity = profile.capacity;
+    }
+}
+
 // bool QIODevice::putChar(char c) {
 //     qDebug() << QString("0x%1").arg((uint8_t)c, 2, 16, QLatin1Char( '0' )).toUpper().toLatin1().data();
 //     return true;
@@ -151,109 +331,186 @@ void QFingerprint::initialize_device(QString port, quint32 baudRate, quint32 add
 // }
 
 void QFingerprint::writePacket(uint8_t packetType, QByteArray packetPayload) {
-    QSerialPort* serial = this->serial();
-    QByteArray packetData;
+    this->tryWritePacket(packetType, packetPayload).value();
+}
 
-    // Write header (one byte at once)
-    packetData.append(rightShift(FINGERPRINT_STARTCODE, 8));
-    packetData.append(rightShift(FINGERPRINT_STARTCODE, 0));
+QByteArray QFingerprint::readPacket() {
+    return this->tryReadPacket().value();
+}
+
+QFingerprintResult<void> QFingerprint::tryWritePacket(uint8_t packetType, const QByteArray& packetPayload) {
+    QIODevice* device = this->device();
 
-    packetData.append(rightShift(address(), 24));
-    packetData.append(rightShift(address(), 16));
-    packetData.append(rightShift(address(), 8));
-    packetData.append(rightShift(address(), 0));
+    if (packetType == FINGERPRINT_COMMANDPACKET) {
+        QFingerprintResult<void> interrupted = this->checkInterrupted();
+        if (!interrupted) {
+            return interrupted;
+        }
+        // The sensor takes no command until the last reply is sent
+        if (this->m_pendingReply != NoReply) {
+            this->drainPendingReply();
+        }
+    }
 
-    packetData.append(packetType);
+    QByteArray packetData = QFingerprintFrame::encode(this->address(), packetType, packetPayload);
+    uint8_t instruction = packetPayload.isEmpty() ? 0 : (uint8_t)packetPayload[0];
+    if (packetType == FINGERPRINT_COMMANDPACKET) {
+        this->m_lastInstruction = instruction;
+    }
 
-    // The packet length = package payload (n bytes) + checksum (2 bytes)
-    uint8_t packetLength = packetPayload.length() + 2;
+    if (this->capture()) {
+        this->capture()->record(QFingerprintCapture::Transmit, packetData);
+    }
+    qint64 traceStart = this->trace() ? this->trace()->now() : 0;
 
-    packetData.append(rightShift(packetLength, 8));
-    packetData.append(rightShift(packetLength, 0));
+    device->write(packetData);
+    bool written = device->waitForBytesWritten(this->timeout());
 
-    // The packet checksum = packet type (1 byte) + packet length (2 bytes) + payload (n bytes)
-    ulong packetChecksum = packetType + rightShift(packetLength, 8) + rightShift(packetLength, 0);
+    if (this->trace()) {
+        const char* name = packetType == FINGERPRINT_COMMANDPACKET ? QFingerprintTrace::instructionName(instruction)
+                         : packetType == FINGERPRINT_ENDDATAPACKET ? "end packet" : "data packet";
+        this->trace()->record(name, "write", traceStart, this->address(), this->m_lastInstruction, packetData.size());
+    }
+    if(!written){
+        return QFingerprintResult<void>(QFingerprintError::Timeout, "Write timeout!");
+    }
 
-    // Write payload
-    for (char data : packetPayload) {
-        packetData.append(data);
-        packetChecksum += data;
+    if (packetType == FINGERPRINT_COMMANDPACKET) {
+        this->m_pendingReply = AckReply;
+        this->m_pendingDataPhase = instruction == FINGERPRINT_DOWNLOADIMAGE
+                                || instruction == FINGERPRINT_DOWNLOADCHARACTERISTICS;
+        this->m_pendingReplyBudget = this->timeout() + replyWorkMsecs(packetPayload);
+        this->m_lastCommandTime.storeRelaxed(QDeadlineTimer::current().deadline());
     }
+    return QFingerprintResult<void>();
+}
 
-    // Write checksum (2 bytes)
-    packetData.append(rightShift(packetChecksum, 8));
-    packetData.append(rightShift(packetChecksum, 0));
 
-    serial->write(packetData);
-    if(!serial->waitForBytesWritten(this->timeout())){
-        throw QFingerprintException("Write timeout!");
+QFingerprintResult<QByteArray> QFingerprint::tryReadPacket() {
+    return this->readFrame(true, this->timeout());
+}
+
+// The reply is waited for as long as the command may take on the sensor,
+// not just the timeout of a read
+bool QFingerprint::drainPendingReply() {
+    while (this->m_pendingReply != NoReply) {
+        QFingerprintResult<QByteArray> packet = this->readFrame(false, this->m_pendingReplyBudget);
+        if (!packet) {
+            // Start over with whatever the sensor sends next. The rest of a
+            // corrupted reply may still be on its way, the line has to be
+            // quiet before the next command is sent.
+            this->m_pendingReply = NoReply;
+            this->discardInput();
+            if (packet.error() != QFingerprintError::Timeout) {
+                while (this->device()->waitForReadyRead(int(this->timeout()))) {
+                    this->discardInput();
+                }
+            }
+            return false;
+        }
     }
+    return true;
 }
 
+// Reads while draining are traced as such
+QFingerprintResult<QByteArray> QFingerprint::readFrame(bool interruptible, qint64 timeout) {
+    if (!this->trace()) {
+        return this->receiveFrame(interruptible, timeout);
+    }
+
+    qint64 traceStart = this->trace()->now();
+    QFingerprintResult<QByteArray> packet = this->receiveFrame(interruptible, timeout);
+    this->trace()->record(packetSpanName(packet), interruptible ? "read" : "drain", traceStart,
+                          this->address(), this->m_lastInstruction, packet ? packet.value().size() : 0);
+    return packet;
+}
 
-QByteArray QFingerprint::readPacket() {
-    QSerialPort* serial = this->serial();
-    QByteArray receivedPacketData;
-    int i = 0;
+// The per read timeout restarts with every chunk of data, the deadline and
+// the cancellation are only checked by interruptible reads
+QFingerprintResult<QByteArray> QFingerprint::receiveFrame(bool interruptible, qint64 timeout) {
+    QIODevice* device = this->device();
+    QByteArray packetData;
+    QByteArray frame;
+    QByteArray skipped;
+    QDeadlineTimer readTimer(timeout);
 
     while(true) {
-        char receivedFragment;
-        if (serial->bytesAvailable() < 1) {
-            if(!serial->waitForReadyRead(this->timeout())) {
-                throw QFingerprintException("Read timeout!");
+        QFingerprintFrameDecoder::Status status = this->m_decoder.next(&packetData, nullptr, this->capture() ? &frame : nullptr);
+
+        // Bytes in front of a start code are skipped, the capture keeps them
+        // as an entry of their own so a replay resynchronizes the same way
+        if (status == QFingerprintFrameDecoder::BadHeader) {
+            if (this->capture()) {
+                skipped.append(frame);
+                if (skipped.size() == QFingerprintCapture::MaxFrameSize) {
+                    this->capture()->record(QFingerprintCapture::Receive, skipped);
+                    skipped.clear();
+                }
             }
+            continue;
         }
-        if (serial->getChar(&receivedFragment)) {
-            // Insert byte if packet seems valid
-            receivedPacketData.insert(i, (uint8_t)receivedFragment);
-            i++;
+        if (!skipped.isEmpty()) {
+            this->capture()->record(QFingerprintCapture::Receive, skipped);
+            skipped.clear();
         }
 
-        // Packet could be complete (the minimal packet size is 12 bytes)
-        if (i >= 12) {
-            // Check the packet header
-            if (receivedPacketData[0] != rightShift(FINGERPRINT_STARTCODE, 8) || receivedPacketData[1] != rightShift(FINGERPRINT_STARTCODE, 0)) {
-                throw QFingerprintException("The received packet do not begin with a valid header!");
+        if (status == QFingerprintFrameDecoder::Frame || status == QFingerprintFrameDecoder::BadChecksum) {
+            if (this->capture()) {
+                this->capture()->record(QFingerprintCapture::Receive, frame);
             }
-
-            //  Calculate packet payload length (combine the 2 length bytes)
-            uint8_t packetPayloadLength;
-            packetPayloadLength = leftShift((uint8_t)receivedPacketData[7], 8) | leftShift((uint8_t)receivedPacketData[8], 0);
-
-            // Check if the packet is still fully received
-            // Condition: index counter < packet payload length + packet frame
-            if ( i < packetPayloadLength + 9 ) {
-                continue;
+            if (status == QFingerprintFrameDecoder::BadChecksum) {
+                return QFingerprintResult<QByteArray>(QFingerprintError::BadPacket, "The received packet is corrupted (the checksum is wrong)!");
             }
 
-            // At this point the packet should be fully received
-            uint8_t packetType = (uint8_t)receivedPacketData[6];
-
-            // Calculate checksum:
-            // checksum = packet type (1 byte) + packet length (2 bytes) + packet payload (n bytes)
-            ulong packetChecksum = packetType + packetPayloadLength;
-
-            QByteArray packetData;
-            packetData.append(packetType);
-            for (int j = 9; j < packetPayloadLength + 9 - 2; j++) {
-                packetData.append((uint8_t)receivedPacketData[j]);
-                packetChecksum += (uint8_t)receivedPacketData[j];
+            uint8_t packetType = packetData[0];
+            if (packetType == FINGERPRINT_ACKPACKET && this->m_pendingReply == AckReply) {
+                bool accepted = packetData.size() > 1 && (uint8_t)packetData[1] == FINGERPRINT_OK;
+                this->m_pendingReply = this->m_pendingDataPhase && accepted ? DataReply : NoReply;
+            }else if (packetType == FINGERPRINT_ENDDATAPACKET && this->m_pendingReply == DataReply) {
+                this->m_pendingReply = NoReply;
             }
+            return packetData;
+        }
 
-            // Calculate full checksum of the 2 separate checksum bytes
-            ulong receivedChecksum = leftShift((uint8_t)receivedPacketData[i - 2], 8) | leftShift((uint8_t)receivedPacketData[i - 1], 0);
-
-            if ( receivedChecksum != packetChecksum ) {
-                qDebug() << "Calculated Checksum:" << packetChecksum;
-                qDebug() << "Received Checksum:" << receivedChecksum;
-                throw QFingerprintException("The received packet is corrupted (the checksum is wrong)!");
+        if (device->bytesAvailable() < 1) {
+            qint64 wait = readTimer.remainingTime();
+            if (interruptible) {
+                QFingerprintResult<void> interrupted = this->checkInterrupted();
+                if (!interrupted) {
+                    return QFingerprintResult<QByteArray>(interrupted.error(), interrupted.errorString());
+                }
+                if (!this->m_deadline.isForever()) {
+                    wait = qMin(wait, this->m_deadline.remainingTime());
+                }
+                if (this->m_cancellation) {
+                    wait = qMin(wait, QFINGERPRINT_CANCELLATION_POLL);
+                }
             }
 
-            return packetData;
+            if(!device->waitForReadyRead(int(wait))) {
+                if (!readTimer.hasExpired()) {
+                    continue;
+                }
+                // A sensor which did not answer in time is not waited for again
+                this->m_pendingReply = NoReply;
+                return QFingerprintResult<QByteArray>(QFingerprintError::Timeout, "Read timeout!");
+            }
         }
+        this->m_decoder.feed(device->readAll());
+        readTimer = QDeadlineTimer(timeout);
     }
 }
 
+QFingerprintResult<void> QFingerprint::checkInterrupted() const {
+    if (this->m_cancellation && this->m_cancellation->isCancelled()) {
+        return QFingerprintResult<void>(QFingerprintError::Cancelled, "The operation was cancelled!");
+    }
+    if (this->m_deadline.hasExpired()) {
+        return QFingerprintResult<void>(QFingerprintError::Timeout, "Deadline exceeded!");
+    }
+    return QFingerprintResult<void>();
+}
+
 bool QFingerprint::verifyPassword() {
     QByteArray packetPayload;
     packetPayload.append(FINGERPRINT_VERIFYPASSWORD)
@@ -425,6 +682,9 @@ bool QFingerprint::setMaxPacketSize(uint8_t packetSize) {
 
     uint8_t packageSizeType = packetSizes[packetSize];
 
+    // Forget the cached packet size, the next upload queries it again
+    this->m_maxPacketSize = 0;
+
     return this->setSystemParameter(FINGERPRINT_SETSYSTEMPARAMETER_PACKAGE_SIZE, packageSizeType);
 }
 
@@ -454,10 +714,20 @@ QByteArray QFingerprint::getSystemParameters() {
 }
 
 quint16 QFingerprint::getStorageCapacity() {
-    QByteArray systemParameters;
-    systemParameters = this->getSystemParameters();
+    // Known from the model or profile, or queried once per session
+    if (this->m_storageCapacity == 0) {
+        QByteArray systemParameters;
+        systemParameters = this->getSystemParameters();
 
-    return this->leftShift((uint8_t)systemParameters[4], 8) | this->leftShift((uint8_t)systemParameters[5], 0);
+        this->m_storageCapacity = this->leftShift((uint8_t)systemParameters[4], 8) | this->leftShift((uint8_t)systemParameters[5], 0);
+    }
+    return this->m_storageCapacity;
+}
+
+// The model rejects a position without a round trip, a position it allows
+// is checked against the capacity of the session
+bool QFingerprint::isValidPosition(int positionNumber) {
+    return this->m_model.isValidPosition(positionNumber) && positionNumber < this->getStorageCapacity();
 }
 
 quint16 QFingerprint::getSecurityLevel() {
@@ -491,7 +761,7 @@ quint16 QFingerprint::getBaudRate() {
 }
 
 QBitArray QFingerprint::getTemplateIndex(uint8_t page) {
-    if (page < 0 | page > 3) {
+    if (page >= this->m_model.indexPages()) {
         throw QFingerprintException("The given index page is invalid!");
     }
 
@@ -515,7 +785,7 @@ QBitArray QFingerprint::getTemplateIndex(uint8_t page) {
         for (int i = 0; i < pageElements.size(); i++) {
             for (int j = 0; j < 8; j++) {
                 // bool positionIsUsed = this->bitAtPosition(byte, i) == 1;
-                templateIndex.setBit(bitAtPosition(pageElements.at(i), j), i * 8 + j);
+                templateIndex.setBit(i * 8 + j, bitAtPosition((uint8_t)pageElements.at(i), j));
             }
         }
         return templateIndex;
@@ -597,65 +867,65 @@ void QFingerprint::downloadImage(QString imageDestination) {
         throw QFingerprintException("The given destination directory " + destinationdirectory.path().toStdString() + " is not writable!");
     }
 
-    QByteArray packetPayload;
-    packetPayload.append(FINGERPRINT_DOWNLOADIMAGE);
-
-    this->writePacket(FINGERPRINT_COMMANDPACKET, packetPayload);
-
-    // Get the first reply packet
-    QByteArray receivedPacket = this->readPacket();
-    uint8_t receivedPacketType = receivedPacket[0];
-    QByteArray receivedPacketPayload = receivedPacket.mid(1);
-
-    if (receivedPacketType != FINGERPRINT_ACKPACKET) {
-        throw QFingerprintException("The received packet is no ack packet!");
+    QImage img;
+    this->downloadImage(&img);
+    if (this->m_imageWriter) {
+        this->m_imageWriter->write(img, imageDestination);
+    } else {
+        img.save(imageDestination);
     }
+}
 
-    // The sensor will send follow-up packets
-    if (receivedPacketPayload[0] == FINGERPRINT_OK) {
-    }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
-        throw QFingerprintException("Communication error");
-    }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_DOWNLOADIMAGE) {
-        throw QFingerprintException("Could not download image");
-    }else {
-        QString message("Unknown error 0x");
-        message += receivedPacketPayload.left(1).toHex();
-        throw QFingerprintException(message.toStdString());
-    }
+// The image is reused when it already has the sensor's size and format
+void QFingerprint::downloadImage(QImage* image) {
+    this->requestImageDownload();
 
-    QByteArrayList imageData;
+    if (image->width() != this->m_model.imageWidth || image->height() != this->m_model.imageHeight
+        || image->format() != QImage::Format_Grayscale8) {
+        *image = QImage(this->m_model.imageWidth, this->m_model.imageHeight, QImage::Format_Grayscale8);
+    }
 
-    // Get follow-up data packets until the last data packet is recieved
+    // Get follow-up data packets until the last data packet is recieved,
+    // each one is decoded into the image as soon as it arrives
+    int receivedBytes = 0;
+    int completedRows = 0;
+    uint8_t receivedPacketType = FINGERPRINT_DATAPACKET;
     while (receivedPacketType != FINGERPRINT_ENDDATAPACKET) {
-        receivedPacket = this->readPacket();
+        QByteArray receivedPacket = this->readPacket();
         receivedPacketType = receivedPacket[0];
-        receivedPacketPayload = receivedPacket.mid(1);
 
         if (receivedPacketType != FINGERPRINT_DATAPACKET && receivedPacketType != FINGERPRINT_ENDDATAPACKET) {
             throw QFingerprintException("The received packet is no data packet!");
         }
 
-        imageData.append(receivedPacketPayload);
-    }
-    QImage img(256, 288, QImage::Format_Grayscale8);
-    uchar* start = img.bits();
-    uchar* ptr = start + img.width() * img.height();
+        receivedBytes += unpackImage(receivedPacket.constData() + 1, receivedPacket.size() - 1, receivedBytes, image);
 
-    quint16 x=0, row=0, col=0;
-    for (; ptr > start; ptr--) {
-        if (x % 2 == 0) {
-            *ptr = (imageData[row][col] >> 4) * 17;
-        } else {
-            *ptr = (imageData[row][col] & 0x0F) * 17;
-            col++;
+        // The image fills up from the bottom, rows are reported once complete
+        int rows = receivedBytes * 2 / image->width();
+        if (this->m_progressiveImage && rows > completedRows) {
+            int firstRow = image->height() - rows;
+            emit imageRowsReady(firstRow, image->copy(0, firstRow, image->width(), rows - completedRows));
+            completedRows = rows;
         }
-        x++;
-        if (col >= imageData[col].size()) {
-            x=0; col = 0;
-            row++;
+    }
+}
+
+QByteArray QFingerprint::downloadImageData() {
+    this->requestImageDownload();
+
+    QByteArray imageData;
+    imageData.reserve(this->m_model.imageBytes());
+    uint8_t receivedPacketType = FINGERPRINT_DATAPACKET;
+    while (receivedPacketType != FINGERPRINT_ENDDATAPACKET) {
+        QByteArray receivedPacket = this->readPacket();
+        receivedPacketType = receivedPacket[0];
+
+        if (receivedPacketType != FINGERPRINT_DATAPACKET && receivedPacketType != FINGERPRINT_ENDDATAPACKET) {
+            throw QFingerprintException("The received packet is no data packet!");
         }
+        imageData.append(receivedPacket.constData() + 1, receivedPacket.size() - 1);
     }
-    img.save(imageDestination);
+    return imageData;
 }
 
 bool QFingerprint::convertImage(uint8_t charBufferNumber) {
@@ -663,6 +933,8 @@ bool QFingerprint::convertImage(uint8_t charBufferNumber) {
         throw QFingerprintException("The given charbuffer number is invalid!");
     }
 
+    this->forgetCharBuffer(charBufferNumber);
+
     QByteArray packetPayload;
     packetPayload.append(FINGERPRINT_CONVERTIMAGE)
                  .append(charBufferNumber);
@@ -695,6 +967,9 @@ bool QFingerprint::convertImage(uint8_t charBufferNumber) {
 }
 
 bool QFingerprint::createTemplate() {
+    this->forgetCharBuffer(FINGERPRINT_CHARBUFFER1);
+    this->forgetCharBuffer(FINGERPRINT_CHARBUFFER2);
+
     QByteArray packetPayload;
     packetPayload.append(FINGERPRINT_CREATETEMPLATE);
 
@@ -725,8 +1000,8 @@ bool QFingerprint::createTemplate() {
 
 quint16 QFingerprint::storeTemplate(qint16 positionNumber, uint8_t charBufferNumber) {
     // Find a free index
-    if (positionNumber = -1) {
-        for (int page; page < 4; page++) {
+    if (positionNumber == -1) {
+        for (int page = 0; page < this->m_model.indexPages(); page++) {
             // Free index found
             if (positionNumber >=0) {
                 break;
@@ -743,7 +1018,7 @@ quint16 QFingerprint::storeTemplate(qint16 positionNumber, uint8_t charBufferNum
         }
     }
 
-    if (positionNumber < 0x0000 or positionNumber >= this->getStorageCapacity()) {
+    if (!this->isValidPosition(positionNumber)) {
         throw QFingerprintException("The given position number is invalid!");
     }
 
@@ -769,7 +1044,8 @@ quint16 QFingerprint::storeTemplate(qint16 positionNumber, uint8_t charBufferNum
 
     // Template stored successful
     if (receivedPacketPayload[0] == FINGERPRINT_OK) {
-        return (quint8)positionNumber;
+        this->templateStored(positionNumber, charBufferNumber);
+        return (quint16)positionNumber;
     }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
         throw QFingerprintException("Communication error");
     }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_INVALIDPOSITION) {
@@ -795,6 +1071,75 @@ QList<qint16> QFingerprint::searchTemplate(uint8_t charBufferNumber, quint16 pos
         templatesCount = this->getStorageCapacity();
     }
 
+    this->writeSearchCommand(charBufferNumber, positionStart, templatesCount);
+    return this->readSearchResult();
+}
+
+QFingerprintBatchSearchResult QFingerprint::searchTemplates(QList<QList<uint8_t>> probes, quint16 positionStart, qint16 count) {
+    QFingerprintBatchSearchResult batchResult;
+    batchResult.probesPerSecond = 0;
+    if (probes.isEmpty()) {
+        return batchResult;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    quint16 templatesCount;
+    if (count > 0) {
+        templatesCount = count;
+    }else {
+        templatesCount = this->getStorageCapacity();
+    }
+
+    // Probes alternate between the two char buffers. Only building the data
+    // packets of the next probe overlaps the current search, the module takes
+    // no upload until it has answered. A failing probe does not stop the batch.
+    uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1;
+    QByteArrayList packets;
+    bool packetsBuilt = false;
+
+    for (int i = 0; i < probes.size(); i++) {
+        QFingerprintProbeResult probeResult = {QList<qint16>(), false, QString()};
+        QByteArrayList nextPackets;
+        bool nextPacketsBuilt = false;
+
+        try {
+            if (!packetsBuilt) {
+                packets = this->characteristicsPackets(probes[i]);
+            }
+            this->writeCharacteristics(charBufferNumber, packets);
+            this->writeSearchCommand(charBufferNumber, positionStart, templatesCount);
+
+            if (i + 1 < probes.size()) {
+                try {
+                    nextPackets = this->characteristicsPackets(probes[i + 1]);
+                    nextPacketsBuilt = true;
+                } catch (const QFingerprintException&) {
+                    // Reported with the next probe
+                }
+            }
+
+            probeResult.result = this->readSearchResult();
+            probeResult.success = true;
+        } catch (const QFingerprintException& e) {
+            probeResult.error = QString::fromStdString(e.what());
+        }
+        batchResult.results.append(probeResult);
+
+        packets = nextPackets;
+        packetsBuilt = nextPacketsBuilt;
+        charBufferNumber = charBufferNumber == FINGERPRINT_CHARBUFFER1 ? FINGERPRINT_CHARBUFFER2 : FINGERPRINT_CHARBUFFER1;
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+    if (elapsed > 0) {
+        batchResult.probesPerSecond = probes.size() * 1e9 / elapsed;
+    }
+    return batchResult;
+}
+
+void QFingerprint::writeSearchCommand(uint8_t charBufferNumber, quint16 positionStart, quint16 templatesCount) {
     QByteArray packetPayload;
     packetPayload.append(FINGERPRINT_SEARCHTEMPLATE)
                  .append(charBufferNumber)
@@ -804,7 +1149,9 @@ QList<qint16> QFingerprint::searchTemplate(uint8_t charBufferNumber, quint16 pos
                  .append(this->rightShift(templatesCount, 0));
 
     this->writePacket(FINGERPRINT_COMMANDPACKET, packetPayload);
+}
 
+QList<qint16> QFingerprint::readSearchResult() {
     QByteArray receivedPacket = this->readPacket();
     uint8_t receivedPacketType = receivedPacket[0];
     QByteArray receivedPacketPayload = receivedPacket.mid(1);
@@ -833,7 +1180,7 @@ QList<qint16> QFingerprint::searchTemplate(uint8_t charBufferNumber, quint16 pos
 }
 
 bool QFingerprint::loadTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
-    if (positionNumber < 0x0000 || positionNumber >= this->getStorageCapacity()) {
+    if (!this->isValidPosition(positionNumber)) {
         throw QFingerprintException("The given positionNumber is invalid!");
     }
 
@@ -841,6 +1188,8 @@ bool QFingerprint::loadTemplate(quint16 positionNumber, uint8_t charBufferNumber
         throw QFingerprintException("The given charbuffer number is invalid!");
     }
 
+    this->forgetCharBuffer(charBufferNumber);
+
     QByteArray packetPayload;
     packetPayload.append(FINGERPRINT_LOADTEMPLATE)
                  .append(charBufferNumber)
@@ -859,6 +1208,7 @@ bool QFingerprint::loadTemplate(quint16 positionNumber, uint8_t charBufferNumber
 
     // Template loaded successful
     if (receivedPacketPayload[0] == FINGERPRINT_OK) {
+        this->m_bufferPositions.insert(charBufferNumber, positionNumber);
         return true;
     }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
         throw QFingerprintException("Communication error");
@@ -874,8 +1224,54 @@ bool QFingerprint::loadTemplate(quint16 positionNumber, uint8_t charBufferNumber
 }
 
 bool QFingerprint::deleteTemplate(quint16 positionNumber, quint16 count) {
+    return this->deleteTemplateRange(positionNumber, count, this->getStorageCapacity());
+}
+
+QList<QFingerprintRangeResult> QFingerprint::deleteTemplates(QList<quint16> positionNumbers) {
+    QList<QFingerprintRangeResult> results;
+    if (positionNumbers.isEmpty()) {
+        return results;
+    }
+
+    // The capacity is fetched once for the whole batch
     quint16 capacity = this->getStorageCapacity();
-    if (positionNumber < 0x0000 || positionNumber >= capacity) {
+
+    std::sort(positionNumbers.begin(), positionNumbers.end());
+    positionNumbers.erase(std::unique(positionNumbers.begin(), positionNumbers.end()), positionNumbers.end());
+
+    if (!this->m_model.isValidPosition(positionNumbers.last()) || positionNumbers.last() >= capacity) {
+        throw QFingerprintException("The given position number is invalid!");
+    }
+
+    // Coalesce the sorted positions into contiguous ranges
+    QList<QFingerprintRangeResult> ranges;
+    for (quint16 positionNumber : positionNumbers) {
+        if (!ranges.isEmpty() && ranges.last().positionStart + ranges.last().count == positionNumber) {
+            ranges.last().count++;
+        } else {
+            ranges.append({positionNumber, 1, false});
+        }
+    }
+
+    // A failing range does not stop the batch, every range is reported
+    for (QFingerprintRangeResult range : ranges) {
+        try {
+            range.success = this->deleteTemplateRange(range.positionStart, range.count, capacity);
+            if (!range.success) {
+                range.error = "Could not delete template";
+            }
+        } catch (const QFingerprintException& e) {
+            range.success = false;
+            range.error = QString::fromStdString(e.what());
+        }
+        results.append(range);
+    }
+
+    return results;
+}
+
+bool QFingerprint::deleteTemplateRange(quint16 positionNumber, quint16 count, quint16 capacity) {
+    if (!this->m_model.isValidPosition(positionNumber) || positionNumber >= capacity) {
         throw QFingerprintException("The given position number is invalid!");
     }
 
@@ -902,6 +1298,7 @@ bool QFingerprint::deleteTemplate(quint16 positionNumber, quint16 count) {
 
     // Template deleted successful
     if (receivedPacketPayload[0] == FINGERPRINT_OK) {
+        this->templatesDeleted(positionNumber, count);
         return true;
     }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
         throw QFingerprintException("Communication error");
@@ -932,6 +1329,11 @@ bool QFingerprint::clearDatabase() {
 
     // Database cleared successful
     if (receivedPacketPayload[0] == FINGERPRINT_OK) {
+        this->m_pendingPositionDigests.clear();
+        this->m_bufferPositions.clear();
+        if (this->templateCache()) {
+            this->templateCache()->clear();
+        }
         return true;
     }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
         throw QFingerprintException("Communication error");
@@ -967,7 +1369,7 @@ quint16 QFingerprint::compareCharacteristics() {
     }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
         throw QFingerprintException("Communication error");
     // The characteristics do not match
-    }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_CLEARDATABASE) {
+    }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_NOTMATCHING) {
         return 0;
     }else {
         QString message("Unknown error 0x");
@@ -985,8 +1387,56 @@ bool QFingerprint::uploadCharacteristics(uint8_t charBufferNumber, QList<uint8_t
         throw QFingerprintException("The characteristics data required!");
     }
 
-    quint16 maxPacketSize = this->getMaxPacketSize();
+    this->writeCharacteristics(charBufferNumber, this->characteristicsPackets(characteristicsData));
+
+    if (this->templateCache()) {
+        this->m_bufferCharacteristics.insert(charBufferNumber, characteristicsData);
+    }
+
+    // Verify uploaded characteristics
+    if (this->uploadVerification() == NoVerification) {
+        return true;
+    } else if (this->uploadVerification() == DeferredVerification) {
+        this->m_pendingBufferDigests.insert(charBufferNumber, this->characteristicsDigest(characteristicsData));
+        return true;
+    } else if (this->uploadVerification() == ProbeVerification) {
+        // When the other buffer is known to hold the same data, a match on the
+        // sensor stands in for the read back. A mismatch reads the buffer back.
+        QByteArray digest = this->characteristicsDigest(characteristicsData);
+        uint8_t otherBufferNumber = charBufferNumber == FINGERPRINT_CHARBUFFER1 ? FINGERPRINT_CHARBUFFER2 : FINGERPRINT_CHARBUFFER1;
+        bool otherBufferMatches = this->m_bufferDigests.value(otherBufferNumber) == digest;
+        this->m_bufferDigests.insert(charBufferNumber, digest);
+        if (otherBufferMatches && this->compareCharacteristics() > 0) {
+            return true;
+        }
+    }
+
+    QList<uint8_t> characteristics = this->downloadCharacteristics(charBufferNumber);
+    return characteristics == characteristicsData;
+}
+
+QByteArrayList QFingerprint::characteristicsPackets(const QList<uint8_t>& characteristicsData) {
+    if (this->m_maxPacketSize == 0) {
+        this->m_maxPacketSize = this->getMaxPacketSize();
+    }
+    quint16 maxPacketSize = this->m_maxPacketSize;
+
+    QByteArray characteristicsPayload;
+    for (uint8_t byte : characteristicsData) {
+        characteristicsPayload.append(byte);
+    }
 
+    QByteArrayList packets;
+    int offset = 0;
+    while (characteristicsPayload.size() - offset > maxPacketSize) {
+        packets.append(characteristicsPayload.mid(offset, maxPacketSize));
+        offset += maxPacketSize;
+    }
+    packets.append(characteristicsPayload.mid(offset));
+    return packets;
+}
+
+void QFingerprint::writeCharacteristics(uint8_t charBufferNumber, const QByteArrayList& packets) {
     // Upload command
     QByteArray packetPayload;
     packetPayload.append(FINGERPRINT_UPLOADCHARACTERISTICS)
@@ -1015,35 +1465,56 @@ bool QFingerprint::uploadCharacteristics(uint8_t charBufferNumber, QList<uint8_t
         throw QFingerprintException(message.toStdString());
     }
 
-    // Upload data packets
-    quint16 packetNbr = characteristicsData.size() / maxPacketSize;
+    // Upload data packets, the last one is marked as end data packet
+    for (int i = 0; i < packets.size(); i++) {
+        uint8_t packetType = i == packets.size() - 1 ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET;
+        this->writePacket(packetType, packets[i]);
+    }
 
-    QByteArray characteristicsPayload;
-    for (uint8_t byte : characteristicsData) {
-        characteristicsPayload.append(byte);
+    // A new upload replaces whatever was known about this buffer
+    this->forgetCharBuffer(charBufferNumber);
+}
+
+QList<quint16> QFingerprint::verifyDeferredUploads() {
+    QList<quint16> failedPositions;
+    bool charBufferFailed = false;
+
+    // Uploads which were not stored are checked in their char buffer first,
+    // loading templates below overwrites the buffers
+    QList<uint8_t> charBuffers = this->m_pendingBufferDigests.keys();
+    for (uint8_t charBufferNumber : charBuffers) {
+        QByteArray digest = this->m_pendingBufferDigests.take(charBufferNumber);
+        QList<uint8_t> characteristics = this->downloadCharacteristics(charBufferNumber);
+        if (this->characteristicsDigest(characteristics) != digest) {
+            charBufferFailed = true;
+        }
     }
-    if (packetNbr <= 1) {
-        this->writePacket(FINGERPRINT_ENDDATAPACKET, characteristicsPayload);
-    }else {
-        quint16 i=0;
-        quint16 lfrom, lto;
-        while (i < packetNbr) {
-            lfrom = (i-1) * maxPacketSize;
-            lto = lfrom + maxPacketSize;
-
-            this->writePacket(FINGERPRINT_DATAPACKET, characteristicsPayload.mid(lfrom, lto));
-            i++;
+
+    // Uploads which were stored are checked in their flash position
+    QList<quint16> positions = this->m_pendingPositionDigests.keys();
+    std::sort(positions.begin(), positions.end());
+    for (quint16 positionNumber : positions) {
+        QByteArray digest = this->m_pendingPositionDigests.take(positionNumber);
+        this->loadTemplate(positionNumber, FINGERPRINT_CHARBUFFER1);
+        QList<uint8_t> characteristics = this->downloadCharacteristics(FINGERPRINT_CHARBUFFER1);
+        if (this->characteristicsDigest(characteristics) != digest) {
+            failedPositions.append(positionNumber);
         }
+    }
 
-        lfrom = (i-1) * maxPacketSize;
-        lto = lfrom + maxPacketSize;
-        this->writePacket(FINGERPRINT_ENDDATAPACKET, characteristicsPayload.mid(lfrom, lto));
+    if (charBufferFailed) {
+        throw QFingerprintException("The characteristics in the char buffer do not match the upload!");
     }
+    return failedPositions;
+}
 
-    // Verify uploaded characteristics
-    QList<uint8_t> characteristics = this->downloadCharacteristics(charBufferNumber);
-    qDebug()<<characteristics;
-    return characteristics == characteristicsData;
+QByteArray QFingerprint::characteristicsDigest(const QList<uint8_t>& characteristicsData) {
+    QByteArray characteristicsPayload;
+    characteristicsPayload.reserve(characteristicsData.size());
+    for (uint8_t byte : characteristicsData) {
+        characteristicsPayload.append(byte);
+    }
+    return QCryptographicHash::hash(characteristicsPayload, QCryptographicHash::Sha1);
 }
 
 quint32 QFingerprint::generateRandomNumber() {
@@ -1128,6 +1599,375 @@ QList<uint8_t> QFingerprint::downloadCharacteristics(uint8_t charBufferNumber) {
         }
     }
 
+    this->m_bufferDigests.insert(charBufferNumber, this->characteristicsDigest(completePayload));
+    if (this->templateCache()) {
+        this->m_bufferCharacteristics.insert(charBufferNumber, completePayload);
+        if (this->m_bufferPositions.contains(charBufferNumber)) {
+            this->templateCache()->insert(this->m_bufferPositions.value(charBufferNumber), completePayload);
+        }
+    }
+
     return completePayload;
 }
 
+QList<uint8_t> QFingerprint::downloadTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
+    // A cache hit leaves the char buffer untouched
+    QList<uint8_t> characteristics;
+    if (this->templateCache() && this->templateCache()->lookup(positionNumber, &characteristics)) {
+        return characteristics;
+    }
+
+    this->loadTemplate(positionNumber, charBufferNumber);
+    return this->downloadCharacteristics(charBufferNumber);
+}
+
+QFingerprintResult<QByteArray> QFingerprint::tryCommand(const QByteArray& packetPayload) {
+    QFingerprintResult<void> written = this->tryWritePacket(FINGERPRINT_COMMANDPACKET, packetPayload);
+    if (!written) {
+        return QFingerprintResult<QByteArray>(written.error(), written.errorString());
+    }
+
+    return this->tryReadAck();
+}
+
+QFingerprintResult<QByteArray> QFingerprint::tryReadAck() {
+    QFingerprintResult<QByteArray> receivedPacket = this->tryReadPacket();
+    if (!receivedPacket) {
+        return receivedPacket;
+    }
+
+    const QByteArray& packet = receivedPacket.value();
+    if (packet.size() < 2 || (uint8_t)packet[0] != FINGERPRINT_ACKPACKET) {
+        return QFingerprintResult<QByteArray>(QFingerprintError::BadPacket, "The received packet is no ack packet!");
+    }
+
+    QFingerprintError error = qFingerprintErrorFromCode((uint8_t)packet[1]);
+    if (error != QFingerprintError::NoError) {
+        return QFingerprintResult<QByteArray>(error);
+    }
+
+    // Payload behind the confirmation code
+    return QFingerprintResult<QByteArray>(packet.mid(2));
+}
+
+QFingerprintResult<quint16> QFingerprint::tryStorageCapacity() {
+    if (this->m_storageCapacity == 0) {
+        QByteArray packetPayload;
+        packetPayload.append(FINGERPRINT_GETSYSTEMPARAMETERS);
+
+        QFingerprintResult<QByteArray> systemParameters = this->tryCommand(packetPayload);
+        if (!systemParameters) {
+            return QFingerprintResult<quint16>(systemParameters.error(), systemParameters.errorString());
+        }
+        const QByteArray& parameters = systemParameters.value();
+        if (parameters.size() < 6) {
+            return QFingerprintResult<quint16>(QFingerprintError::BadPacket);
+        }
+        this->m_storageCapacity = this->leftShift((uint8_t)parameters[4], 8) | this->leftShift((uint8_t)parameters[5], 0);
+    }
+    return QFingerprintResult<quint16>(this->m_storageCapacity);
+}
+
+QFingerprintResult<void> QFingerprint::tryVerifyPassword() {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_VERIFYPASSWORD)
+                 .append(rightShift(password(), 24))
+                 .append(rightShift(password(), 16))
+                 .append(rightShift(password(), 8))
+                 .append(rightShift(password(), 0));
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    return QFingerprintResult<void>(reply.error(), reply ? nullptr : reply.errorString());
+}
+
+QFingerprintResult<quint16> QFingerprint::tryGetTemplateCount() {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_TEMPLATECOUNT);
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    if (!reply) {
+        return QFingerprintResult<quint16>(reply.error(), reply.errorString());
+    }
+    const QByteArray& payload = reply.value();
+    if (payload.size() < 2) {
+        return QFingerprintResult<quint16>(QFingerprintError::BadPacket);
+    }
+    return QFingerprintResult<quint16>(this->leftShift((uint8_t)payload[0], 8) | this->leftShift((uint8_t)payload[1], 0));
+}
+
+QFingerprintResult<void> QFingerprint::tryReadImage() {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_READIMAGE);
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    return QFingerprintResult<void>(reply.error(), reply ? nullptr : reply.errorString());
+}
+
+QFingerprintResult<void> QFingerprint::tryConvertImage(uint8_t charBufferNumber) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        return QFingerprintResult<void>(QFingerprintError::InvalidArgument, "The given charbuffer number is invalid!");
+    }
+    this->forgetCharBuffer(charBufferNumber);
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_CONVERTIMAGE)
+                 .append(charBufferNumber);
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    return QFingerprintResult<void>(reply.error(), reply ? nullptr : reply.errorString());
+}
+
+QFingerprintResult<void> QFingerprint::tryCreateTemplate() {
+    this->forgetCharBuffer(FINGERPRINT_CHARBUFFER1);
+    this->forgetCharBuffer(FINGERPRINT_CHARBUFFER2);
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_CREATETEMPLATE);
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    return QFingerprintResult<void>(reply.error(), reply ? nullptr : reply.errorString());
+}
+
+QFingerprintResult<quint16> QFingerprint::tryStoreTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        return QFingerprintResult<quint16>(QFingerprintError::InvalidArgument, "The given charbuffer number is invalid!");
+    }
+
+    // Only the model is checked, the module validates the position against
+    // its capacity and no round trip is spent on it here
+    if (!this->m_model.isValidPosition(positionNumber)) {
+        return QFingerprintResult<quint16>(QFingerprintError::InvalidArgument, "The given position number is invalid!");
+    }
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_STORETEMPLATE)
+                 .append(charBufferNumber)
+                 .append(this->rightShift(positionNumber, 8))
+                 .append(this->rightShift(positionNumber, 0));
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    if (!reply) {
+        return QFingerprintResult<quint16>(reply.error(), reply.errorString());
+    }
+
+    this->templateStored(positionNumber, charBufferNumber);
+    return QFingerprintResult<quint16>(positionNumber);
+}
+
+void QFingerprint::characteristicsUploaded(uint8_t charBufferNumber, const QList<uint8_t>& characteristicsData) {
+    this->forgetCharBuffer(charBufferNumber);
+    if (this->templateCache()) {
+        this->m_bufferCharacteristics.insert(charBufferNumber, characteristicsData);
+    }
+}
+
+void QFingerprint::templateStored(quint16 positionNumber, uint8_t charBufferNumber) {
+    // A deferred upload now lives at this position
+    if (this->m_pendingBufferDigests.contains(charBufferNumber)) {
+        this->m_pendingPositionDigests.insert(positionNumber, this->m_pendingBufferDigests.take(charBufferNumber));
+    }
+    // The buffer now mirrors the stored position
+    if (this->templateCache()) {
+        this->templateCache()->invalidate(positionNumber);
+        if (this->m_bufferCharacteristics.contains(charBufferNumber)) {
+            this->templateCache()->insert(positionNumber, this->m_bufferCharacteristics.value(charBufferNumber));
+        }
+    }
+    this->m_bufferPositions.insert(charBufferNumber, positionNumber);
+}
+
+void QFingerprint::templatesDeleted(quint16 positionNumber, quint16 count) {
+    for (quint16 i = 0; i < count; i++) {
+        this->m_pendingPositionDigests.remove(positionNumber + i);
+    }
+    for (uint8_t charBufferNumber : this->m_bufferPositions.keys()) {
+        quint16 bufferPosition = this->m_bufferPositions.value(charBufferNumber);
+        if (bufferPosition >= positionNumber && bufferPosition - positionNumber < count) {
+            this->m_bufferPositions.remove(charBufferNumber);
+        }
+    }
+    if (this->templateCache()) {
+        this->templateCache()->invalidate(positionNumber, count);
+    }
+}
+
+QFingerprintResult<QFingerprintMatch> QFingerprint::trySearchTemplate(uint8_t charBufferNumber, quint16 positionStart, quint16 count) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        return QFingerprintResult<QFingerprintMatch>(QFingerprintError::InvalidArgument, "The given charbuffer number is invalid!");
+    }
+
+    // A count of zero searches the whole (cached) capacity
+    if (count == 0) {
+        QFingerprintResult<quint16> capacity = this->tryStorageCapacity();
+        if (!capacity) {
+            return QFingerprintResult<QFingerprintMatch>(capacity.error(), capacity.errorString());
+        }
+        count = capacity.value();
+    }
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_SEARCHTEMPLATE)
+                 .append(charBufferNumber)
+                 .append(this->rightShift(positionStart, 8))
+                 .append(this->rightShift(positionStart, 0))
+                 .append(this->rightShift(count, 8))
+                 .append(this->rightShift(count, 0));
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    if (!reply) {
+        return QFingerprintResult<QFingerprintMatch>(reply.error(), reply.errorString());
+    }
+    const QByteArray& payload = reply.value();
+    if (payload.size() < 4) {
+        return QFingerprintResult<QFingerprintMatch>(QFingerprintError::BadPacket);
+    }
+
+    QFingerprintMatch match;
+    match.positionNumber = this->leftShift((uint8_t)payload[0], 8) | this->leftShift((uint8_t)payload[1], 0);
+    match.accuracyScore = this->leftShift((uint8_t)payload[2], 8) | this->leftShift((uint8_t)payload[3], 0);
+    return QFingerprintResult<QFingerprintMatch>(match);
+}
+
+QFingerprintResult<void> QFingerprint::tryLoadTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        return QFingerprintResult<void>(QFingerprintError::InvalidArgument, "The given charbuffer number is invalid!");
+    }
+    if (!this->m_model.isValidPosition(positionNumber)) {
+        return QFingerprintResult<void>(QFingerprintError::InvalidArgument, "The given positionNumber is invalid!");
+    }
+    this->forgetCharBuffer(charBufferNumber);
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_LOADTEMPLATE)
+                 .append(charBufferNumber)
+                 .append(this->rightShift(positionNumber, 8))
+                 .append(this->rightShift(positionNumber, 0));
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    if (!reply) {
+        return QFingerprintResult<void>(reply.error(), reply.errorString());
+    }
+    this->m_bufferPositions.insert(charBufferNumber, positionNumber);
+    return QFingerprintResult<void>();
+}
+
+QFingerprintResult<quint16> QFingerprint::tryCompareCharacteristics() {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_COMPARECHARACTERISTICS);
+
+    QFingerprintResult<QByteArray> reply = this->tryCommand(packetPayload);
+    if (!reply) {
+        return QFingerprintResult<quint16>(reply.error(), reply.errorString());
+    }
+    const QByteArray& payload = reply.value();
+    if (payload.size() < 2) {
+        return QFingerprintResult<quint16>(QFingerprintError::BadPacket);
+    }
+    return QFingerprintResult<quint16>(this->leftShift((uint8_t)payload[0], 8) | this->leftShift((uint8_t)payload[1], 0));
+}
+
+void QFingerprint::unpackImage(const QByteArray& imageData, QImage* image) {
+    unpackImage(imageData.constData(), imageData.size(), 0, image);
+}
+
+// Every byte holds two 4 bit pixels. The image is filled from its last
+// pixel backwards, the orientation downloadImage() always produced.
+// byteOffset is the position of data in the whole image transfer, the
+// number of bytes that fitted into the image is returned. Scanlines are
+// addressed through bytesPerLine(), which may be wider than the image.
+int QFingerprint::unpackImage(const char* data, int size, int byteOffset, QImage* image) {
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    int width = image->width();
+    int pixelCount = width * image->height();
+    int byteCount = qMax(0, qMin(size, pixelCount / 2 - byteOffset));
+    if (byteCount == 0) {
+        return 0;
+    }
+
+    int pixel = pixelCount - 1 - 2 * byteOffset;
+    int row = pixel / width;
+    int column = pixel % width;
+    uchar* line = image->scanLine(row);
+
+    for (int i = 0; i < 2 * byteCount; i++) {
+        line[column] = (i % 2 ? bytes[i / 2] & 0x0F : bytes[i / 2] >> 4) * 17;
+        if (--column < 0 && --row >= 0) {
+            column = width - 1;
+            line = image->scanLine(row);
+        }
+    }
+    return byteCount;
+}
+
+// Inverse of unpackImage(), pixels are rounded to the nearest of the 16 levels
+QByteArray QFingerprint::packImage(const QImage& image) {
+    QImage grayscale = image.format() == QImage::Format_Grayscale8 ? image : image.convertToFormat(QImage::Format_Grayscale8);
+    int width = grayscale.width();
+    int height = grayscale.height();
+    QByteArray imageData(width * height / 2, 0);
+    if (imageData.isEmpty()) {
+        return imageData;
+    }
+    uchar* bytes = reinterpret_cast<uchar*>(imageData.data());
+
+    int row = height - 1;
+    int column = width - 1;
+    const uchar* line = grayscale.constScanLine(row);
+
+    for (int i = 0; i < 2 * imageData.size(); i++) {
+        int level = (line[column] + 8) / 17;
+        bytes[i / 2] |= i % 2 ? level : level << 4;
+        if (--column < 0 && --row >= 0) {
+            column = width - 1;
+            line = grayscale.constScanLine(row);
+        }
+    }
+    return imageData;
+}
+
+// Sends the download command and checks its acknowledgement, the image data
+// packets follow
+void QFingerprint::requestImageDownload() {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_DOWNLOADIMAGE);
+
+    this->writePacket(FINGERPRINT_COMMANDPACKET, packetPayload);
+
+    // Get the first reply packet
+    QByteArray receivedPacket = this->readPacket();
+    uint8_t receivedPacketType = receivedPacket[0];
+    QByteArray receivedPacketPayload = receivedPacket.mid(1);
+
+    if (receivedPacketType != FINGERPRINT_ACKPACKET) {
+        throw QFingerprintException("The received packet is no ack packet!");
+    }
+
+    // The sensor will send follow-up packets
+    if (receivedPacketPayload[0] == FINGERPRINT_OK) {
+    }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_COMMUNICATION) {
+        throw QFingerprintException("Communication error");
+    }else if (receivedPacketPayload[0] == FINGERPRINT_ERROR_DOWNLOADIMAGE) {
+        throw QFingerprintException("Could not download image");
+    }else {
+        QString message("Unknown error 0x");
+        message += receivedPacketPayload.left(1).toHex();
+        throw QFingerprintException(message.toStdString());
+    }
+}
+
+void QFingerprint::discardInput() {
+    if (this->serial()) {
+        this->serial()->clear();
+    } else if (this->device()) {
+        this->device()->readAll();
+    }
+    this->m_decoder.clear();
+}
+
+void QFingerprint::forgetCharBuffer(uint8_t charBufferNumber) {
+    this->m_pendingBufferDigests.remove(charBufferNumber);
+    this->m_bufferPositions.remove(charBufferNumber);
+    this->m_bufferCharacteristics.remove(charBufferNumber);
+    this->m_bufferDigests.remove(charBufferNumber);
+}
+
@@ -31,6 +31,21 @@
 #include <QException>
 #include <exception>
 #include <QDebug>
+#include <QHash>
+#include <QByteArrayList>
+#include <QDeadlineTimer>
+#include <QAtomicInteger>
+#include "qfingerprintframe.h"
+#include "qfingerprintmodel.h"
+
+class QImage;
+struct QFingerprintDeviceProfile;
+class QFingerprintTemplateCache;
+class QFingerprintCapture;
+class QFingerprintCancellation;
+class QFingerprintBusChannel;
+class QFingerprintTrace;
+class QFingerprintImageWriter;
 
 // Baotou start byte
 #define FINGERPRINT_STARTCODE 0xEF01
@@ -95,6 +110,8 @@
 #define FINGERPRINT_PACKETRESPONSEFAIL 0x0E
 #define FINGERPRINT_ERROR_TIMEOUT 0xFF
 #define FINGERPRINT_ERROR_BADPACKET 0xFE
+#define FINGERPRINT_ERROR_CANCELLED 0xFD
+#define FINGERPRINT_ERROR_INVALIDARGUMENT 0xFC
 
 // Char buffers
 #define FINGERPRINT_CHARBUFFER1 0x01
@@ -112,6 +129,169 @@ public:
 };
 
 
+enum class QFingerprintError : uint8_t {
+    NoError,
+    Communication,
+    WrongPassword,
+    InvalidRegister,
+    NoFinger,
+    ReadImage,
+    MessyImage,
+    FewFeaturePoints,
+    InvalidImage,
+    CharacteristicsMismatch,
+    InvalidPosition,
+    Flash,
+    NoTemplateFound,
+    LoadTemplate,
+    DeleteTemplate,
+    ClearDatabase,
+    NotMatching,
+    DownloadImage,
+    DownloadCharacteristics,
+    AddressCode,
+    PassVerify,
+    PacketResponseFail,
+    Timeout,
+    BadPacket,
+    Cancelled,
+    InvalidArgument,
+    Unknown
+};
+
+
+struct QFingerprintErrorInfo {
+    uint8_t code;
+    QFingerprintError error;
+    const char* message;
+};
+
+// Every confirmation code of an ack packet, the host side failures use the
+// timeout, bad packet and cancelled codes
+constexpr QFingerprintErrorInfo QFINGERPRINT_ERRORS[] = {
+    {FINGERPRINT_OK, QFingerprintError::NoError, "No error"},
+    {FINGERPRINT_ERROR_COMMUNICATION, QFingerprintError::Communication, "Communication error"},
+    {FINGERPRINT_ERROR_WRONGPASSWORD, QFingerprintError::WrongPassword, "The password is wrong"},
+    {FINGERPRINT_ERROR_INVALIDREGISTER, QFingerprintError::InvalidRegister, "Invalid register number"},
+    {FINGERPRINT_ERROR_NOFINGER, QFingerprintError::NoFinger, "No finger found"},
+    {FINGERPRINT_ERROR_READIMAGE, QFingerprintError::ReadImage, "Could not read image"},
+    {FINGERPRINT_ERROR_MESSYIMAGE, QFingerprintError::MessyImage, "The image is too messy"},
+    {FINGERPRINT_ERROR_FEWFEATUREPOINTS, QFingerprintError::FewFeaturePoints, "The image contains too few feature points"},
+    {FINGERPRINT_ERROR_INVALIDIMAGE, QFingerprintError::InvalidImage, "The image is invalid"},
+    {FINGERPRINT_ERROR_CHARACTERISTICSMISMATCH, QFingerprintError::CharacteristicsMismatch, "The characteristics do not match"},
+    {FINGERPRINT_ERROR_INVALIDPOSITION, QFingerprintError::InvalidPosition, "Invalid position"},
+    {FINGERPRINT_ERROR_FLASH, QFingerprintError::Flash, "Error writing to flash"},
+    {FINGERPRINT_ERROR_NOTEMPLATEFOUND, QFingerprintError::NoTemplateFound, "No matching template found"},
+    {FINGERPRINT_ERROR_LOADTEMPLATE, QFingerprintError::LoadTemplate, "The template could not be read"},
+    {FINGERPRINT_ERROR_DELETETEMPLATE, QFingerprintError::DeleteTemplate, "Could not delete template"},
+    {FINGERPRINT_ERROR_CLEARDATABASE, QFingerprintError::ClearDatabase, "Could not clear database"},
+    {FINGERPRINT_ERROR_NOTMATCHING, QFingerprintError::NotMatching, "The characteristics are not matching"},
+    {FINGERPRINT_ERROR_DOWNLOADIMAGE, QFingerprintError::DownloadImage, "Could not download image"},
+    {FINGERPRINT_ERROR_DOWNLOADCHARACTERISTICS, QFingerprintError::DownloadCharacteristics, "Could not download characteristics"},
+    {FINGERPRINT_ADDRCODE, QFingerprintError::AddressCode, "The address is wrong"},
+    {FINGERPRINT_PASSVERIFY, QFingerprintError::PassVerify, "The password must be verified"},
+    {FINGERPRINT_PACKETRESPONSEFAIL, QFingerprintError::PacketResponseFail, "Could not receive the follow-up packets"},
+    {FINGERPRINT_ERROR_TIMEOUT, QFingerprintError::Timeout, "Timeout"},
+    {FINGERPRINT_ERROR_BADPACKET, QFingerprintError::BadPacket, "Bad packet"},
+    {FINGERPRINT_ERROR_CANCELLED, QFingerprintError::Cancelled, "Cancelled"},
+    {FINGERPRINT_ERROR_INVALIDARGUMENT, QFingerprintError::InvalidArgument, "Invalid argument"},
+};
+
+constexpr int QFINGERPRINT_ERRORCOUNT = sizeof(QFINGERPRINT_ERRORS) / sizeof(QFINGERPRINT_ERRORS[0]);
+
+constexpr QFingerprintError qFingerprintErrorFromCode(uint8_t code, int i = 0) {
+    return i >= QFINGERPRINT_ERRORCOUNT ? QFingerprintError::Unknown
+         : QFINGERPRINT_ERRORS[i].code == code ? QFINGERPRINT_ERRORS[i].error
+         : qFingerprintErrorFromCode(code, i + 1);
+}
+
+constexpr const char* qFingerprintErrorMessage(QFingerprintError error, int i = 0) {
+    return i >= QFINGERPRINT_ERRORCOUNT ? "Unknown error"
+         : QFINGERPRINT_ERRORS[i].error == error ? QFINGERPRINT_ERRORS[i].message
+         : qFingerprintErrorMessage(error, i + 1);
+}
+
+
+// Value or error of a command, for callers which do not want to pay for
+// exceptions on normal outcomes like "no finger" or "no match". value()
+// throws a QFingerprintException for callers which prefer exceptions.
+template<typename T>
+class QFingerprintResult {
+public:
+    QFingerprintResult(const T& value) : m_value(value) {}
+    QFingerprintResult(QFingerprintError error, const char* message = nullptr)
+        : m_value(), m_error(error), m_message(message) {}
+
+    bool hasValue() const { return m_error == QFingerprintError::NoError; }
+    explicit operator bool() const { return hasValue(); }
+    QFingerprintError error() const { return m_error; }
+    const char* errorString() const { return m_message ? m_message : qFingerprintErrorMessage(m_error); }
+
+    const T& value() const {
+        if (!hasValue()) {
+            throw QFingerprintException(this->errorString());
+        }
+        return m_value;
+    }
+    T valueOr(const T& defaultValue) const { return hasValue() ? m_value : defaultValue; }
+
+private:
+    T m_value;
+    QFingerprintError m_error = QFingerprintError::NoError;
+    const char* m_message = nullptr;
+};
+
+template<>
+class QFingerprintResult<void> {
+public:
+    QFingerprintResult() {}
+    QFingerprintResult(QFingerprintError error, const char* message = nullptr)
+        : m_error(error), m_message(message) {}
+
+    bool hasValue() const { return m_error == QFingerprintError::NoError; }
+    explicit operator bool() const { return hasValue(); }
+    QFingerprintError error() const { return m_error; }
+    const char* errorString() const { return m_message ? m_message : qFingerprintErrorMessage(m_error); }
+
+    void value() const {
+        if (!hasValue()) {
+            throw QFingerprintException(this->errorString());
+        }
+    }
+
+private:
+    QFingerprintError m_error = QFingerprintError::NoError;
+    const char* m_message = nullptr;
+};
+
+
+struct QFingerprintMatch {
+    quint16 positionNumber;
+    quint16 accuracyScore;
+};
+
+
+struct QFingerprintProbeResult {
+    QList<qint16> result;   // Position and accuracy score, as from searchTemplate()
+    bool success;
+    QString error;          // Why a failed probe was not searched
+};
+
+
+struct QFingerprintBatchSearchResult {
+    QList<QFingerprintProbeResult> results;
+    qreal probesPerSecond;
+};
+
+
+struct QFingerprintRangeResult {
+    quint16 positionStart;
+    quint16 count;
+    bool success;
+    QString error;      // Why a failed range was not deleted
+};
+
+
 class QFingerprint : public QObject {
     Q_OBJECT
     Q_PROPERTY(quint32 address MEMBER m_address)
@@ -120,6 +300,16 @@ class QFingerprint : public QObject {
     Q_PROPERTY(QSerialPort* serial MEMBER m_serial)
 
 public:
+    // Read back policy of uploadCharacteristics()
+    enum UploadVerification {
+        NoVerification,         // Trust the data phase
+        FullVerification,       // Download the char buffer and compare it, the only byte exact check
+        ProbeVerification,      // Match against the other char buffer if it holds the same data, else read back.
+                                // A match score is a similarity, an upload corrupted in a few bytes may pass
+        DeferredVerification    // Remember a digest, verify later with verifyDeferredUploads()
+    };
+    Q_ENUM(UploadVerification)
+
     explicit QFingerprint(QObject* parent=nullptr);
     ~QFingerprint();
 
@@ -135,13 +325,68 @@ public:
     QSerialPort* serial() const;
     void setSerial(QSerialPort* serial);
 
+    // Any other transport, e.g. a simulated sensor
+    QIODevice* device() const;
+    void setDevice(QIODevice* device);
+
+    // Capacity and packet size of a known model are not asked for, e.g.
+    // setModel<QFingerprintZfm60>(). setMaxPacketSize() overrides the packet
+    // size of the model until the next initialize_device().
+    QFingerprintModel model() const;
+    void setModel(const QFingerprintModel& model);
+    template<typename Model>
+    void setModel() { this->setModel(qFingerprintModel<Model>()); }
+
+    // Emit imageRowsReady() while an image is downloaded, bottom row first
+    bool progressiveImage() const;
+    void setProgressiveImage(bool progressive);
+
+    UploadVerification uploadVerification() const;
+    void setUploadVerification(UploadVerification verification);
+
+    QFingerprintCapture* capture() const;
+    void setCapture(QFingerprintCapture* capture);
+
+    QFingerprintTemplateCache* templateCache() const;
+    void setTemplateCache(QFingerprintTemplateCache* cache);
+
+    // Spans of every packet written and read, may be shared by many sensors
+    QFingerprintTrace* trace() const;
+    void setTrace(QFingerprintTrace* trace);
+
+    // Saves the images of downloadImage(QString) in the background
+    QFingerprintImageWriter* imageWriter() const;
+    void setImageWriter(QFingerprintImageWriter* writer);
+
+    // Checked while waiting for the sensor, see QFingerprintOperation. A
+    // command interrupted by either leaves its reply to drainPendingReply().
+    QFingerprintCancellation* cancellation() const;
+    void setCancellation(QFingerprintCancellation* cancellation);
+    QDeadlineTimer deadline() const;
+    void setDeadline(QDeadlineTimer deadline);
+
+    // When the last command was sent, as QDeadlineTimer::current().deadline().
+    // May be read from any thread, e.g. to stay off a sensor in use.
+    qint64 lastCommandTime() const;
+
     void initialize_device(QString port="/dev/ttyUSB0",
                            quint32 baudRate=57600,
                            quint32 address=0xFFFFFFFF,
                            quint32 password=0x00000000);
+    // Connects with a profile from QFingerprintDiscovery, packet size and
+    // capacity are taken from it instead of being asked for later
+    void initialize_device(const QFingerprintDeviceProfile& profile);
+    // A module on a shared line, the address is the one of the channel
+    void initialize_device(QFingerprintBusChannel* channel, quint32 password = 0x00000000);
 
     void writePacket(uint8_t packetType, QByteArray packetPayload);
     QByteArray readPacket();
+    QFingerprintResult<void> tryWritePacket(uint8_t packetType, const QByteArray& packetPayload);
+    QFingerprintResult<QByteArray> tryReadPacket();
+    // Reads the rest of an interrupted reply, false if the input had to be
+    // discarded instead once the line was quiet. Called by the next command
+    // otherwise.
+    bool drainPendingReply();
     bool verifyPassword();
     bool setPassword();
 
@@ -157,7 +402,11 @@ public:
     QBitArray getTemplateIndex(uint8_t page);
     quint16 getTemplateCount();
     bool readImage();
+    // Encodes and saves the image, on the threads of imageWriter() if set
     void downloadImage(QString imageDestination);
+    void downloadImage(QImage* image);
+    // The packed 4 bit pixels as sent by the sensor
+    QByteArray downloadImageData();
     bool convertImage(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
     bool createTemplate();
     quint16 storeTemplate(qint16 positionNumber = -1,
@@ -166,15 +415,41 @@ public:
     QList<qint16> searchTemplate(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1,
                                   quint16 positionStart = 0,
                                   qint16 count = -1);
+    QFingerprintBatchSearchResult searchTemplates(QList<QList<uint8_t>> probes,
+                                                  quint16 positionStart = 0,
+                                                  qint16 count = -1);
     bool loadTemplate(quint16 positionNumber,
                       uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
     bool deleteTemplate(quint16 positionNumber, quint16 count);
+    QList<QFingerprintRangeResult> deleteTemplates(QList<quint16> positionNumbers);
     bool clearDatabase();
     quint16 compareCharacteristics();
     bool uploadCharacteristics(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1,
                                QList<uint8_t> characteristicsData = {0});
     quint32 generateRandomNumber();
     QList<uint8_t> downloadCharacteristics(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QList<uint8_t> downloadTemplate(quint16 positionNumber,
+                                    uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QList<quint16> verifyDeferredUploads();
+
+    static void unpackImage(const QByteArray& imageData, QImage* image);
+    static int unpackImage(const char* data, int size, int byteOffset, QImage* image);
+    static QByteArray packImage(const QImage& image);
+
+    // Exception free variants of the identification hot path
+    QFingerprintResult<void> tryVerifyPassword();
+    QFingerprintResult<quint16> tryGetTemplateCount();
+    QFingerprintResult<void> tryReadImage();
+    QFingerprintResult<void> tryConvertImage(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintResult<void> tryCreateTemplate();
+    QFingerprintResult<quint16> tryStoreTemplate(quint16 positionNumber,
+                                                 uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintResult<QFingerprintMatch> trySearchTemplate(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1,
+                                                            quint16 positionStart = 0,
+                                                            quint16 count = 0);
+    QFingerprintResult<void> tryLoadTemplate(quint16 positionNumber,
+                                             uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintResult<quint16> tryCompareCharacteristics();
 
 
 signals:
@@ -182,16 +457,77 @@ signals:
     void passwordChanged();
     void timeoutChanged();
     void serialChanged();
+    // Completed rows of the image being downloaded. The image is rotated by
+    // 180 degrees and fills up from its last row, so the range grows from the
+    // bottom: firstRow decreases with every emit and rows ends where the rows
+    // of the previous emit begin.
+    void imageRowsReady(int firstRow, const QImage& rows);
 
 private:
-    quint32 m_address;
-    quint32 m_password;
-    quint32 m_timeout;
+    quint32 m_address = 0xFFFFFFFF;
+    quint32 m_password = 0x00000000;
+    quint32 m_timeout = 500;
     QSerialPort* m_serial = nullptr;
+    QIODevice* m_device = nullptr;
+    UploadVerification m_uploadVerification = FullVerification;
+    bool m_progressiveImage = false;
+    QFingerprintModel m_model = qFingerprintModel<QFingerprintZfmAny>();
+    quint16 m_maxPacketSize = 0;
+    quint16 m_storageCapacity = 0;
+    QFingerprintFrameDecoder m_decoder;
+    QFingerprintCapture* m_capture = nullptr;
+    QFingerprintTrace* m_trace = nullptr;
+    QFingerprintImageWriter* m_imageWriter = nullptr;
+    uint8_t m_lastInstruction = 0;
+    QFingerprintCancellation* m_cancellation = nullptr;
+    QDeadlineTimer m_deadline = QDeadlineTimer(QDeadlineTimer::Forever);
+    QAtomicInteger<qint64> m_lastCommandTime;
+
+    // The reply of the last command which was not read completely
+    enum PendingReply { NoReply, AckReply, DataReply };
+    PendingReply m_pendingReply = NoReply;
+    bool m_pendingDataPhase = false;
+    qint64 m_pendingReplyBudget = 0;
+
+    // Digests of uploads awaiting verifyDeferredUploads()
+    QHash<uint8_t, QByteArray> m_pendingBufferDigests;
+    QHash<quint16, QByteArray> m_pendingPositionDigests;
+
+    // Known contents of the char buffers, kept for the template cache
+    QFingerprintTemplateCache* m_templateCache = nullptr;
+    QHash<uint8_t, quint16> m_bufferPositions;
+    QHash<uint8_t, QList<uint8_t>> m_bufferCharacteristics;
+
+    // Digests of char buffer contents known to the host, used by ProbeVerification
+    QHash<uint8_t, QByteArray> m_bufferDigests;
 
     uint8_t rightShift(ulong n, int x);
     ulong leftShift(ulong n, int x);
     bool bitAtPosition(ulong n, uint8_t p);
+
+    void resetSession(quint32 address, quint32 password);
+    bool isValidPosition(int positionNumber);
+    bool deleteTemplateRange(quint16 positionNumber, quint16 count, quint16 capacity);
+    QByteArray characteristicsDigest(const QList<uint8_t>& characteristicsData);
+    void forgetCharBuffer(uint8_t charBufferNumber);
+    void discardInput();
+    void requestImageDownload();
+    QByteArrayList characteristicsPackets(const QList<uint8_t>& characteristicsData);
+    void writeCharacteristics(uint8_t charBufferNumber, const QByteArrayList& packets);
+    void writeSearchCommand(uint8_t charBufferNumber, quint16 positionStart, quint16 templatesCount);
+    QList<qint16> readSearchResult();
+    QFingerprintResult<QByteArray> tryCommand(const QByteArray& packetPayload);
+    QFingerprintResult<QByteArray> tryReadAck();
+    QFingerprintResult<QByteArray> readFrame(bool interruptible, qint64 timeout);
+    QFingerprintResult<QByteArray> receiveFrame(bool interruptible, qint64 timeout);
+    QFingerprintResult<void> checkInterrupted() const;
+    QFingerprintResult<quint16> tryStorageCapacity();
+    void characteristicsUploaded(uint8_t charBufferNumber, const QList<uint8_t>& characteristicsData);
+    void templateStored(quint16 positionNumber, uint8_t charBufferNumber);
+    void templatesDeleted(quint16 positionNumber, quint16 count);
+
+    // Splits commands into write and read phases to overlap several sensors
+    friend class QFingerprintMirror;
 };
 
 #endif /* end of include guard */
@@ -0,0 +1,342 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintasync.h"
+
+
+namespace {
+
+quint16 replyWord(const QByteArray& payload, int index) {
+    return quint16((quint16(uint8_t(payload[index])) << 8) | uint8_t(payload[index + 1]));
+}
+
+QFingerprintResult<void> acknowledged(const QFingerprintResult<QByteArray>& reply) {
+    return QFingerprintResult<void>(reply.error(), reply ? nullptr : reply.errorString());
+}
+
+QFingerprintResult<quint16> firstWord(const QFingerprintResult<QByteArray>& reply) {
+    if (!reply) {
+        return QFingerprintResult<quint16>(reply.error(), reply.errorString());
+    }
+    if (reply.value().size() < 2) {
+        return QFingerprintResult<quint16>(QFingerprintError::BadPacket);
+    }
+    return QFingerprintResult<quint16>(replyWord(reply.value(), 0));
+}
+
+bool isCharBuffer(uint8_t charBufferNumber) {
+    return charBufferNumber == FINGERPRINT_CHARBUFFER1 || charBufferNumber == FINGERPRINT_CHARBUFFER2;
+}
+
+QByteArray appendWord(QByteArray packetPayload, quint16 word) {
+    return packetPayload.append(char(word >> 8)).append(char(word & 0xFF));
+}
+
+}
+
+
+QFingerprintAsync::QFingerprintAsync(QIODevice* device, quint32 address, QObject* parent)
+    : QObject(parent), m_device(device), m_address(address)
+{
+    m_timer.setSingleShot(true);
+    connect(device, &QIODevice::readyRead, this, &QFingerprintAsync::receive);
+    connect(&m_timer, &QTimer::timeout, this, &QFingerprintAsync::expire);
+}
+
+QIODevice* QFingerprintAsync::device() const {
+    return m_device;
+}
+
+quint32 QFingerprintAsync::address() const {
+    return m_address;
+}
+
+int QFingerprintAsync::timeout() const {
+    return m_timeout;
+}
+
+void QFingerprintAsync::setTimeout(int msecs) {
+    m_timeout = msecs;
+}
+
+void QFingerprintAsync::enqueue(const QByteArray& packetPayload, Callback callback, bool dataPhase, int timeout) {
+    Command command;
+    command.packetPayload = packetPayload;
+    command.callback = callback;
+    command.dataPhase = dataPhase;
+    command.timeout = timeout;
+    m_commands.enqueue(command);
+    this->startNext();
+}
+
+int QFingerprintAsync::pendingCommands() const {
+    return m_commands.size();
+}
+
+QFingerprintCommand<QByteArray> QFingerprintAsync::command(const QByteArray& packetPayload, bool dataPhase) {
+    return QFingerprintCommand<QByteArray>(this, packetPayload, [](const QFingerprintResult<QByteArray>& reply) {
+        return reply;
+    }, dataPhase);
+}
+
+QFingerprintCommand<void> QFingerprintAsync::verifyPassword(quint32 password) {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_VERIFYPASSWORD)
+                 .append(char(password >> 24))
+                 .append(char(password >> 16))
+                 .append(char(password >> 8))
+                 .append(char(password));
+    return QFingerprintCommand<void>(this, packetPayload, acknowledged);
+}
+
+QFingerprintCommand<quint16> QFingerprintAsync::getTemplateCount() {
+    return QFingerprintCommand<quint16>(this, QByteArray(1, char(FINGERPRINT_TEMPLATECOUNT)), firstWord);
+}
+
+QFingerprintCommand<void> QFingerprintAsync::readImage() {
+    return QFingerprintCommand<void>(this, QByteArray(1, char(FINGERPRINT_READIMAGE)), acknowledged);
+}
+
+// The packed 4 bit pixels, see QFingerprint::unpackImage()
+QFingerprintCommand<QByteArray> QFingerprintAsync::downloadImageData() {
+    return QFingerprintCommand<QByteArray>(this, QByteArray(1, char(FINGERPRINT_DOWNLOADIMAGE)),
+                                           [](const QFingerprintResult<QByteArray>& reply) { return reply; }, true);
+}
+
+QFingerprintCommand<void> QFingerprintAsync::convertImage(uint8_t charBufferNumber) {
+    if (!isCharBuffer(charBufferNumber)) {
+        return QFingerprintCommand<void>(QFingerprintResult<void>(QFingerprintError::InvalidArgument,
+                                                                  "The given charbuffer number is invalid!"));
+    }
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_CONVERTIMAGE)
+                 .append(charBufferNumber);
+    return QFingerprintCommand<void>(this, packetPayload, acknowledged);
+}
+
+QFingerprintCommand<void> QFingerprintAsync::createTemplate() {
+    return QFingerprintCommand<void>(this, QByteArray(1, char(FINGERPRINT_CREATETEMPLATE)), acknowledged);
+}
+
+QFingerprintCommand<quint16> QFingerprintAsync::storeTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
+    if (!isCharBuffer(charBufferNumber)) {
+        return QFingerprintCommand<quint16>(QFingerprintResult<quint16>(QFingerprintError::InvalidArgument,
+                                                                        "The given charbuffer number is invalid!"));
+    }
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_STORETEMPLATE)
+                 .append(charBufferNumber);
+    return QFingerprintCommand<quint16>(this, appendWord(packetPayload, positionNumber),
+                                        [positionNumber](const QFingerprintResult<QByteArray>& reply) {
+        if (!reply) {
+            return QFingerprintResult<quint16>(reply.error(), reply.errorString());
+        }
+        return QFingerprintResult<quint16>(positionNumber);
+    });
+}
+
+QFingerprintCommand<QFingerprintMatch> QFingerprintAsync::searchTemplate(quint16 positionStart, quint16 count,
+                                                                         uint8_t charBufferNumber) {
+    if (!isCharBuffer(charBufferNumber)) {
+        return QFingerprintCommand<QFingerprintMatch>(QFingerprintResult<QFingerprintMatch>(
+            QFingerprintError::InvalidArgument, "The given charbuffer number is invalid!"));
+    }
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_SEARCHTEMPLATE)
+                 .append(charBufferNumber);
+    packetPayload = appendWord(appendWord(packetPayload, positionStart), count);
+    return QFingerprintCommand<QFingerprintMatch>(this, packetPayload, [](const QFingerprintResult<QByteArray>& reply) {
+        if (!reply) {
+            return QFingerprintResult<QFingerprintMatch>(reply.error(), reply.errorString());
+        }
+        if (reply.value().size() < 4) {
+            return QFingerprintResult<QFingerprintMatch>(QFingerprintError::BadPacket);
+        }
+        QFingerprintMatch match;
+        match.positionNumber = replyWord(reply.value(), 0);
+        match.accuracyScore = replyWord(reply.value(), 2);
+        return QFingerprintResult<QFingerprintMatch>(match);
+    });
+}
+
+QFingerprintCommand<void> QFingerprintAsync::loadTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
+    if (!isCharBuffer(charBufferNumber)) {
+        return QFingerprintCommand<void>(QFingerprintResult<void>(QFingerprintError::InvalidArgument,
+                                                                  "The given charbuffer number is invalid!"));
+    }
+
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_LOADTEMPLATE)
+                 .append(charBufferNumber);
+    return QFingerprintCommand<void>(this, appendWord(packetPayload, positionNumber), acknowledged);
+}
+
+QFingerprintCommand<void> QFingerprintAsync::deleteTemplate(quint16 positionNumber, quint16 count) {
+    QByteArray packetPayload(1, char(FINGERPRINT_DELETETEMPLATE));
+    return QFingerprintCommand<void>(this, appendWord(appendWord(packetPayload, positionNumber), count), acknowledged);
+}
+
+QFingerprintCommand<quint16> QFingerprintAsync::compareCharacteristics() {
+    return QFingerprintCommand<quint16>(this, QByteArray(1, char(FINGERPRINT_COMPARECHARACTERISTICS)), firstWord);
+}
+
+// The timer is started before writing, a device may reply from within write()
+void QFingerprintAsync::startNext() {
+    if (m_busy || m_draining || m_commands.isEmpty()) {
+        return;
+    }
+
+    const Command& command = m_commands.head();
+    m_busy = true;
+    m_acknowledged = false;
+    m_data.clear();
+    m_timer.start(command.timeout < 0 ? m_timeout : command.timeout);
+    m_device->write(QFingerprintFrame::encode(m_address, FINGERPRINT_COMMANDPACKET, m_commands.head().packetPayload));
+}
+
+void QFingerprintAsync::receive() {
+    QByteArray bytes = m_device->readAll();
+    // The line is not quiet as long as the late reply is still arriving
+    if (m_draining && !bytes.isEmpty()) {
+        m_timer.start(m_drainTimeout);
+    }
+    m_decoder.feed(bytes);
+
+    QByteArray packet;
+    while (true) {
+        QFingerprintFrameDecoder::Status status = m_decoder.next(&packet);
+        if (status == QFingerprintFrameDecoder::Incomplete) {
+            break;
+        }
+        if (status == QFingerprintFrameDecoder::Frame) {
+            if (m_draining) {
+                this->drainPacket(packet);
+            }else {
+                this->handlePacket(packet);
+            }
+        }else if (status == QFingerprintFrameDecoder::BadChecksum && m_busy && !m_draining) {
+            // The rest of the reply may still be on its way
+            this->fail(QFingerprintResult<QByteArray>(QFingerprintError::BadPacket));
+        }
+    }
+}
+
+void QFingerprintAsync::handlePacket(const QByteArray& packet) {
+    if (!m_busy) {
+        return;
+    }
+
+    // The timeout is the longest silence between two packets, a long data
+    // phase does not expire while its packets keep arriving
+    const Command& command = m_commands.head();
+    m_timer.start(command.timeout < 0 ? m_timeout : command.timeout);
+
+    uint8_t packetType = packet[0];
+    bool dataPhase = command.dataPhase;
+
+    if (packetType == FINGERPRINT_ACKPACKET && !m_acknowledged) {
+        uint8_t code = packet.size() > 1 ? uint8_t(packet[1]) : FINGERPRINT_ERROR_BADPACKET;
+        if (code != FINGERPRINT_OK) {
+            this->complete(QFingerprintResult<QByteArray>(qFingerprintErrorFromCode(code)));
+        }else if (dataPhase) {
+            m_acknowledged = true;
+        }else {
+            this->complete(QFingerprintResult<QByteArray>(packet.mid(2)));
+        }
+    }else if (dataPhase && m_acknowledged
+              && (packetType == FINGERPRINT_DATAPACKET || packetType == FINGERPRINT_ENDDATAPACKET)) {
+        m_data.append(packet.constData() + 1, packet.size() - 1);
+        if (packetType == FINGERPRINT_ENDDATAPACKET) {
+            this->complete(QFingerprintResult<QByteArray>(m_data));
+        }
+    }
+}
+
+// The next command is sent before the callback runs, a resumed workflow
+// queues behind it
+void QFingerprintAsync::complete(const QFingerprintResult<QByteArray>& reply) {
+    Command command = m_commands.dequeue();
+    m_busy = false;
+    m_acknowledged = false;
+    // A drain keeps the timer for its quiet deadline
+    if (!m_draining) {
+        m_timer.stop();
+    }
+
+    this->startNext();
+    if (command.callback) {
+        command.callback(reply);
+    }
+}
+
+// Whatever arrives late belongs to the expired command. The next command is
+// held back until its reply ended or the line was quiet for the timeout of
+// the expired command, so a late reply is never taken for the next one.
+void QFingerprintAsync::expire() {
+    if (m_draining) {
+        m_decoder.clear();
+        this->finishDrain();
+        return;
+    }
+    if (!m_busy) {
+        return;
+    }
+    this->fail(QFingerprintResult<QByteArray>(QFingerprintError::Timeout));
+}
+
+// Completes the current command and drains what is left of its reply
+void QFingerprintAsync::fail(const QFingerprintResult<QByteArray>& reply) {
+    const Command& command = m_commands.head();
+    m_draining = true;
+    m_drainDataPhase = command.dataPhase;
+    m_drainAcknowledged = m_acknowledged;
+    m_drainTimeout = command.timeout < 0 ? m_timeout : command.timeout;
+    m_timer.start(m_drainTimeout);
+    this->complete(reply);
+}
+
+void QFingerprintAsync::drainPacket(const QByteArray& packet) {
+    uint8_t packetType = packet[0];
+
+    if (packetType == FINGERPRINT_ACKPACKET && !m_drainAcknowledged) {
+        uint8_t code = packet.size() > 1 ? uint8_t(packet[1]) : FINGERPRINT_ERROR_BADPACKET;
+        if (code == FINGERPRINT_OK && m_drainDataPhase) {
+            m_drainAcknowledged = true;
+        }else {
+            this->finishDrain();
+        }
+    }else if (m_drainDataPhase && m_drainAcknowledged && packetType == FINGERPRINT_ENDDATAPACKET) {
+        this->finishDrain();
+    }
+}
+
+void QFingerprintAsync::finishDrain() {
+    m_draining = false;
+    m_timer.stop();
+    this->startNext();
+}
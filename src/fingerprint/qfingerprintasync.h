@@ -0,0 +1,286 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTASYNC_H
+#define QFINGERPRINTASYNC_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+
+#include <functional>
+
+#include "qfingerprint.h"
+#include "qfingerprintframe.h"
+
+// Coroutine support needs a C++20 compiler, e.g. CONFIG += c++2a
+#if defined(__cpp_impl_coroutine)
+#  if __has_include(<coroutine>)
+#    define QFINGERPRINT_COROUTINES
+#    include <coroutine>
+#    include <exception>
+#    include <optional>
+#  endif
+#endif
+
+class QFingerprintAsync;
+
+
+// A command of QFingerprintAsync. It is started by then() or by co_await,
+// the result is delivered from the event loop once the reply is decoded.
+template<typename T>
+class QFingerprintCommand {
+public:
+    typedef QFingerprintResult<T> Result;
+    typedef std::function<Result(const QFingerprintResult<QByteArray>& reply)> Parser;
+
+    QFingerprintCommand(QFingerprintAsync* engine, const QByteArray& packetPayload, Parser parser, bool dataPhase = false)
+        : m_engine(engine), m_packetPayload(packetPayload), m_parser(parser), m_dataPhase(dataPhase), m_timeout(-1),
+          m_rejected(QFingerprintError::NoError) {}
+    // A command rejected before it was sent
+    explicit QFingerprintCommand(const Result& rejected)
+        : m_engine(nullptr), m_dataPhase(false), m_timeout(-1), m_rejected(rejected) {}
+
+    // Overrides the timeout of the engine for this command, it is the
+    // longest silence allowed between two packets of the reply
+    QFingerprintCommand withTimeout(int msecs) const {
+        QFingerprintCommand command(*this);
+        command.m_timeout = msecs;
+        return command;
+    }
+
+    void then(std::function<void(const Result& result)> callback);
+
+private:
+    template<typename U> friend class QFingerprintCommandAwaiter;
+
+    QFingerprintAsync* m_engine;
+    QByteArray m_packetPayload;
+    Parser m_parser;
+    bool m_dataPhase;
+    int m_timeout;
+    Result m_rejected;
+};
+
+
+// Non-blocking command engine on the Qt event loop. Commands are queued and
+// sent one at a time, replies are decoded from readyRead() and a timer
+// expires a command that gets no reply. Many engines, one per sensor, run on
+// one thread; a workflow only keeps its callback or coroutine frame alive.
+//
+//     QFingerprintTask<bool> enroll(QFingerprintAsync* fp, quint16 position) {
+//         if (!co_await fp->readImage() || !co_await fp->convertImage(FINGERPRINT_CHARBUFFER1)) {
+//             co_return false;
+//         }
+//         ...
+//     }
+class QFingerprintAsync : public QObject {
+    Q_OBJECT
+
+public:
+    // The value is the reply payload after the confirmation code, for
+    // commands with a data phase it is the received data
+    typedef std::function<void(const QFingerprintResult<QByteArray>& reply)> Callback;
+
+    explicit QFingerprintAsync(QIODevice* device, quint32 address = 0xFFFFFFFF, QObject* parent = nullptr);
+
+    QIODevice* device() const;
+    quint32 address() const;
+
+    int timeout() const;
+    void setTimeout(int msecs);
+
+    // A negative timeout uses timeout()
+    void enqueue(const QByteArray& packetPayload, Callback callback, bool dataPhase = false, int timeout = -1);
+    int pendingCommands() const;
+
+    QFingerprintCommand<QByteArray> command(const QByteArray& packetPayload, bool dataPhase = false);
+    QFingerprintCommand<void> verifyPassword(quint32 password = 0x00000000);
+    QFingerprintCommand<quint16> getTemplateCount();
+    QFingerprintCommand<void> readImage();
+    QFingerprintCommand<QByteArray> downloadImageData();
+    QFingerprintCommand<void> convertImage(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintCommand<void> createTemplate();
+    QFingerprintCommand<quint16> storeTemplate(quint16 positionNumber, uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintCommand<QFingerprintMatch> searchTemplate(quint16 positionStart, quint16 count,
+                                                          uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintCommand<void> loadTemplate(quint16 positionNumber, uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintCommand<void> deleteTemplate(quint16 positionNumber, quint16 count = 1);
+    QFingerprintCommand<quint16> compareCharacteristics();
+
+private slots:
+    void receive();
+    void expire();
+
+private:
+    struct Command {
+        QByteArray packetPayload;
+        Callback callback;
+        bool dataPhase;
+        int timeout;
+    };
+
+    void startNext();
+    void handlePacket(const QByteArray& packet);
+    void fail(const QFingerprintResult<QByteArray>& reply);
+    void drainPacket(const QByteArray& packet);
+    void finishDrain();
+    void complete(const QFingerprintResult<QByteArray>& reply);
+
+    QIODevice* m_device;
+    quint32 m_address;
+    int m_timeout = 500;
+    bool m_busy = false;
+    bool m_acknowledged = false;
+    // After a timeout the late reply of the expired command is awaited
+    // before the next command is sent
+    bool m_draining = false;
+    bool m_drainDataPhase = false;
+    bool m_drainAcknowledged = false;
+    int m_drainTimeout = 0;
+    QByteArray m_data;
+    QFingerprintFrameDecoder m_decoder;
+    QQueue<Command> m_commands;
+    QTimer m_timer;
+};
+
+
+template<typename T>
+void QFingerprintCommand<T>::then(std::function<void(const Result& result)> callback) {
+    if (!this->m_engine) {
+        callback(this->m_rejected);
+        return;
+    }
+    Parser parser = this->m_parser;
+    this->m_engine->enqueue(this->m_packetPayload, [parser, callback](const QFingerprintResult<QByteArray>& reply) {
+        callback(parser(reply));
+    }, this->m_dataPhase, this->m_timeout);
+}
+
+
+#ifdef QFINGERPRINT_COROUTINES
+
+// Awaits a QFingerprintCommand, it lives in the coroutine frame while the
+// command runs
+template<typename T>
+class QFingerprintCommandAwaiter {
+public:
+    typedef typename QFingerprintCommand<T>::Result Result;
+
+    explicit QFingerprintCommandAwaiter(const QFingerprintCommand<T>& command) : m_command(command) {}
+
+    bool await_ready() const noexcept { return !this->m_command.m_engine; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        this->m_command.then([this, handle](const Result& result) {
+            this->m_result.emplace(result);
+            handle.resume();
+        });
+    }
+    Result await_resume() { return this->m_command.m_engine ? *this->m_result : this->m_command.m_rejected; }
+
+private:
+    QFingerprintCommand<T> m_command;
+    std::optional<Result> m_result;
+};
+
+template<typename T>
+QFingerprintCommandAwaiter<T> operator co_await(const QFingerprintCommand<T>& command) {
+    return QFingerprintCommandAwaiter<T>(command);
+}
+
+
+// Coroutine type of a workflow. It runs right away until its first co_await
+// and can itself be awaited by another workflow. Destroying an unfinished
+// task lets the workflow run to its end on its own.
+template<typename T>
+class QFingerprintTask {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr exception;
+        std::coroutine_handle<> continuation;
+        bool detached = false;
+
+        QFingerprintTask get_return_object() {
+            return QFingerprintTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    promise_type& promise = handle.promise();
+                    if (promise.detached) {
+                        handle.destroy();
+                        return std::noop_coroutine();
+                    }
+                    return promise.continuation ? promise.continuation : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return FinalAwaiter();
+        }
+        void return_value(T result) { this->value.emplace(std::move(result)); }
+        void unhandled_exception() { this->exception = std::current_exception(); }
+    };
+
+    QFingerprintTask(QFingerprintTask&& other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+    QFingerprintTask(const QFingerprintTask&) = delete;
+    QFingerprintTask& operator=(const QFingerprintTask&) = delete;
+    ~QFingerprintTask() {
+        if (!this->m_handle) {
+            return;
+        }
+        if (this->m_handle.done()) {
+            this->m_handle.destroy();
+        }else {
+            this->m_handle.promise().detached = true;
+        }
+    }
+
+    bool isFinished() const { return this->m_handle.done(); }
+    // Rethrows an exception the workflow ended with
+    const T& result() const {
+        if (this->m_handle.promise().exception) {
+            std::rethrow_exception(this->m_handle.promise().exception);
+        }
+        return *this->m_handle.promise().value;
+    }
+
+    bool await_ready() const noexcept { return this->m_handle.done(); }
+    void await_suspend(std::coroutine_handle<> continuation) { this->m_handle.promise().continuation = continuation; }
+    const T& await_resume() const { return this->result(); }
+
+private:
+    explicit QFingerprintTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+#endif
+
+#endif /* end of include guard */
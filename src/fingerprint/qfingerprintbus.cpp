@@ -0,0 +1,374 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintbus.h"
+#include "qfingerprint.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+#include <cstring>
+
+// The thread reading the transport hands over to queued writers this often
+static const qint64 QFINGERPRINTBUS_SLICE = 5;
+
+namespace {
+
+uint8_t frameType(const QByteArray& frame) {
+    return frame.size() > 6 ? uint8_t(frame[6]) : 0;
+}
+
+uint8_t frameInstruction(const QByteArray& frame) {
+    return frame.size() > QFingerprintFrame::HeaderSize ? uint8_t(frame[QFingerprintFrame::HeaderSize]) : 0;
+}
+
+unsigned long sliceOf(const QDeadlineTimer& deadline) {
+    qint64 remaining = deadline.remainingTime();
+    return remaining < 0 ? QFINGERPRINTBUS_SLICE : qMin(remaining, QFINGERPRINTBUS_SLICE);
+}
+
+}
+
+
+QFingerprintBusChannel::QFingerprintBusChannel(QFingerprintBus* bus, quint32 address)
+    : QIODevice(bus), m_bus(bus), m_address(address)
+{
+    this->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+QFingerprintBus* QFingerprintBusChannel::bus() const {
+    return m_bus;
+}
+
+quint32 QFingerprintBusChannel::address() const {
+    return m_address;
+}
+
+bool QFingerprintBusChannel::isSequential() const {
+    return true;
+}
+
+qint64 QFingerprintBusChannel::bytesAvailable() const {
+    return m_bus->available(this) + QIODevice::bytesAvailable();
+}
+
+bool QFingerprintBusChannel::waitForReadyRead(int msecs) {
+    return m_bus->waitForFrame(this, msecs);
+}
+
+bool QFingerprintBusChannel::waitForBytesWritten(int msecs) {
+    return m_bus->waitForWritten(msecs);
+}
+
+qint64 QFingerprintBusChannel::readData(char* data, qint64 maxSize) {
+    return m_bus->take(this, data, maxSize);
+}
+
+qint64 QFingerprintBusChannel::writeData(const char* data, qint64 maxSize) {
+    m_bus->submit(this, QByteArray(data, int(maxSize)));
+    return maxSize;
+}
+
+
+QFingerprintBus::QFingerprintBus(QIODevice* transport, QObject* parent)
+    : QObject(parent), m_transport(transport)
+{
+    m_timer.setSingleShot(true);
+    connect(transport, &QIODevice::readyRead, this, &QFingerprintBus::receive);
+    connect(&m_timer, &QTimer::timeout, this, &QFingerprintBus::receive);
+}
+
+QIODevice* QFingerprintBus::transport() const {
+    return m_transport;
+}
+
+QFingerprintBusChannel* QFingerprintBus::channel(quint32 address) {
+    QMutexLocker locker(&m_mutex);
+    QFingerprintBusChannel* channel = m_channels.value(address);
+    if (!channel) {
+        channel = new QFingerprintBusChannel(this, address);
+        m_channels.insert(address, channel);
+        m_order.append(channel);
+    }
+    return channel;
+}
+
+QList<quint32> QFingerprintBus::addresses() const {
+    QMutexLocker locker(&m_mutex);
+    QList<quint32> addresses;
+    for (QFingerprintBusChannel* channel : m_order) {
+        addresses.append(channel->address());
+    }
+    return addresses;
+}
+
+int QFingerprintBus::timeout() const {
+    return m_timeout;
+}
+
+void QFingerprintBus::setTimeout(int msecs) {
+    QMutexLocker locker(&m_mutex);
+    m_timeout = msecs;
+}
+
+quint64 QFingerprintBus::transactions() const {
+    QMutexLocker locker(&m_mutex);
+    return m_transactions;
+}
+
+quint64 QFingerprintBus::droppedFrames() const {
+    QMutexLocker locker(&m_mutex);
+    return m_droppedFrames;
+}
+
+// Event driven path, also expires a silent module when nobody waits
+void QFingerprintBus::receive() {
+    QList<QFingerprintBusChannel*> notified;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_pumping) {
+            this->route(&notified);
+            this->expire();
+            this->dispatch();
+        }
+        if (m_owner) {
+            m_timer.start(int(qMax<qint64>(m_ownerDeadline.remainingTime(), 0)) + 1);
+        }
+    }
+    this->notify(notified);
+}
+
+// Frames of other threads are written by the thread of the bus
+void QFingerprintBus::submit(QFingerprintBusChannel* channel, const QByteArray& frame) {
+    QMutexLocker locker(&m_mutex);
+    channel->m_outgoing.append(frame);
+    if (this->isBusThread()) {
+        this->dispatch();
+    }else {
+        QMetaObject::invokeMethod(this, "receive", Qt::QueuedConnection);
+    }
+}
+
+bool QFingerprintBus::isBusThread() const {
+    return QThread::currentThread() == this->thread();
+}
+
+// Only the thread of the bus reads the transport. Other threads wait until
+// their frames are routed by receive(). A blocking reader on the thread of
+// the bus dispatches between short waits, so queued commands of other
+// threads go out without delay.
+bool QFingerprintBus::waitForFrame(QFingerprintBusChannel* channel, int msecs) {
+    QList<QFingerprintBusChannel*> notified;
+    QMutexLocker locker(&m_mutex);
+    QDeadlineTimer deadline(msecs);
+
+    while (channel->m_received.isEmpty()) {
+        // The read timeout starts when the command is on the line
+        if (m_owner != channel && !channel->m_outgoing.isEmpty()) {
+            deadline = QDeadlineTimer(msecs);
+        }
+        if (deadline.hasExpired()) {
+            break;
+        }
+        if (m_pumping || !this->isBusThread()) {
+            m_routed.wait(&m_mutex, sliceOf(deadline));
+            continue;
+        }
+
+        this->expire();
+        this->dispatch();
+        m_pumping = true;
+        locker.unlock();
+        bool ready = m_transport->bytesAvailable() > 0 || m_transport->waitForReadyRead(int(sliceOf(deadline)));
+        locker.relock();
+        m_pumping = false;
+
+        if (ready) {
+            this->route(&notified);
+        }
+        this->dispatch();
+        m_routed.wakeAll();
+    }
+
+    bool received = !channel->m_received.isEmpty();
+    locker.unlock();
+    this->notify(notified);
+    return received;
+}
+
+bool QFingerprintBus::waitForWritten(int msecs) {
+    QMutexLocker locker(&m_mutex);
+    // Queued frames are sent by dispatch() on the thread of the bus, a
+    // reading thread flushes the rest
+    if (m_pumping || !this->isBusThread() || m_transport->bytesToWrite() == 0) {
+        return true;
+    }
+    return m_transport->waitForBytesWritten(msecs);
+}
+
+qint64 QFingerprintBus::available(const QFingerprintBusChannel* channel) const {
+    QMutexLocker locker(&m_mutex);
+    return channel->m_received.size();
+}
+
+qint64 QFingerprintBus::take(QFingerprintBusChannel* channel, char* data, qint64 maxSize) {
+    QMutexLocker locker(&m_mutex);
+    int size = int(qMin<qint64>(maxSize, channel->m_received.size()));
+    memcpy(data, channel->m_received.constData(), size);
+    channel->m_received.remove(0, size);
+    return size;
+}
+
+void QFingerprintBus::notify(const QList<QFingerprintBusChannel*>& notified) {
+    for (QFingerprintBusChannel* channel : notified) {
+        emit channel->readyRead();
+    }
+}
+
+// Runs on the thread of the bus only. A blocking reader dispatches after
+// its wait, the transport is its own until then.
+void QFingerprintBus::dispatch() {
+    if (m_pumping) {
+        return;
+    }
+
+    while (true) {
+        if (m_owner) {
+            // A new command of the owner abandons its transaction
+            if (!m_owner->m_outgoing.isEmpty() && frameType(m_owner->m_outgoing.first()) == FINGERPRINT_COMMANDPACKET) {
+                this->release();
+                continue;
+            }
+            // The data packets of an upload are part of the transaction
+            while (m_phase == SendData && !m_owner->m_outgoing.isEmpty()) {
+                QByteArray frame = m_owner->m_outgoing.takeFirst();
+                m_transport->write(frame);
+                if (frameType(frame) == FINGERPRINT_ENDDATAPACKET) {
+                    this->release();
+                    break;
+                }
+            }
+            if (m_owner) {
+                return;
+            }
+        }
+
+        // Channels with queued commands take turns
+        QFingerprintBusChannel* next = nullptr;
+        for (int i = 0; i < m_order.size() && !next; i++) {
+            QFingerprintBusChannel* channel = m_order[(m_turn + i) % m_order.size()];
+            if (!channel->m_outgoing.isEmpty()) {
+                next = channel;
+                m_turn = (m_turn + i + 1) % m_order.size();
+            }
+        }
+        if (!next) {
+            return;
+        }
+        this->start(next);
+    }
+}
+
+void QFingerprintBus::start(QFingerprintBusChannel* channel) {
+    QByteArray frame = channel->m_outgoing.takeFirst();
+    m_transport->write(frame);
+
+    // A data packet outside of a transaction has nobody to answer it
+    if (frameType(frame) != FINGERPRINT_COMMANDPACKET) {
+        return;
+    }
+
+    uint8_t instruction = frameInstruction(frame);
+    m_owner = channel;
+    m_phase = AwaitAck;
+    m_receivesData = instruction == FINGERPRINT_DOWNLOADIMAGE || instruction == FINGERPRINT_DOWNLOADCHARACTERISTICS;
+    m_sendsData = instruction == FINGERPRINT_UPLOADCHARACTERISTICS;
+    m_ownerDeadline = QDeadlineTimer(m_timeout);
+    m_transactions++;
+    m_timer.start(m_timeout + 1);
+}
+
+void QFingerprintBus::release() {
+    m_owner = nullptr;
+    m_phase = Idle;
+}
+
+void QFingerprintBus::route(QList<QFingerprintBusChannel*>* notified) {
+    m_decoder.feed(m_transport->readAll());
+
+    QByteArray packet;
+    QByteArray frame;
+    quint32 address = 0;
+    while (true) {
+        QFingerprintFrameDecoder::Status status = m_decoder.next(&packet, &address, &frame);
+        if (status == QFingerprintFrameDecoder::Incomplete) {
+            break;
+        }
+        if (status == QFingerprintFrameDecoder::BadHeader) {
+            continue;
+        }
+
+        // The address of a corrupted frame can not be trusted, it goes to
+        // the transaction waiting for it and fails there
+        QFingerprintBusChannel* channel = status == QFingerprintFrameDecoder::Frame ? m_channels.value(address) : m_owner;
+        if (!channel) {
+            m_droppedFrames++;
+            continue;
+        }
+
+        channel->m_received.append(frame);
+        if (!notified->contains(channel)) {
+            notified->append(channel);
+        }
+        if (channel == m_owner && status == QFingerprintFrameDecoder::Frame) {
+            this->advance(packet);
+        }
+    }
+    m_routed.wakeAll();
+}
+
+void QFingerprintBus::advance(const QByteArray& packet) {
+    m_ownerDeadline = QDeadlineTimer(m_timeout);
+
+    uint8_t packetType = packet[0];
+    if (m_phase == AwaitAck && packetType == FINGERPRINT_ACKPACKET) {
+        bool accepted = packet.size() > 1 && uint8_t(packet[1]) == FINGERPRINT_OK;
+        if (accepted && m_receivesData) {
+            m_phase = ReceiveData;
+        }else if (accepted && m_sendsData) {
+            m_phase = SendData;
+        }else {
+            this->release();
+        }
+    }else if (m_phase == ReceiveData && packetType == FINGERPRINT_ENDDATAPACKET) {
+        this->release();
+    }
+}
+
+void QFingerprintBus::expire() {
+    if (m_owner && m_ownerDeadline.hasExpired()) {
+        this->release();
+    }
+}
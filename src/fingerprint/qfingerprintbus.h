@@ -0,0 +1,161 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTBUS_H
+#define QFINGERPRINTBUS_H
+
+#include <QByteArray>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include "qfingerprintframe.h"
+
+class QFingerprintBus;
+
+
+// The device of one module address on a QFingerprintBus. It receives only
+// the frames sent by that module. Each write must be one whole frame, as
+// written by QFingerprint and QFingerprintAsync.
+class QFingerprintBusChannel : public QIODevice {
+    Q_OBJECT
+
+public:
+    QFingerprintBus* bus() const;
+    quint32 address() const;
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    bool waitForReadyRead(int msecs) override;
+    bool waitForBytesWritten(int msecs) override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    friend class QFingerprintBus;
+    QFingerprintBusChannel(QFingerprintBus* bus, quint32 address);
+
+    QFingerprintBus* m_bus;
+    quint32 m_address;
+    // Guarded by the mutex of the bus, received holds whole frames
+    QByteArray m_received;
+    QList<QByteArray> m_outgoing;
+};
+
+
+// Several modules with distinct addresses on one serial line, e.g. RS-485.
+// The bus owns the transport; every address gets a channel which is used
+// like a port of its own:
+//
+//     QFingerprintBus bus(port);
+//     gateA->initialize_device(bus.channel(0x00000001));
+//     gateB->initialize_device(bus.channel(0x00000002));
+//
+// One transaction is on the line at a time: a command, its ack and the
+// data phase that follows. Channels with queued commands take turns, and
+// replies are routed by the address in the frame header, so a late reply
+// never reaches the wrong sensor. Time a command waits for the line does
+// not count against the read timeout of its channel.
+//
+// A QSerialPort may only be used from its own thread, so all I/O on the
+// transport happens on the thread of the bus, which is the thread of the
+// transport. Channels are created there and may be used from other
+// threads as well: their frames are written and their replies routed by
+// the thread of the bus, which then has to run an event loop. The
+// transport must not emit readyRead() from within write().
+class QFingerprintBus : public QObject {
+    Q_OBJECT
+
+public:
+    explicit QFingerprintBus(QIODevice* transport, QObject* parent = nullptr);
+
+    QIODevice* transport() const;
+
+    // Created on first use, owned by the bus. Called on the thread of the bus.
+    QFingerprintBusChannel* channel(quint32 address);
+    QList<quint32> addresses() const;
+
+    // A module which stops answering releases the line after this time
+    int timeout() const;
+    void setTimeout(int msecs);
+
+    quint64 transactions() const;
+    // Frames of addresses without a channel and stray frames
+    quint64 droppedFrames() const;
+
+private slots:
+    void receive();
+
+private:
+    friend class QFingerprintBusChannel;
+
+    enum Phase { Idle, AwaitAck, ReceiveData, SendData };
+
+    void submit(QFingerprintBusChannel* channel, const QByteArray& frame);
+    bool waitForFrame(QFingerprintBusChannel* channel, int msecs);
+    bool waitForWritten(int msecs);
+    qint64 available(const QFingerprintBusChannel* channel) const;
+    qint64 take(QFingerprintBusChannel* channel, char* data, qint64 maxSize);
+
+    void notify(const QList<QFingerprintBusChannel*>& notified);
+    bool isBusThread() const;
+
+    // Called with the mutex held
+    void dispatch();
+    void start(QFingerprintBusChannel* channel);
+    void release();
+    void route(QList<QFingerprintBusChannel*>* notified);
+    void advance(const QByteArray& packet);
+    void expire();
+
+    QIODevice* m_transport;
+    QHash<quint32, QFingerprintBusChannel*> m_channels;
+    QList<QFingerprintBusChannel*> m_order;
+    int m_timeout = 1000;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_routed;
+    QTimer m_timer;
+    bool m_pumping = false;
+    QFingerprintFrameDecoder m_decoder;
+
+    QFingerprintBusChannel* m_owner = nullptr;
+    Phase m_phase = Idle;
+    bool m_receivesData = false;
+    bool m_sendsData = false;
+    int m_turn = 0;
+    QDeadlineTimer m_ownerDeadline;
+    quint64 m_transactions = 0;
+    quint64 m_droppedFrames = 0;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,43 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintcancellation.h"
+#include "qfingerprint.h"
+
+
+QFingerprintOperation::QFingerprintOperation(QFingerprint* fingerprint, QFingerprintCancellation* cancellation,
+                                             QDeadlineTimer deadline)
+    : m_fingerprint(fingerprint),
+      m_previousCancellation(fingerprint->cancellation()),
+      m_previousDeadline(fingerprint->deadline())
+{
+    fingerprint->setCancellation(cancellation);
+    fingerprint->setDeadline(deadline);
+}
+
+QFingerprintOperation::~QFingerprintOperation() {
+    m_fingerprint->setCancellation(m_previousCancellation);
+    m_fingerprint->setDeadline(m_previousDeadline);
+}
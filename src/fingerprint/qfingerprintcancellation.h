@@ -0,0 +1,71 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTCANCELLATION_H
+#define QFINGERPRINTCANCELLATION_H
+
+#include <QAtomicInteger>
+#include <QDeadlineTimer>
+
+class QFingerprint;
+
+
+// Cancels the operations of a QFingerprint from any thread. A cancelled
+// read returns within a few milliseconds with QFingerprintError::Cancelled,
+// the reply the sensor still sends is drained before the next command.
+class QFingerprintCancellation {
+public:
+    QFingerprintCancellation() : m_cancelled(0) {}
+
+    void cancel() { m_cancelled.storeRelease(1); }
+    void reset() { m_cancelled.storeRelease(0); }
+    bool isCancelled() const { return m_cancelled.loadAcquire() != 0; }
+
+private:
+    QAtomicInteger<int> m_cancelled;
+    Q_DISABLE_COPY(QFingerprintCancellation)
+};
+
+
+// Applies a cancellation token and an absolute deadline to every command
+// sent while it is in scope, the previous ones are restored afterwards.
+//
+//     QFingerprintOperation operation(fingerprint, &token, QDeadlineTimer(2000));
+//     fingerprint->readImage();
+//     fingerprint->downloadImage(&image);
+class QFingerprintOperation {
+public:
+    QFingerprintOperation(QFingerprint* fingerprint, QFingerprintCancellation* cancellation,
+                          QDeadlineTimer deadline = QDeadlineTimer(QDeadlineTimer::Forever));
+    ~QFingerprintOperation();
+
+private:
+    QFingerprint* m_fingerprint;
+    QFingerprintCancellation* m_previousCancellation;
+    QDeadlineTimer m_previousDeadline;
+    Q_DISABLE_COPY(QFingerprintOperation)
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,139 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintcapture.h"
+#include <QDataStream>
+#include <QFile>
+#include <cstring>
+
+// File header: magic, version and frame count, then per frame the
+// timestamp, direction, size and raw bytes
+static const quint32 CaptureMagic = 0x51465043; // "QFPC"
+static const quint16 CaptureVersion = 1;
+
+
+QFingerprintCapture::QFingerprintCapture(int capacity)
+    : m_slots(new Slot[qMax(1, capacity)]), m_capacity(qMax(1, capacity)), m_head(0)
+{
+    m_clock.start();
+}
+
+QFingerprintCapture::~QFingerprintCapture() {
+    delete[] m_slots;
+}
+
+int QFingerprintCapture::capacity() const {
+    return m_capacity;
+}
+
+quint64 QFingerprintCapture::recordedFrames() const {
+    return m_head.loadAcquire();
+}
+
+void QFingerprintCapture::record(Direction direction, const QByteArray& frame) {
+    quint64 index = m_head.fetchAndAddRelaxed(1);
+    Slot& slot = m_slots[index % m_capacity];
+
+    slot.sequence.beginWrite(index);
+    slot.timestamp = m_clock.nsecsElapsed();
+    slot.direction = direction;
+    slot.size = qMin(frame.size(), (int)MaxFrameSize);
+    memcpy(slot.data, frame.constData(), slot.size);
+    slot.sequence.endWrite(index);
+}
+
+QList<QFingerprintCaptureFrame> QFingerprintCapture::frames() const {
+    QList<QFingerprintCaptureFrame> snapshot;
+    quint64 head = m_head.loadAcquire();
+    quint64 first = head > (quint64)m_capacity ? head - m_capacity : 0;
+
+    for (quint64 index = first; index < head; index++) {
+        const Slot& slot = m_slots[index % m_capacity];
+        if (!slot.sequence.beginRead(index)) {
+            // Still being written or already overwritten
+            continue;
+        }
+
+        QFingerprintCaptureFrame frame;
+        frame.timestamp = slot.timestamp;
+        frame.direction = slot.direction;
+        frame.data = QByteArray(slot.data, slot.size);
+
+        if (slot.sequence.endRead(index)) {
+            snapshot.append(frame);
+        }
+    }
+    return snapshot;
+}
+
+bool QFingerprintCapture::dump(const QString& fileName) const {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QList<QFingerprintCaptureFrame> snapshot = this->frames();
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << CaptureMagic << CaptureVersion << (quint32)snapshot.size();
+    for (const QFingerprintCaptureFrame& frame : snapshot) {
+        stream << frame.timestamp << frame.direction << (quint16)frame.data.size();
+        stream.writeRawData(frame.data.constData(), frame.data.size());
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+QList<QFingerprintCaptureFrame> QFingerprintCapture::load(const QString& fileName) {
+    QList<QFingerprintCaptureFrame> frames;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return frames;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic, count;
+    quint16 version;
+    stream >> magic >> version >> count;
+    if (magic != CaptureMagic || version != CaptureVersion) {
+        return frames;
+    }
+
+    // A truncated file yields the frames before the cut
+    for (quint32 i = 0; i < count; i++) {
+        QFingerprintCaptureFrame frame;
+        quint16 size;
+        stream >> frame.timestamp >> frame.direction >> size;
+        frame.data.resize(size);
+        if (stream.status() != QDataStream::Ok || stream.readRawData(frame.data.data(), size) != size) {
+            break;
+        }
+        frames.append(frame);
+    }
+    return frames;
+}
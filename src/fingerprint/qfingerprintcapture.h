@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTCAPTURE_H
+#define QFINGERPRINTCAPTURE_H
+
+#include "qfingerprintseqlock.h"
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+
+struct QFingerprintCaptureFrame {
+    qint64 timestamp;   // Nanoseconds since the capture was created
+    quint8 direction;
+    QByteArray data;
+};
+
+
+// In-memory flight recorder of the frames going over the wire. Bytes skipped
+// while resynchronizing are recorded as received data of their own. Recording is
+// lock-free: writers claim a slot with an atomic counter and publish it with
+// a sequence number, the oldest frames are overwritten when the ring is full.
+// frames() and dump() take a consistent snapshot while writers keep going.
+class QFingerprintCapture {
+public:
+    enum Direction {
+        Transmit,
+        Receive
+    };
+
+    // The ring keeps at least one frame
+    explicit QFingerprintCapture(int capacity = 4096);
+    ~QFingerprintCapture();
+
+    int capacity() const;
+    quint64 recordedFrames() const;
+
+    void record(Direction direction, const QByteArray& frame);
+    QList<QFingerprintCaptureFrame> frames() const;
+
+    bool dump(const QString& fileName) const;
+    static QList<QFingerprintCaptureFrame> load(const QString& fileName);
+
+    // A frame of the largest packet size is 9 + 256 + 2 bytes
+    static const int MaxFrameSize = 272;
+
+private:
+    struct Slot {
+        QFingerprintSeqLock sequence;
+        qint64 timestamp;
+        quint8 direction;
+        quint16 size;
+        char data[MaxFrameSize];
+    };
+
+    Slot* m_slots;
+    int m_capacity;
+    QAtomicInteger<quint64> m_head;
+    QElapsedTimer m_clock;
+
+    Q_DISABLE_COPY(QFingerprintCapture)
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintcascadesearch.h"
+#include <QElapsedTimer>
+#include <algorithm>
+
+
+QFingerprintCascadeSearch::QFingerprintCascadeSearch(QFingerprint* fingerprint, quint16 hotRangeSize)
+    : m_fingerprint(fingerprint), m_hotRangeSize(hotRangeSize)
+{
+}
+
+QFingerprint* QFingerprintCascadeSearch::fingerprint() const {
+    return m_fingerprint;
+}
+
+quint16 QFingerprintCascadeSearch::hotRangeSize() const {
+    return m_hotRangeSize;
+}
+
+void QFingerprintCascadeSearch::setHotRangeSize(quint16 hotRangeSize) {
+    m_hotRangeSize = hotRangeSize;
+    m_hotRangeDirty = true;
+}
+
+quint16 QFingerprintCascadeSearch::hotRangeStart() {
+    if (m_hotRangeDirty) {
+        this->updateHotRange();
+    }
+    return m_hotRangeStart;
+}
+
+quint32 QFingerprintCascadeSearch::fullScanInterval() const {
+    return m_fullScanInterval;
+}
+
+void QFingerprintCascadeSearch::setFullScanInterval(quint32 fullScanInterval) {
+    m_fullScanInterval = fullScanInterval;
+}
+
+QList<qint16> QFingerprintCascadeSearch::searchTemplate(uint8_t charBufferNumber) {
+    if (m_capacity == 0) {
+        m_capacity = m_fingerprint->getStorageCapacity();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<qint16> result;
+    quint16 hotRangeSize = qMin(m_hotRangeSize, m_capacity);
+
+    // Without any statistics (or with a window covering everything) there is nothing to cascade.
+    // Without a baseline, or once per interval, a full scan is sampled.
+    m_searchesSinceFullScan++;
+    bool sampleFullScan = m_fullScans == 0
+            || (m_fullScanInterval > 0 && m_searchesSinceFullScan >= m_fullScanInterval);
+
+    if (m_matchCounts.isEmpty() || hotRangeSize == 0 || hotRangeSize >= m_capacity || sampleFullScan) {
+        result = this->searchRange(charBufferNumber, 0, m_capacity, true);
+    } else {
+        quint16 hotStart = this->hotRangeStart();
+        quint16 hotEnd = hotStart + hotRangeSize;
+
+        result = this->searchRange(charBufferNumber, hotStart, hotRangeSize, false);
+        if (result[0] >= 0) {
+            m_hotHits++;
+            m_hotHitNsecs += timer.nsecsElapsed();
+        } else {
+            m_hotMisses++;
+            if (hotStart > 0) {
+                result = this->searchRange(charBufferNumber, 0, hotStart, false);
+            }
+            if (result[0] < 0 && hotEnd < m_capacity) {
+                result = this->searchRange(charBufferNumber, hotEnd, m_capacity - hotEnd, false);
+            }
+        }
+    }
+
+    m_searches++;
+    m_searchNsecs += timer.nsecsElapsed();
+
+    if (result[0] >= 0) {
+        m_matchCounts[result[0]]++;
+        m_hotRangeDirty = true;
+    }
+    return result;
+}
+
+QList<qint16> QFingerprintCascadeSearch::searchRange(uint8_t charBufferNumber, quint16 positionStart, quint16 count, bool fullScan) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<qint16> result = m_fingerprint->searchTemplate(charBufferNumber, positionStart, count);
+
+    // Full scans are the baseline the cascade is measured against
+    if (fullScan) {
+        m_searchesSinceFullScan = 0;
+        m_fullScans++;
+        m_fullScanNsecs += timer.nsecsElapsed();
+    }
+    return result;
+}
+
+void QFingerprintCascadeSearch::updateHotRange() {
+    m_hotRangeDirty = false;
+
+    QList<quint16> positions = m_matchCounts.keys();
+    std::sort(positions.begin(), positions.end());
+
+    // Slide a window of hotRangeSize over the matched positions and keep
+    // the one holding the most matches
+    quint64 windowMatches = 0;
+    quint64 bestMatches = 0;
+    int first = 0;
+    for (int last = 0; last < positions.size(); last++) {
+        windowMatches += m_matchCounts.value(positions[last]);
+        while (positions[last] - positions[first] >= m_hotRangeSize) {
+            windowMatches -= m_matchCounts.value(positions[first]);
+            first++;
+        }
+        if (windowMatches > bestMatches) {
+            bestMatches = windowMatches;
+            m_hotRangeStart = positions[first];
+        }
+    }
+
+    if (m_capacity > m_hotRangeSize && m_hotRangeStart > m_capacity - m_hotRangeSize) {
+        m_hotRangeStart = m_capacity - m_hotRangeSize;
+    }
+}
+
+quint32 QFingerprintCascadeSearch::matchCount(quint16 positionNumber) const {
+    return m_matchCounts.value(positionNumber);
+}
+
+QHash<quint16, quint32> QFingerprintCascadeSearch::matchCounts() const {
+    return m_matchCounts;
+}
+
+void QFingerprintCascadeSearch::forgetPosition(quint16 positionNumber) {
+    m_matchCounts.remove(positionNumber);
+    m_hotRangeDirty = true;
+}
+
+void QFingerprintCascadeSearch::movePosition(quint16 fromPosition, quint16 toPosition) {
+    quint32 count = m_matchCounts.take(fromPosition);
+    if (count > 0) {
+        m_matchCounts.insert(toPosition, count);
+    }
+    m_hotRangeDirty = true;
+}
+
+quint64 QFingerprintCascadeSearch::hotHits() const {
+    return m_hotHits;
+}
+
+quint64 QFingerprintCascadeSearch::hotMisses() const {
+    return m_hotMisses;
+}
+
+qreal QFingerprintCascadeSearch::averageLatency() const {
+    return m_searches ? m_searchNsecs / 1e6 / m_searches : 0;
+}
+
+qreal QFingerprintCascadeSearch::hotHitLatency() const {
+    return m_hotHits ? m_hotHitNsecs / 1e6 / m_hotHits : 0;
+}
+
+qreal QFingerprintCascadeSearch::fullScanLatency() const {
+    return m_fullScans ? m_fullScanNsecs / 1e6 / m_fullScans : 0;
+}
+
+qreal QFingerprintCascadeSearch::savedLatency() const {
+    if (m_fullScans == 0 || m_searches == 0) {
+        return 0;
+    }
+    return this->fullScanLatency() - this->averageLatency();
+}
+
+void QFingerprintCascadeSearch::resetStatistics() {
+    // The full scan baseline does not depend on the match history, so it is
+    // kept and savedLatency() stays meaningful after a reset
+    m_hotHits = 0;
+    m_hotHitNsecs = 0;
+    m_hotMisses = 0;
+    m_searches = 0;
+    m_searchNsecs = 0;
+}
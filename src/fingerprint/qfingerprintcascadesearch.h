@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTCASCADESEARCH_H
+#define QFINGERPRINTCASCADESEARCH_H
+
+#include "qfingerprint.h"
+#include <QHash>
+#include <QList>
+
+
+// Identification which first searches the window of positions that matched
+// most often and scans the remaining positions only when that window has no
+// match. The first match wins, so a hot hit can differ from the best scoring
+// template of a full scan.
+class QFingerprintCascadeSearch {
+public:
+    explicit QFingerprintCascadeSearch(QFingerprint* fingerprint, quint16 hotRangeSize = 32);
+
+    QFingerprint* fingerprint() const;
+
+    quint16 hotRangeSize() const;
+    void setHotRangeSize(quint16 hotRangeSize);
+    quint16 hotRangeStart();
+
+    // Every fullScanInterval-th search scans everything to keep the baseline
+    // current, 0 disables the sampling
+    quint32 fullScanInterval() const;
+    void setFullScanInterval(quint32 fullScanInterval);
+
+    QList<qint16> searchTemplate(uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+
+    // Match frequency per position
+    quint32 matchCount(quint16 positionNumber) const;
+    QHash<quint16, quint32> matchCounts() const;
+    void forgetPosition(quint16 positionNumber);
+    void movePosition(quint16 fromPosition, quint16 toPosition);
+
+    // Statistics in milliseconds per search
+    quint64 hotHits() const;
+    quint64 hotMisses() const;
+    qreal averageLatency() const;
+    qreal hotHitLatency() const;
+    qreal fullScanLatency() const;
+    qreal savedLatency() const;
+    void resetStatistics();     // Keeps the full scan baseline
+
+private:
+    QFingerprint* m_fingerprint;
+    quint16 m_hotRangeSize;
+    quint16 m_hotRangeStart = 0;
+    quint16 m_capacity = 0;
+    bool m_hotRangeDirty = true;
+
+    QHash<quint16, quint32> m_matchCounts;
+
+    quint32 m_fullScanInterval = 64;
+    quint32 m_searchesSinceFullScan = 0;
+
+    quint64 m_hotHits = 0;
+    qint64 m_hotHitNsecs = 0;
+    quint64 m_hotMisses = 0;
+    quint64 m_searches = 0;
+    qint64 m_searchNsecs = 0;
+    quint64 m_fullScans = 0;
+    qint64 m_fullScanNsecs = 0;
+
+    void updateHotRange();
+    QList<qint16> searchRange(uint8_t charBufferNumber, quint16 positionStart, quint16 count, bool fullScan);
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,367 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintcompactor.h"
+#include "qfingerprintcascadesearch.h"
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QFile>
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+QFingerprintCompactor::QFingerprintCompactor(QFingerprint* fingerprint, QString journalPath,
+                                             QFingerprintCascadeSearch* cascadeSearch, QObject* parent)
+    : QObject(parent), m_fingerprint(fingerprint), m_journalPath(journalPath), m_cascadeSearch(cascadeSearch)
+{
+    m_timer.setInterval(1000);
+    connect(&m_timer, &QTimer::timeout, this, [this]() {
+        // Exceptions must not leave the event loop, the journal lets a later run resume
+        try {
+            if (!this->step()) {
+                m_timer.stop();
+                // step() throws if the flash is too full to compact
+                emit finished();
+            }
+        } catch (const QFingerprintException& e) {
+            m_timer.stop();
+            m_planned = false;
+            emit failed(QString::fromStdString(e.what()));
+        }
+    });
+}
+
+QFingerprint* QFingerprintCompactor::fingerprint() const {
+    return m_fingerprint;
+}
+
+QString QFingerprintCompactor::journalPath() const {
+    return m_journalPath;
+}
+
+int QFingerprintCompactor::interval() const {
+    return m_timer.interval();
+}
+
+void QFingerprintCompactor::setInterval(int msecs) {
+    m_timer.setInterval(msecs);
+}
+
+uint8_t QFingerprintCompactor::charBufferNumber() const {
+    return m_charBufferNumber;
+}
+
+void QFingerprintCompactor::setCharBufferNumber(uint8_t charBufferNumber) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        throw QFingerprintException("The given charbuffer number is invalid!");
+    }
+    m_charBufferNumber = charBufferNumber;
+}
+
+void QFingerprintCompactor::setMatchCounts(const QHash<quint16, quint32>& matchCounts) {
+    m_matchCounts = matchCounts;
+    m_planned = false;
+}
+
+void QFingerprintCompactor::recover() {
+    QFile journal(m_journalPath);
+    if (!journal.exists()) {
+        return;
+    }
+    if (!journal.open(QIODevice::ReadOnly)) {
+        throw QFingerprintException("Could not open the compaction journal " + m_journalPath.toStdString());
+    }
+
+    // Replay the finished moves into the remap table and find an unfinished one
+    m_remap.clear();
+    bool pending = false;
+    quint16 pendingFrom = 0, pendingTo = 0;
+    QByteArray pendingData;
+
+    // A line torn by a crash fails its checksum and is skipped; a torn
+    // move entry was written before the flash was touched
+    while (!journal.atEnd()) {
+        QByteArray line = journal.readLine().trimmed();
+        int separator = line.lastIndexOf(' ');
+        if (separator < 0 || journalLine(line.left(separator)) != line) {
+            continue;
+        }
+        QByteArrayList fields = line.left(separator).split(' ');
+        if (fields.size() < 3) {
+            continue;
+        }
+        quint16 fromPosition = fields[1].toUShort();
+        quint16 toPosition = fields[2].toUShort();
+
+        if (fields[0] == "move" && fields.size() == 4) {
+            pending = true;
+            pendingFrom = fromPosition;
+            pendingTo = toPosition;
+            pendingData = QByteArray::fromHex(fields[3]);
+        } else if (fields[0] == "done") {
+            pending = false;
+            quint16 original = m_remap.key(fromPosition, fromPosition);
+            m_remap.insert(original, toPosition);
+        } else if (fields[0] == "abort") {
+            pending = false;
+        }
+    }
+    journal.close();
+
+    if (!pending) {
+        return;
+    }
+    m_planned = false;
+
+    QList<uint8_t> characteristicsData;
+    for (char byte : pendingData) {
+        characteristicsData.append((uint8_t)byte);
+    }
+
+    // The source is only deleted once the target holds the template
+    QList<quint16> occupied = this->occupiedPositions();
+    if (occupied.contains(pendingTo) && this->holds(pendingTo, characteristicsData)) {
+        if (occupied.contains(pendingFrom)) {
+            m_fingerprint->deleteTemplate(pendingFrom, 1);
+        }
+        this->finishMove(pendingFrom, pendingTo);
+        return;
+    }
+
+    // Interrupted before the store, the source is still the good copy
+    if (occupied.contains(pendingFrom)) {
+        this->appendJournal("abort " + QByteArray::number(pendingFrom) + " " + QByteArray::number(pendingTo));
+        return;
+    }
+
+    // Neither position holds the template, the journal has the only copy
+    if (occupied.contains(pendingTo)) {
+        throw QFingerprintException("The target of the interrupted move holds another template");
+    }
+    if (!m_fingerprint->uploadCharacteristics(m_charBufferNumber, characteristicsData)) {
+        throw QFingerprintException("Could not upload the template of the interrupted move");
+    }
+    m_fingerprint->storeTemplate(pendingTo, m_charBufferNumber);
+    this->finishMove(pendingFrom, pendingTo);
+}
+
+void QFingerprintCompactor::start() {
+    if (m_cascadeSearch) {
+        this->setMatchCounts(m_cascadeSearch->matchCounts());
+    }
+    m_planned = false;
+    m_timer.start();
+}
+
+void QFingerprintCompactor::stop() {
+    m_timer.stop();
+}
+
+bool QFingerprintCompactor::isRunning() const {
+    return m_timer.isActive();
+}
+
+bool QFingerprintCompactor::step() {
+    if (!m_planned) {
+        this->plan();
+    }
+
+    while (m_next < m_order.size()) {
+        quint16 original = m_order[m_next];
+        quint16 currentPosition = m_remap.value(original, original);
+
+        if (currentPosition == m_next) {
+            m_next++;
+            continue;
+        }
+
+        if (m_slots.contains(m_next)) {
+            // Spill the occupant of the target slot to the first free slot
+            // behind the compacted area, it gets placed later
+            quint16 spillPosition = m_order.size();
+            while (m_slots.contains(spillPosition)) {
+                spillPosition++;
+            }
+            if (spillPosition >= m_capacity) {
+                throw QFingerprintException("The flash has no free position to compact with");
+            }
+            this->moveTemplate(m_next, spillPosition);
+        } else if (this->moveTemplate(currentPosition, m_next)) {
+            m_next++;
+        }
+        return true;
+    }
+    return false;
+}
+
+void QFingerprintCompactor::plan() {
+    m_capacity = m_fingerprint->getStorageCapacity();
+    m_slots.clear();
+    for (quint16 positionNumber : this->occupiedPositions()) {
+        quint16 original = m_remap.key(positionNumber, positionNumber);
+        // A template stored where a moved one came from can not be told apart
+        if (original == positionNumber && m_remap.value(positionNumber, positionNumber) != positionNumber) {
+            throw QFingerprintException("A template was stored at a remapped position, commitRemap() first");
+        }
+        m_slots.insert(positionNumber, original);
+    }
+
+    // Hot templates first, then by current position to keep the number of moves low
+    QList<quint16> positions = m_slots.keys();
+    std::sort(positions.begin(), positions.end(), [this](quint16 a, quint16 b) {
+        quint32 countA = m_matchCounts.value(a);
+        quint32 countB = m_matchCounts.value(b);
+        if (countA != countB) {
+            return countA > countB;
+        }
+        return a < b;
+    });
+
+    m_order.clear();
+    for (quint16 positionNumber : positions) {
+        m_order.append(m_slots.value(positionNumber));
+    }
+    m_next = 0;
+    m_planned = true;
+}
+
+// Another user may have stored a template since the plan was made, e.g.
+// storeTemplate() takes the first free position. The move is dropped and
+// the next step plans again.
+bool QFingerprintCompactor::moveTemplate(quint16 fromPosition, quint16 toPosition) {
+    m_fingerprint->loadTemplate(fromPosition, m_charBufferNumber);
+    QList<uint8_t> characteristicsData = m_fingerprint->downloadCharacteristics(m_charBufferNumber);
+
+    QByteArray data;
+    for (uint8_t byte : characteristicsData) {
+        data.append(byte);
+    }
+    this->appendJournal("move " + QByteArray::number(fromPosition) + " " + QByteArray::number(toPosition) + " " + data.toHex());
+
+    if (this->isOccupied(toPosition)) {
+        this->appendJournal("abort " + QByteArray::number(fromPosition) + " " + QByteArray::number(toPosition));
+        m_planned = false;
+        return false;
+    }
+
+    // The char buffer still holds the loaded template
+    m_fingerprint->storeTemplate(toPosition, m_charBufferNumber);
+    m_fingerprint->deleteTemplate(fromPosition, 1);
+
+    this->finishMove(fromPosition, toPosition);
+    return true;
+}
+
+void QFingerprintCompactor::finishMove(quint16 fromPosition, quint16 toPosition) {
+    this->appendJournal("done " + QByteArray::number(fromPosition) + " " + QByteArray::number(toPosition));
+
+    quint16 original = m_slots.contains(fromPosition) ? m_slots.take(fromPosition) : m_remap.key(fromPosition, fromPosition);
+    m_slots.insert(toPosition, original);
+    m_remap.insert(original, toPosition);
+
+    // Match statistics follow the template
+    if (m_matchCounts.contains(fromPosition)) {
+        m_matchCounts.insert(toPosition, m_matchCounts.take(fromPosition));
+    }
+    if (m_cascadeSearch) {
+        m_cascadeSearch->movePosition(fromPosition, toPosition);
+    }
+
+    emit templateMoved(fromPosition, toPosition);
+}
+
+QList<quint16> QFingerprintCompactor::occupiedPositions() {
+    quint16 capacity = m_fingerprint->getStorageCapacity();
+    QList<quint16> positions;
+
+    for (uint8_t page = 0; page < m_fingerprint->model().indexPages(); page++) {
+        QBitArray templateIndex = m_fingerprint->getTemplateIndex(page);
+        for (int i = 0; i < templateIndex.size(); i++) {
+            int positionNumber = templateIndex.size() * page + i;
+            if (positionNumber >= capacity) {
+                return positions;
+            }
+            if (templateIndex[i]) {
+                positions.append(positionNumber);
+            }
+        }
+    }
+    return positions;
+}
+
+bool QFingerprintCompactor::isOccupied(quint16 positionNumber) {
+    QBitArray templateIndex = m_fingerprint->getTemplateIndex(uint8_t(positionNumber / 256));
+    return templateIndex.testBit(positionNumber % 256);
+}
+
+bool QFingerprintCompactor::holds(quint16 positionNumber, const QList<uint8_t>& characteristicsData) {
+    m_fingerprint->loadTemplate(positionNumber, m_charBufferNumber);
+    return m_fingerprint->downloadCharacteristics(m_charBufferNumber) == characteristicsData;
+}
+
+quint16 QFingerprintCompactor::remap(quint16 positionNumber) const {
+    return m_remap.value(positionNumber, positionNumber);
+}
+
+QHash<quint16, quint16> QFingerprintCompactor::remapTable() const {
+    return m_remap;
+}
+
+void QFingerprintCompactor::commitRemap() {
+    // Callers picked up the new positions, start over with an empty journal
+    QFile::remove(m_journalPath);
+    m_remap.clear();
+    m_planned = false;
+}
+
+QByteArray QFingerprintCompactor::journalLine(const QByteArray& entry) {
+    return entry + " " + QCryptographicHash::hash(entry, QCryptographicHash::Sha1).left(4).toHex();
+}
+
+void QFingerprintCompactor::appendJournal(const QByteArray& entry) {
+    QByteArray line = journalLine(entry);
+    QFile journal(m_journalPath);
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        throw QFingerprintException("Could not write the compaction journal " + m_journalPath.toStdString());
+    }
+    // The entry has to reach the disk before the flash is touched
+    bool written = journal.write(line + "\n") == line.size() + 1 && journal.flush();
+#if defined(Q_OS_WIN)
+    written = written && ::_commit(journal.handle()) == 0;
+#elif defined(Q_OS_LINUX)
+    written = written && ::fdatasync(journal.handle()) == 0;
+#else
+    written = written && ::fsync(journal.handle()) == 0;
+#endif
+    journal.close();
+    if (!written) {
+        throw QFingerprintException("Could not write the compaction journal " + m_journalPath.toStdString());
+    }
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTCOMPACTOR_H
+#define QFINGERPRINTCOMPACTOR_H
+
+#include "qfingerprint.h"
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+
+class QFingerprintCascadeSearch;
+
+
+// Background job which relocates templates so that frequently matched ones
+// sit contiguously at the lowest positions and free space is left at the
+// end. Every move is written to a journal before the flash is touched, so an
+// interrupted move is completed or rolled back by recover() on the next
+// start. The journal also holds the position remap table until
+// commitRemap() is called.
+// Each move overwrites the char buffer given by charBufferNumber(), so other
+// users of the sensor must not rely on it while the compactor runs.
+class QFingerprintCompactor : public QObject {
+    Q_OBJECT
+
+public:
+    explicit QFingerprintCompactor(QFingerprint* fingerprint,
+                                   QString journalPath,
+                                   QFingerprintCascadeSearch* cascadeSearch = nullptr,
+                                   QObject* parent = nullptr);
+
+    QFingerprint* fingerprint() const;
+    QString journalPath() const;
+
+    // Delay between two moves, keeps the sensor available for other commands
+    int interval() const;
+    void setInterval(int msecs);
+
+    // Overwritten by every move, CHARBUFFER1 by default
+    uint8_t charBufferNumber() const;
+    void setCharBufferNumber(uint8_t charBufferNumber);
+
+    void setMatchCounts(const QHash<quint16, quint32>& matchCounts);
+
+    void recover();
+    void start();
+    void stop();
+    bool isRunning() const;
+    bool step();
+
+    quint16 remap(quint16 positionNumber) const;
+    QHash<quint16, quint16> remapTable() const;
+    void commitRemap();
+
+    // A journal entry with the checksum recover() checks it by
+    static QByteArray journalLine(const QByteArray& entry);
+
+signals:
+    void templateMoved(quint16 fromPosition, quint16 toPosition);
+    void finished();
+    void failed(QString message);
+
+private:
+    QFingerprint* m_fingerprint;
+    QString m_journalPath;
+    QFingerprintCascadeSearch* m_cascadeSearch;
+    QTimer m_timer;
+    uint8_t m_charBufferNumber = FINGERPRINT_CHARBUFFER1;
+
+    QHash<quint16, quint32> m_matchCounts;
+    QHash<quint16, quint16> m_remap;    // Original position -> current position
+    QHash<quint16, quint16> m_slots;    // Occupied position -> original position
+    QList<quint16> m_order;             // Original positions in their target order
+    int m_next = 0;
+    quint16 m_capacity = 0;
+    bool m_planned = false;
+
+    void plan();
+    bool moveTemplate(quint16 fromPosition, quint16 toPosition);
+    void finishMove(quint16 fromPosition, quint16 toPosition);
+    QList<quint16> occupiedPositions();
+    bool isOccupied(quint16 positionNumber);
+    bool holds(quint16 positionNumber, const QList<uint8_t>& characteristicsData);
+    void appendJournal(const QByteArray& entry);
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,267 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintdiscovery.h"
+#include "qfingerprint.h"
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSerialPortInfo>
+#include <QSettings>
+#include <QThreadPool>
+#include <QVector>
+
+
+namespace {
+
+quint16 parameterWord(const QByteArray& parameters, int index) {
+    return (quint16(uint8_t(parameters[index])) << 8) | uint8_t(parameters[index + 1]);
+}
+
+// Validates the cached profile of one port or probes the port again
+class DiscoveryTask : public QRunnable {
+public:
+    DiscoveryTask(const QFingerprintDiscovery* discovery, const QString& portName,
+                  const QFingerprintDeviceProfile& cached, QFingerprintDeviceProfile* result)
+        : m_discovery(discovery), m_portName(portName), m_cached(cached), m_result(result) {}
+
+    void run() override {
+        if (this->m_cached.isValid() && this->m_discovery->validate(this->m_cached)) {
+            *this->m_result = this->m_cached;
+        }else {
+            *this->m_result = this->m_discovery->probe(this->m_portName);
+        }
+    }
+
+private:
+    const QFingerprintDiscovery* m_discovery;
+    QString m_portName;
+    QFingerprintDeviceProfile m_cached;
+    QFingerprintDeviceProfile* m_result;
+};
+
+}
+
+
+QFingerprintDiscovery::QFingerprintDiscovery(QSettings* settings)
+    : m_settings(settings)
+    // The factory default first, then the common rates, then the rest of the ZFM table
+    , m_baudRates({57600, 115200, 9600, 19200, 38400, 28800, 48000, 67200, 76800, 86400, 96000, 105600})
+    , m_addresses({0xFFFFFFFF})
+{
+    if (!this->m_settings) {
+        this->m_ownedSettings.reset(new QSettings());
+        this->m_settings = this->m_ownedSettings.data();
+    }
+}
+
+QList<qint32> QFingerprintDiscovery::baudRates() const {
+    return this->m_baudRates;
+}
+
+void QFingerprintDiscovery::setBaudRates(const QList<qint32>& baudRates) {
+    this->m_baudRates = baudRates;
+}
+
+QList<quint32> QFingerprintDiscovery::addresses() const {
+    return this->m_addresses;
+}
+
+void QFingerprintDiscovery::setAddresses(const QList<quint32>& addresses) {
+    this->m_addresses = addresses;
+}
+
+quint32 QFingerprintDiscovery::password() const {
+    return this->m_password;
+}
+
+void QFingerprintDiscovery::setPassword(quint32 password) {
+    this->m_password = password;
+}
+
+int QFingerprintDiscovery::timeout() const {
+    return this->m_timeout;
+}
+
+void QFingerprintDiscovery::setTimeout(int msecs) {
+    this->m_timeout = msecs;
+}
+
+QStringList QFingerprintDiscovery::candidatePorts() {
+    QStringList ports;
+    for (const QSerialPortInfo& info : QSerialPortInfo::availablePorts()) {
+        ports.append(info.portName());
+    }
+    return ports;
+}
+
+QList<QFingerprintDeviceProfile> QFingerprintDiscovery::discover(const QStringList& ports) {
+    QVector<QFingerprintDeviceProfile> cached;
+    for (const QString& port : ports) {
+        cached.append(this->cachedProfile(port));
+    }
+
+    // One task per port, a port can only be opened once at a time anyway
+    QVector<QFingerprintDeviceProfile> results(ports.size());
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, ports.size()));
+    for (int i = 0; i < ports.size(); i++) {
+        pool.start(new DiscoveryTask(this, ports[i], cached[i], &results[i]));
+    }
+    pool.waitForDone();
+
+    QList<QFingerprintDeviceProfile> profiles;
+    for (int i = 0; i < ports.size(); i++) {
+        if (results[i].isValid()) {
+            if (results[i].systemParameters != cached[i].systemParameters
+                || results[i].baudRate != cached[i].baudRate) {
+                this->storeProfile(results[i]);
+            }
+            profiles.append(results[i]);
+        }else if (cached[i].isValid()) {
+            this->forgetProfile(ports[i]);
+        }
+    }
+    return profiles;
+}
+
+QFingerprintDeviceProfile QFingerprintDiscovery::probe(const QString& portName) const {
+    for (quint32 address : this->m_addresses) {
+        QFingerprintDeviceProfile profile = this->probeAddress(portName, address);
+        if (profile.isValid()) {
+            return profile;
+        }
+    }
+    return QFingerprintDeviceProfile();
+}
+
+// Confirms a profile with one round trip, two if a password has to be verified
+bool QFingerprintDiscovery::validate(const QFingerprintDeviceProfile& profile) const {
+    if (!profile.isValid() || profile.systemParameters.size() < 16) {
+        return false;
+    }
+    if (!profile.adapterSerial.isEmpty() && adapterSerial(profile.portName) != profile.adapterSerial) {
+        return false;
+    }
+
+    QFingerprint fingerprint;
+    try {
+        fingerprint.initialize_device(profile);
+        fingerprint.setTimeout(this->m_timeout);
+        if (profile.password != 0x00000000 && !fingerprint.tryVerifyPassword()) {
+            return false;
+        }
+
+        // The status register in the first word changes from command to command
+        QByteArray parameters = fingerprint.getSystemParameters();
+        return parameters.mid(2) == profile.systemParameters.mid(2);
+    }catch (const QFingerprintException&) {
+        return false;
+    }
+}
+
+QFingerprintDeviceProfile QFingerprintDiscovery::probeAddress(const QString& portName, quint32 address) const {
+    QFingerprint fingerprint;
+    try {
+        fingerprint.initialize_device(portName, quint32(this->m_baudRates.value(0, 57600)), address, this->m_password);
+    }catch (const QFingerprintException&) {
+        return QFingerprintDeviceProfile();
+    }
+
+    QSerialPort* serial = fingerprint.serial();
+    for (qint32 baudRate : this->m_baudRates) {
+        serial->setBaudRate(baudRate);
+        serial->clear();
+        fingerprint.setSerial(serial);
+        fingerprint.setTimeout(quint32(this->m_timeout));
+
+        if (!fingerprint.tryVerifyPassword()) {
+            continue;
+        }
+
+        QByteArray parameters;
+        try {
+            parameters = fingerprint.getSystemParameters();
+        }catch (const QFingerprintException&) {
+            continue;
+        }
+        if (parameters.size() < 16) {
+            continue;
+        }
+
+        QFingerprintDeviceProfile profile;
+        profile.portName = portName;
+        profile.baudRate = baudRate;
+        profile.address = address;
+        profile.password = this->m_password;
+        profile.capacity = parameterWord(parameters, 4);
+        profile.packetSize = quint16(32 << qMin(parameterWord(parameters, 12), quint16(3)));
+        profile.adapterSerial = adapterSerial(portName);
+        profile.systemParameters = parameters;
+        return profile;
+    }
+    return QFingerprintDeviceProfile();
+}
+
+QFingerprintDeviceProfile QFingerprintDiscovery::cachedProfile(const QString& portName) const {
+    QFingerprintDeviceProfile profile;
+    this->m_settings->beginGroup(settingsGroup(portName));
+    if (this->m_settings->contains("baudRate")) {
+        profile.portName = portName;
+        profile.baudRate = this->m_settings->value("baudRate").toInt();
+        profile.address = this->m_settings->value("address").toUInt();
+        profile.password = this->m_password;
+        profile.packetSize = quint16(this->m_settings->value("packetSize").toUInt());
+        profile.capacity = quint16(this->m_settings->value("capacity").toUInt());
+        profile.adapterSerial = this->m_settings->value("adapterSerial").toString();
+        profile.systemParameters = this->m_settings->value("systemParameters").toByteArray();
+    }
+    this->m_settings->endGroup();
+    return profile;
+}
+
+// The password is not stored, it always comes from setPassword()
+void QFingerprintDiscovery::storeProfile(const QFingerprintDeviceProfile& profile) {
+    this->m_settings->beginGroup(settingsGroup(profile.portName));
+    this->m_settings->setValue("baudRate", profile.baudRate);
+    this->m_settings->setValue("address", profile.address);
+    this->m_settings->setValue("packetSize", profile.packetSize);
+    this->m_settings->setValue("capacity", profile.capacity);
+    this->m_settings->setValue("adapterSerial", profile.adapterSerial);
+    this->m_settings->setValue("systemParameters", profile.systemParameters);
+    this->m_settings->endGroup();
+}
+
+void QFingerprintDiscovery::forgetProfile(const QString& portName) {
+    this->m_settings->remove(settingsGroup(portName));
+}
+
+QString QFingerprintDiscovery::adapterSerial(const QString& portName) {
+    return QSerialPortInfo(portName).serialNumber();
+}
+
+// "/dev/ttyUSB0" and "ttyUSB0" share a profile, slashes would nest groups
+QString QFingerprintDiscovery::settingsGroup(const QString& portName) {
+    return QString("QtFingerprint/devices/") + QFileInfo(portName).fileName();
+}
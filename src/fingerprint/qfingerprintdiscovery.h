@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTDISCOVERY_H
+#define QFINGERPRINTDISCOVERY_H
+
+#include <QByteArray>
+#include <QList>
+#include <QScopedPointer>
+#include <QString>
+#include <QStringList>
+
+class QSettings;
+
+
+// Everything needed to talk to a sensor without probing it first.
+// systemParameters is the reply of getSystemParameters() as seen during
+// discovery, adapterSerial the USB serial number of the serial adapter.
+struct QFingerprintDeviceProfile {
+    QString portName;
+    qint32 baudRate = 0;
+    quint32 address = 0xFFFFFFFF;
+    quint32 password = 0x00000000;
+    quint16 packetSize = 0;
+    quint16 capacity = 0;
+    QString adapterSerial;
+    QByteArray systemParameters;
+
+    bool isValid() const { return !portName.isEmpty() && baudRate > 0; }
+};
+
+
+// Finds sensors on a set of serial ports. All ports are probed at the same
+// time, each one through the baud rate and address tables. Found sensors are
+// remembered per port in QSettings; on the next start a remembered profile
+// is confirmed with a single getSystemParameters() round trip and only a
+// port whose profile does not match is probed again.
+class QFingerprintDiscovery {
+public:
+    explicit QFingerprintDiscovery(QSettings* settings = nullptr);
+
+    QList<qint32> baudRates() const;
+    void setBaudRates(const QList<qint32>& baudRates);
+
+    QList<quint32> addresses() const;
+    void setAddresses(const QList<quint32>& addresses);
+
+    quint32 password() const;
+    void setPassword(quint32 password);
+
+    // Reply timeout of a single probe
+    int timeout() const;
+    void setTimeout(int msecs);
+
+    static QStringList candidatePorts();
+
+    QList<QFingerprintDeviceProfile> discover(const QStringList& ports = candidatePorts());
+    QFingerprintDeviceProfile probe(const QString& portName) const;
+    bool validate(const QFingerprintDeviceProfile& profile) const;
+
+    QFingerprintDeviceProfile cachedProfile(const QString& portName) const;
+    void storeProfile(const QFingerprintDeviceProfile& profile);
+    void forgetProfile(const QString& portName);
+
+private:
+    QFingerprintDeviceProfile probeAddress(const QString& portName, quint32 address) const;
+    static QString adapterSerial(const QString& portName);
+    static QString settingsGroup(const QString& portName);
+
+    QSettings* m_settings;
+    QScopedPointer<QSettings> m_ownedSettings;
+    QList<qint32> m_baudRates;
+    QList<quint32> m_addresses;
+    quint32 m_password = 0x00000000;
+    int m_timeout = 100;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,141 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintframe.h"
+#include "qfingerprint.h"
+
+
+QByteArray QFingerprintFrame::encode(quint32 address, uint8_t packetType, const QByteArray& packetPayload) {
+    // The packet length = package payload (n bytes) + checksum (2 bytes)
+    quint16 packetLength = packetPayload.size() + 2;
+    quint16 packetChecksum = checksum(packetType, packetLength, packetPayload.constData(), packetPayload.size());
+
+    QByteArray packetData;
+    packetData.reserve(HeaderSize + packetLength);
+    packetData.append((char)(FINGERPRINT_STARTCODE >> 8))
+              .append((char)(FINGERPRINT_STARTCODE & 0xFF))
+              .append((char)(address >> 24))
+              .append((char)(address >> 16))
+              .append((char)(address >> 8))
+              .append((char)address)
+              .append((char)packetType)
+              .append((char)(packetLength >> 8))
+              .append((char)(packetLength & 0xFF))
+              .append(packetPayload)
+              .append((char)(packetChecksum >> 8))
+              .append((char)(packetChecksum & 0xFF));
+    return packetData;
+}
+
+quint16 QFingerprintFrame::checksum(uint8_t packetType, quint16 packetLength, const char* payload, int size) {
+    // The packet checksum = packet type (1 byte) + packet length (2 bytes) + payload (n bytes)
+    quint32 packetChecksum = packetType + (packetLength >> 8) + (packetLength & 0xFF);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload);
+    for (int i = 0; i < size; i++) {
+        packetChecksum += bytes[i];
+    }
+    return packetChecksum & 0xFFFF;
+}
+
+void QFingerprintFrameDecoder::feed(const QByteArray& data) {
+    this->feed(data.constData(), data.size());
+}
+
+void QFingerprintFrameDecoder::feed(const char* data, int size) {
+    // Drop consumed bytes before growing the buffer
+    if (m_offset > 0 && m_offset >= m_buffer.size() / 2) {
+        m_buffer.remove(0, m_offset);
+        m_offset = 0;
+    }
+    m_buffer.append(data, size);
+}
+
+void QFingerprintFrameDecoder::clear() {
+    m_buffer.clear();
+    m_offset = 0;
+}
+
+int QFingerprintFrameDecoder::bufferedBytes() const {
+    return m_buffer.size() - m_offset;
+}
+
+QFingerprintFrameDecoder::Status QFingerprintFrameDecoder::next(QByteArray* packet, quint32* address, QByteArray* frame) {
+    int available = m_buffer.size() - m_offset;
+    if (available < QFingerprintFrame::MinimumSize) {
+        return Incomplete;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_buffer.constData()) + m_offset;
+
+    // Check the packet header, skip one byte to resynchronize on garbage
+    if (data[0] != (FINGERPRINT_STARTCODE >> 8) || data[1] != (FINGERPRINT_STARTCODE & 0xFF)) {
+        if (frame) {
+            *frame = QByteArray(reinterpret_cast<const char*>(data), 1);
+        }
+        m_offset++;
+        return BadHeader;
+    }
+
+    // Calculate packet payload length (combine the 2 length bytes)
+    quint16 packetLength = (data[7] << 8) | data[8];
+    if (packetLength < 2) {
+        if (frame) {
+            *frame = QByteArray(reinterpret_cast<const char*>(data), 1);
+        }
+        m_offset++;
+        return BadHeader;
+    }
+    if (available < QFingerprintFrame::HeaderSize + packetLength) {
+        return Incomplete;
+    }
+
+    int frameSize = QFingerprintFrame::HeaderSize + packetLength;
+    uint8_t packetType = data[6];
+    int payloadSize = packetLength - 2;
+    const char* payload = reinterpret_cast<const char*>(data) + QFingerprintFrame::HeaderSize;
+
+    quint16 receivedChecksum = (data[frameSize - 2] << 8) | data[frameSize - 1];
+    quint16 packetChecksum = QFingerprintFrame::checksum(packetType, packetLength, payload, payloadSize);
+
+    if (frame) {
+        *frame = QByteArray(reinterpret_cast<const char*>(data), frameSize);
+    }
+    m_offset += frameSize;
+
+    if (receivedChecksum != packetChecksum) {
+        return BadChecksum;
+    }
+
+    if (address) {
+        *address = (quint32(data[2]) << 24) | (quint32(data[3]) << 16) | (quint32(data[4]) << 8) | data[5];
+    }
+    if (packet) {
+        packet->clear();
+        packet->reserve(1 + payloadSize);
+        packet->append((char)packetType);
+        packet->append(payload, payloadSize);
+    }
+    return Frame;
+}
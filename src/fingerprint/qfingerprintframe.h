@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTFRAME_H
+#define QFINGERPRINTFRAME_H
+
+#include <QByteArray>
+
+
+// Wire format of a packet:
+// start code (2) | address (4) | type (1) | length (2) | payload (n) | checksum (2)
+// The length counts payload and checksum, the checksum sums type, length and payload.
+class QFingerprintFrame {
+public:
+    static const int HeaderSize = 9;
+    static const int MinimumSize = 12;
+
+    static QByteArray encode(quint32 address, uint8_t packetType, const QByteArray& packetPayload);
+    static quint16 checksum(uint8_t packetType, quint16 packetLength, const char* payload, int size);
+};
+
+
+// Incremental decoder, bytes are fed as they arrive and complete frames are
+// taken out one by one. Leftover bytes of the next frame stay buffered.
+class QFingerprintFrameDecoder {
+public:
+    enum Status {
+        Incomplete,     // More bytes are needed
+        Frame,          // A valid frame was decoded
+        BadHeader,      // A byte without start code was dropped
+        BadChecksum     // A complete frame with a wrong checksum was dropped
+    };
+
+    void feed(const QByteArray& data);
+    void feed(const char* data, int size);
+    void clear();
+    int bufferedBytes() const;
+
+    // The packet is the type byte followed by the payload, like QFingerprint::readPacket().
+    // The frame receives the raw bytes of a decoded frame or the byte a BadHeader dropped.
+    Status next(QByteArray* packet, quint32* address = nullptr, QByteArray* frame = nullptr);
+
+private:
+    QByteArray m_buffer;
+    int m_offset = 0;
+};
+
+#endif /* end of include guard */
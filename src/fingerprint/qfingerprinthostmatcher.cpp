@@ -0,0 +1,497 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprinthostmatcher.h"
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define QFINGERPRINT_MINUTIAE_BLOCK 16
+// Pixel variance of a block that contains ridges
+#define QFINGERPRINT_MINUTIAE_VARIANCE 150
+// Minutiae closer than this come from breaks and spurs
+#define QFINGERPRINT_MINUTIAE_MINIMUMDISTANCE 6
+
+
+namespace {
+
+const float pi = 3.14159265f;
+const float distanceTolerance = 8;
+const float angleTolerance = pi / 12;
+
+float wrapAngle(float angle) {
+    angle = std::fmod(angle, pi);
+    return angle < 0 ? angle + pi : angle;
+}
+
+// Difference of two angles from 0 to pi, which are periodic in pi
+inline float angleDifference(float a, float b) {
+    float difference = std::fabs(a - b);
+    return qMin(difference, pi - difference);
+}
+
+#ifdef __SSE2__
+inline __m128 absoluteDifference(__m128 a, __m128 b) {
+    return _mm_and_ps(_mm_sub_ps(a, b), _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+}
+
+inline __m128 angleDifference(__m128 a, __m128 b) {
+    __m128 difference = absoluteDifference(a, b);
+    return _mm_min_ps(difference, _mm_sub_ps(_mm_set1_ps(pi), difference));
+}
+#endif
+
+// Zhang-Suen thinning of a binary image whose border pixels are zero
+void thin(std::vector<uchar>* pixels, int width, int height) {
+    uchar* p = pixels->data();
+    std::vector<int> marked;
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+        for (int pass = 0; pass < 2; pass++) {
+            marked.clear();
+            for (int y = 1; y < height - 1; y++) {
+                for (int x = 1; x < width - 1; x++) {
+                    int i = y * width + x;
+                    if (!p[i]) {
+                        continue;
+                    }
+                    // Clockwise from north
+                    int n[8] = {p[i - width], p[i - width + 1], p[i + 1], p[i + width + 1],
+                                p[i + width], p[i + width - 1], p[i - 1], p[i - width - 1]};
+                    int neighbours = 0;
+                    int transitions = 0;
+                    for (int k = 0; k < 8; k++) {
+                        neighbours += n[k];
+                        transitions += !n[k] && n[(k + 1) % 8];
+                    }
+                    if (neighbours < 2 || neighbours > 6 || transitions != 1) {
+                        continue;
+                    }
+                    if (pass == 0 ? (n[0] && n[2] && n[4]) || (n[2] && n[4] && n[6])
+                                  : (n[0] && n[2] && n[6]) || (n[0] && n[4] && n[6])) {
+                        continue;
+                    }
+                    marked.push_back(i);
+                }
+            }
+            for (int i : marked) {
+                p[i] = 0;
+            }
+            changed = changed || !marked.empty();
+        }
+    }
+}
+
+}
+
+
+class QFingerprintHostMatcher::Worker : public QRunnable {
+public:
+    Worker(const QFingerprintHostMatcher* matcher, const Descriptors* probe, QAtomicInt* next,
+           QFingerprintHostMatch* result, QSemaphore* done)
+        : m_matcher(matcher), m_probe(probe), m_next(next), m_result(result), m_done(done) {}
+
+    void run() override {
+        *this->m_result = this->m_matcher->scan(*this->m_probe, this->m_next);
+        this->m_done->release();
+    }
+
+private:
+    const QFingerprintHostMatcher* m_matcher;
+    const Descriptors* m_probe;
+    QAtomicInt* m_next;
+    QFingerprintHostMatch* m_result;
+    QSemaphore* m_done;
+};
+
+
+QFingerprintHostMatcher::QFingerprintHostMatcher()
+    : m_offsets(1, 0)
+{
+    this->setThreadCount(QThread::idealThreadCount());
+}
+
+QVector<QFingerprintMinutia> QFingerprintHostMatcher::extractMinutiae(const QImage& source) {
+    QVector<QFingerprintMinutia> minutiae;
+    QImage image = source.format() == QImage::Format_Grayscale8 ? source : source.convertToFormat(QImage::Format_Grayscale8);
+
+    const int block = QFINGERPRINT_MINUTIAE_BLOCK;
+    const qint64 blockPixels = block * block;
+    int columns = image.width() / block;
+    int rows = image.height() / block;
+    if (columns < 3 || rows < 3) {
+        return minutiae;
+    }
+    int width = columns * block;
+    int height = rows * block;
+
+    // Mean for the binarization, variance for the foreground and ridge orientation of every block
+    std::vector<int> means(size_t(columns) * rows);
+    std::vector<uchar> foreground(size_t(columns) * rows);
+    std::vector<float> orientations(size_t(columns) * rows);
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            qint64 sum = 0;
+            qint64 squares = 0;
+            qint64 gxx = 0;
+            qint64 gyy = 0;
+            qint64 gxy = 0;
+            for (int y = row * block; y < (row + 1) * block; y++) {
+                const uchar* line = image.constScanLine(y);
+                const uchar* above = image.constScanLine(qMax(y - 1, 0));
+                const uchar* below = image.constScanLine(qMin(y + 1, height - 1));
+                for (int x = column * block; x < (column + 1) * block; x++) {
+                    int pixel = line[x];
+                    int gx = int(line[qMin(x + 1, width - 1)]) - int(line[qMax(x - 1, 0)]);
+                    int gy = int(below[x]) - int(above[x]);
+                    sum += pixel;
+                    squares += pixel * pixel;
+                    gxx += gx * gx;
+                    gyy += gy * gy;
+                    gxy += gx * gy;
+                }
+            }
+
+            int i = row * columns + column;
+            means[i] = int(sum / blockPixels);
+            foreground[i] = squares * blockPixels - sum * sum >= qint64(QFINGERPRINT_MINUTIAE_VARIANCE) * blockPixels * blockPixels;
+            // Ridges run across the dominant gradient
+            orientations[i] = wrapAngle(0.5f * std::atan2(2.0f * gxy, float(gxx - gyy)) + pi / 2);
+        }
+    }
+
+    // Minutiae are only taken where all surrounding blocks are foreground,
+    // the edge of the print is full of false endings
+    std::vector<uchar> interior(size_t(columns) * rows);
+    for (int row = 1; row < rows - 1; row++) {
+        for (int column = 1; column < columns - 1; column++) {
+            bool inside = true;
+            for (int r = row - 1; r <= row + 1; r++) {
+                for (int c = column - 1; c <= column + 1; c++) {
+                    inside = inside && foreground[r * columns + c];
+                }
+            }
+            interior[row * columns + column] = inside;
+        }
+    }
+
+    // Ridges are dark, the outermost pixels stay background for the thinning
+    std::vector<uchar> ridges(size_t(width) * height);
+    for (int y = 1; y < height - 1; y++) {
+        const uchar* line = image.constScanLine(y);
+        for (int x = 1; x < width - 1; x++) {
+            int i = (y / block) * columns + x / block;
+            ridges[size_t(y) * width + x] = foreground[i] && line[x] < means[i];
+        }
+    }
+    thin(&ridges, width, height);
+
+    // Crossing number of the skeleton: one is a ridge ending, three a bifurcation
+    const uchar* p = ridges.data();
+    for (int y = 1; y < height - 1; y++) {
+        for (int x = 1; x < width - 1; x++) {
+            int i = y * width + x;
+            int b = (y / block) * columns + x / block;
+            if (!p[i] || !interior[b]) {
+                continue;
+            }
+            int n[8] = {p[i - width], p[i - width + 1], p[i + 1], p[i + width + 1],
+                        p[i + width], p[i + width - 1], p[i - 1], p[i - width - 1]};
+            int crossings = 0;
+            for (int k = 0; k < 8; k++) {
+                crossings += n[k] != n[(k + 1) % 8];
+            }
+            crossings /= 2;
+
+            if (crossings == QFingerprintMinutia::Ending || crossings == QFingerprintMinutia::Bifurcation) {
+                QFingerprintMinutia minutia;
+                minutia.x = qint16(x);
+                minutia.y = qint16(y);
+                minutia.angle = orientations[b];
+                minutia.type = QFingerprintMinutia::Type(crossings);
+                minutiae.append(minutia);
+            }
+        }
+    }
+
+    // Breaks and spurs leave pairs of minutiae close to each other, both are dropped
+    const int minimum = QFINGERPRINT_MINUTIAE_MINIMUMDISTANCE * QFINGERPRINT_MINUTIAE_MINIMUMDISTANCE;
+    std::vector<uchar> spurious(size_t(minutiae.size()));
+    for (int i = 0; i < minutiae.size(); i++) {
+        for (int j = i + 1; j < minutiae.size(); j++) {
+            int dx = minutiae[i].x - minutiae[j].x;
+            int dy = minutiae[i].y - minutiae[j].y;
+            if (dx * dx + dy * dy < minimum) {
+                spurious[i] = 1;
+                spurious[j] = 1;
+            }
+        }
+    }
+    QVector<QFingerprintMinutia> kept;
+    kept.reserve(minutiae.size());
+    for (int i = 0; i < minutiae.size(); i++) {
+        if (!spurious[i]) {
+            kept.append(minutiae[i]);
+        }
+    }
+    return kept;
+}
+
+void QFingerprintHostMatcher::describe(const QVector<QFingerprintMinutia>& minutiae, Descriptors* descriptors) {
+    int count = minutiae.size();
+    if (count < 3) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int nearest = -1;
+        int second = -1;
+        qint64 nearestDistance = 0;
+        qint64 secondDistance = 0;
+        for (int j = 0; j < count; j++) {
+            if (j == i) {
+                continue;
+            }
+            qint64 dx = minutiae[j].x - minutiae[i].x;
+            qint64 dy = minutiae[j].y - minutiae[i].y;
+            qint64 distance = dx * dx + dy * dy;
+            if (nearest < 0 || distance < nearestDistance) {
+                second = nearest;
+                secondDistance = nearestDistance;
+                nearest = j;
+                nearestDistance = distance;
+            }else if (second < 0 || distance < secondDistance) {
+                second = j;
+                secondDistance = distance;
+            }
+        }
+
+        const QFingerprintMinutia& minutia = minutiae[i];
+        const QFingerprintMinutia& near = minutiae[nearest];
+        const QFingerprintMinutia& far = minutiae[second];
+        descriptors->nearDistance.push_back(std::sqrt(float(nearestDistance)));
+        descriptors->farDistance.push_back(std::sqrt(float(secondDistance)));
+        descriptors->nearBearing.push_back(wrapAngle(std::atan2(float(near.y - minutia.y), float(near.x - minutia.x)) - minutia.angle));
+        descriptors->farBearing.push_back(wrapAngle(std::atan2(float(far.y - minutia.y), float(far.x - minutia.x)) - minutia.angle));
+        descriptors->nearTurn.push_back(wrapAngle(near.angle - minutia.angle));
+        descriptors->farTurn.push_back(wrapAngle(far.angle - minutia.angle));
+    }
+}
+
+int QFingerprintHostMatcher::addTemplate(quint32 id, const QVector<QFingerprintMinutia>& minutiae) {
+    describe(minutiae, &this->m_gallery);
+    this->m_offsets.push_back(quint32(this->m_gallery.size()));
+    this->m_ids.push_back(id);
+    return this->count() - 1;
+}
+
+int QFingerprintHostMatcher::addImage(quint32 id, const QImage& image) {
+    return this->addTemplate(id, extractMinutiae(image));
+}
+
+int QFingerprintHostMatcher::enroll(QFingerprint* fingerprint, quint32 id) {
+    QImage image;
+    fingerprint->downloadImage(&image);
+    return this->addImage(id, image);
+}
+
+void QFingerprintHostMatcher::reserve(int templates, int minutiae) {
+    this->m_offsets.reserve(size_t(templates) + 1);
+    this->m_ids.reserve(size_t(templates));
+    for (std::vector<float>* field : {&this->m_gallery.nearDistance, &this->m_gallery.farDistance,
+                                      &this->m_gallery.nearBearing, &this->m_gallery.farBearing,
+                                      &this->m_gallery.nearTurn, &this->m_gallery.farTurn}) {
+        field->reserve(size_t(minutiae));
+    }
+}
+
+void QFingerprintHostMatcher::clear() {
+    this->m_gallery = Descriptors();
+    this->m_offsets.assign(1, 0);
+    this->m_ids.clear();
+}
+
+int QFingerprintHostMatcher::count() const {
+    return int(this->m_ids.size());
+}
+
+quint32 QFingerprintHostMatcher::id(int index) const {
+    return this->m_ids.at(size_t(index));
+}
+
+int QFingerprintHostMatcher::descriptorCount(int index) const {
+    return int(this->m_offsets.at(size_t(index) + 1) - this->m_offsets.at(size_t(index)));
+}
+
+int QFingerprintHostMatcher::threshold() const {
+    return this->m_threshold;
+}
+
+void QFingerprintHostMatcher::setThreshold(int score) {
+    this->m_threshold = score;
+}
+
+int QFingerprintHostMatcher::threadCount() const {
+    return this->m_threadCount;
+}
+
+void QFingerprintHostMatcher::setThreadCount(int count) {
+    this->m_threadCount = qMax(1, count);
+    // The calling thread scans too
+    this->m_pool.setMaxThreadCount(qMax(1, this->m_threadCount - 1));
+}
+
+int QFingerprintHostMatcher::chunkSize() const {
+    return this->m_chunkSize;
+}
+
+void QFingerprintHostMatcher::setChunkSize(int templates) {
+    this->m_chunkSize = qMax(1, templates);
+}
+
+// Share of probe minutiae whose descriptor is found in the template. The
+// gallery descriptors are compared four at a time where SSE2 is available.
+int QFingerprintHostMatcher::score(const Descriptors& probe, int index) const {
+    const quint32 begin = this->m_offsets[size_t(index)];
+    const quint32 end = this->m_offsets[size_t(index) + 1];
+    const size_t probeCount = probe.size();
+    if (probeCount == 0 || begin == end) {
+        return 0;
+    }
+
+    const float* nearDistance = this->m_gallery.nearDistance.data();
+    const float* farDistance = this->m_gallery.farDistance.data();
+    const float* nearBearing = this->m_gallery.nearBearing.data();
+    const float* farBearing = this->m_gallery.farBearing.data();
+    const float* nearTurn = this->m_gallery.nearTurn.data();
+    const float* farTurn = this->m_gallery.farTurn.data();
+
+    size_t matched = 0;
+    for (size_t i = 0; i < probeCount; i++) {
+        const float probeNearDistance = probe.nearDistance[i];
+        const float probeFarDistance = probe.farDistance[i];
+        const float probeNearBearing = probe.nearBearing[i];
+        const float probeFarBearing = probe.farBearing[i];
+        const float probeNearTurn = probe.nearTurn[i];
+        const float probeFarTurn = probe.farTurn[i];
+
+        int found = 0;
+        quint32 j = begin;
+#ifdef __SSE2__
+        const __m128 distances = _mm_set1_ps(distanceTolerance);
+        const __m128 angles = _mm_set1_ps(angleTolerance);
+        for (; !found && j + 4 <= end; j += 4) {
+            __m128 equal = _mm_cmple_ps(absoluteDifference(_mm_loadu_ps(nearDistance + j), _mm_set1_ps(probeNearDistance)), distances);
+            equal = _mm_and_ps(equal, _mm_cmple_ps(absoluteDifference(_mm_loadu_ps(farDistance + j), _mm_set1_ps(probeFarDistance)), distances));
+            equal = _mm_and_ps(equal, _mm_cmple_ps(angleDifference(_mm_loadu_ps(nearBearing + j), _mm_set1_ps(probeNearBearing)), angles));
+            equal = _mm_and_ps(equal, _mm_cmple_ps(angleDifference(_mm_loadu_ps(farBearing + j), _mm_set1_ps(probeFarBearing)), angles));
+            equal = _mm_and_ps(equal, _mm_cmple_ps(angleDifference(_mm_loadu_ps(nearTurn + j), _mm_set1_ps(probeNearTurn)), angles));
+            equal = _mm_and_ps(equal, _mm_cmple_ps(angleDifference(_mm_loadu_ps(farTurn + j), _mm_set1_ps(probeFarTurn)), angles));
+            found = _mm_movemask_ps(equal) != 0;
+        }
+#endif
+        for (; !found && j < end; j++) {
+            found = std::fabs(nearDistance[j] - probeNearDistance) <= distanceTolerance
+                 && std::fabs(farDistance[j] - probeFarDistance) <= distanceTolerance
+                 && angleDifference(nearBearing[j], probeNearBearing) <= angleTolerance
+                 && angleDifference(farBearing[j], probeFarBearing) <= angleTolerance
+                 && angleDifference(nearTurn[j], probeNearTurn) <= angleTolerance
+                 && angleDifference(farTurn[j], probeFarTurn) <= angleTolerance;
+        }
+        matched += size_t(found);
+    }
+    return int(matched * 200 / (probeCount + (end - begin)));
+}
+
+int QFingerprintHostMatcher::match(const QVector<QFingerprintMinutia>& probe, int index) const {
+    Descriptors descriptors;
+    describe(probe, &descriptors);
+    return this->score(descriptors, index);
+}
+
+// Claims chunks until the gallery is exhausted. Chunks are claimed in
+// increasing order, so the first best template of a thread has the lowest index.
+QFingerprintHostMatch QFingerprintHostMatcher::scan(const Descriptors& probe, QAtomicInt* next) const {
+    QFingerprintHostMatch best;
+    const int total = this->count();
+
+    while (true) {
+        int first = next->fetchAndAddRelaxed(this->m_chunkSize);
+        if (first >= total) {
+            break;
+        }
+        int last = qMin(total, first + this->m_chunkSize);
+        for (int index = first; index < last; index++) {
+            int score = this->score(probe, index);
+            if (score > best.score) {
+                best.index = index;
+                best.score = score;
+            }
+        }
+    }
+    return best;
+}
+
+QFingerprintHostMatch QFingerprintHostMatcher::identify(const QVector<QFingerprintMinutia>& probe) const {
+    Descriptors descriptors;
+    describe(probe, &descriptors);
+    if (descriptors.size() == 0 || this->count() == 0) {
+        return QFingerprintHostMatch();
+    }
+
+    int chunks = (this->count() + this->m_chunkSize - 1) / this->m_chunkSize;
+    int helpers = qMin(this->m_threadCount, chunks) - 1;
+    QAtomicInt next(0);
+    QVector<QFingerprintHostMatch> results(helpers + 1);
+    QSemaphore done;
+    for (int i = 0; i < helpers; i++) {
+        this->m_pool.start(new Worker(this, &descriptors, &next, &results[i + 1], &done));
+    }
+    results[0] = this->scan(descriptors, &next);
+    done.acquire(helpers);
+
+    QFingerprintHostMatch best;
+    for (const QFingerprintHostMatch& result : results) {
+        if (result.score > best.score || (result.score == best.score && result.index >= 0 && result.index < best.index)) {
+            best = result;
+        }
+    }
+    if (best.index < 0 || best.score < this->m_threshold) {
+        return QFingerprintHostMatch();
+    }
+    best.id = this->m_ids[size_t(best.index)];
+    return best;
+}
+
+QFingerprintHostMatch QFingerprintHostMatcher::identify(const QImage& image) const {
+    return this->identify(extractMinutiae(image));
+}
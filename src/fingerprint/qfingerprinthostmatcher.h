@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTHOSTMATCHER_H
+#define QFINGERPRINTHOSTMATCHER_H
+
+#include "qfingerprint.h"
+#include <QImage>
+#include <QThreadPool>
+#include <QVector>
+#include <vector>
+
+
+struct QFingerprintMinutia {
+    enum Type : quint8 {
+        Ending = 1,
+        Bifurcation = 3
+    };
+
+    qint16 x;
+    qint16 y;
+    // Ridge orientation in radians, 0 to pi
+    float angle;
+    Type type;
+};
+
+struct QFingerprintHostMatch {
+    // Gallery index, -1 if no template reached the threshold
+    int index = -1;
+    quint32 id = 0;
+    int score = 0;
+};
+
+// Host side 1:N matcher, the sensor is only used to capture images.
+// Each minutia of a template is described by its two nearest neighbours
+// (distances and angles relative to its own orientation), which does not
+// depend on where and how rotated the finger was placed. The descriptor fields
+// of all templates are stored in separate contiguous arrays, so the inner
+// match loop streams through memory and compares several descriptors at once.
+// identify() splits the gallery in chunks, which the calling thread and the
+// worker threads claim from a shared counter until none are left.
+class QFingerprintHostMatcher {
+public:
+    QFingerprintHostMatcher();
+
+    static QVector<QFingerprintMinutia> extractMinutiae(const QImage& image);
+
+    int addTemplate(quint32 id, const QVector<QFingerprintMinutia>& minutiae);
+    int addImage(quint32 id, const QImage& image);
+    // Downloads the image in the image buffer of the sensor and adds it
+    int enroll(QFingerprint* fingerprint, quint32 id);
+    void reserve(int templates, int minutiae);
+    void clear();
+
+    int count() const;
+    quint32 id(int index) const;
+    // Zero for templates with fewer than three minutiae
+    int descriptorCount(int index) const;
+
+    // Score from 0 to 100 a match must reach
+    int threshold() const;
+    void setThreshold(int score);
+    // Threads used by identify(), including the calling one
+    int threadCount() const;
+    void setThreadCount(int count);
+    // Templates claimed at a time by one thread
+    int chunkSize() const;
+    void setChunkSize(int templates);
+
+    int match(const QVector<QFingerprintMinutia>& probe, int index) const;
+    QFingerprintHostMatch identify(const QVector<QFingerprintMinutia>& probe) const;
+    QFingerprintHostMatch identify(const QImage& image) const;
+
+private:
+    class Worker;
+
+    // One entry per minutia, the nearer neighbour first
+    struct Descriptors {
+        std::vector<float> nearDistance;
+        std::vector<float> farDistance;
+        std::vector<float> nearBearing;
+        std::vector<float> farBearing;
+        std::vector<float> nearTurn;
+        std::vector<float> farTurn;
+
+        size_t size() const { return nearDistance.size(); }
+    };
+
+    static void describe(const QVector<QFingerprintMinutia>& minutiae, Descriptors* descriptors);
+    int score(const Descriptors& probe, int index) const;
+    QFingerprintHostMatch scan(const Descriptors& probe, QAtomicInt* next) const;
+
+    Descriptors m_gallery;
+    // Template i owns the descriptors m_offsets[i] to m_offsets[i + 1]
+    std::vector<quint32> m_offsets;
+    std::vector<quint32> m_ids;
+
+    int m_threshold = 40;
+    int m_threadCount;
+    int m_chunkSize = 256;
+    mutable QThreadPool m_pool;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,174 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintimagearchive.h"
+#include "qfingerprint.h"
+#include <QDataStream>
+#include <QMutexLocker>
+
+// File header: magic and version, then per image the timestamp, width,
+// height and width * height / 2 bytes of pixels
+static const quint32 ArchiveMagic = 0x51465049; // "QFPI"
+static const quint16 ArchiveVersion = 1;
+static const int ArchiveHeaderSize = 6;
+static const int RecordHeaderSize = 12;
+
+
+QFingerprintImageArchive::QFingerprintImageArchive(const QString& fileName)
+    : m_fileName(fileName), m_file(fileName)
+{
+}
+
+QString QFingerprintImageArchive::fileName() const {
+    return m_fileName;
+}
+
+bool QFingerprintImageArchive::open() {
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen()) {
+        return true;
+    }
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    QDataStream stream(&m_file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    m_records.clear();
+
+    if (m_file.size() == 0) {
+        stream << ArchiveMagic << ArchiveVersion;
+        return stream.status() == QDataStream::Ok;
+    }
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != ArchiveMagic || version != ArchiveVersion) {
+        m_file.close();
+        return false;
+    }
+
+    qint64 offset = ArchiveHeaderSize;
+    while (offset + RecordHeaderSize <= m_file.size()) {
+        Record record;
+        record.offset = offset;
+        m_file.seek(offset);
+        stream >> record.timestamp >> record.width >> record.height;
+        qint64 end = offset + RecordHeaderSize + qint64(record.width) * record.height / 2;
+        if (stream.status() != QDataStream::Ok || end > m_file.size()) {
+            break;
+        }
+        m_records.append(record);
+        offset = end;
+    }
+
+    if (offset < m_file.size() && !m_file.resize(offset)) {
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+void QFingerprintImageArchive::close() {
+    QMutexLocker locker(&m_mutex);
+    m_file.close();
+    m_records.clear();
+}
+
+bool QFingerprintImageArchive::isOpen() const {
+    QMutexLocker locker(&m_mutex);
+    return m_file.isOpen();
+}
+
+bool QFingerprintImageArchive::append(const QByteArray& imageData, qint64 timestamp, quint16 width, quint16 height) {
+    if (imageData.size() != width * height / 2) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return false;
+    }
+
+    Record record;
+    record.offset = m_file.size();
+    record.timestamp = timestamp;
+    record.width = width;
+    record.height = height;
+
+    m_file.seek(record.offset);
+    QDataStream stream(&m_file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << record.timestamp << record.width << record.height;
+    stream.writeRawData(imageData.constData(), imageData.size());
+    if (stream.status() != QDataStream::Ok) {
+        // Leave no partial record behind
+        m_file.resize(record.offset);
+        return false;
+    }
+    m_records.append(record);
+    return true;
+}
+
+bool QFingerprintImageArchive::append(const QImage& image, qint64 timestamp) {
+    return this->append(QFingerprint::packImage(image), timestamp, quint16(image.width()), quint16(image.height()));
+}
+
+int QFingerprintImageArchive::count() const {
+    QMutexLocker locker(&m_mutex);
+    return m_records.size();
+}
+
+qint64 QFingerprintImageArchive::timestamp(int index) const {
+    QMutexLocker locker(&m_mutex);
+    return m_records.value(index, Record{0, 0, 0, 0}).timestamp;
+}
+
+QByteArray QFingerprintImageArchive::imageData(int index) const {
+    QMutexLocker locker(&m_mutex);
+    if (index < 0 || index >= m_records.size()) {
+        return QByteArray();
+    }
+
+    const Record& record = m_records[index];
+    m_file.seek(record.offset + RecordHeaderSize);
+    return m_file.read(qint64(record.width) * record.height / 2);
+}
+
+QImage QFingerprintImageArchive::image(int index) const {
+    QMutexLocker locker(&m_mutex);
+    if (index < 0 || index >= m_records.size()) {
+        return QImage();
+    }
+
+    const Record& record = m_records[index];
+    m_file.seek(record.offset + RecordHeaderSize);
+    QByteArray data = m_file.read(qint64(record.width) * record.height / 2);
+
+    QImage image(record.width, record.height, QImage::Format_Grayscale8);
+    QFingerprint::unpackImage(data, &image);
+    return image;
+}
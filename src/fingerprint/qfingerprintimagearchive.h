@@ -0,0 +1,75 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTIMAGEARCHIVE_H
+#define QFINGERPRINTIMAGEARCHIVE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+
+// Append only file of raw images. Every record holds the packed 4 bit pixels
+// as sent by the sensor, half the size of an 8 bit image and without any
+// encoding. append() may be called from several threads.
+class QFingerprintImageArchive {
+public:
+    explicit QFingerprintImageArchive(const QString& fileName);
+
+    QString fileName() const;
+
+    // Creates the file or indexes the records of an existing one. A record
+    // torn by a crash is cut off.
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    bool append(const QByteArray& imageData, qint64 timestamp, quint16 width = 256, quint16 height = 288);
+    bool append(const QImage& image, qint64 timestamp);
+
+    int count() const;
+    // Milliseconds since the epoch, as passed to append()
+    qint64 timestamp(int index) const;
+    QByteArray imageData(int index) const;
+    QImage image(int index) const;
+
+private:
+    struct Record {
+        qint64 offset;
+        qint64 timestamp;
+        quint16 width;
+        quint16 height;
+    };
+
+    QString m_fileName;
+    mutable QFile m_file;
+    QVector<Record> m_records;
+    mutable QMutex m_mutex;
+};
+
+#endif /* end of include guard */
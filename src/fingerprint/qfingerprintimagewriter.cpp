@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintimagewriter.h"
+#include <QDateTime>
+#include <QRunnable>
+
+
+class QFingerprintImageWriter::Task : public QRunnable {
+public:
+    Task(QFingerprintImageWriter* writer, const QImage& image, const QString& fileName)
+        : m_writer(writer), m_image(image), m_fileName(fileName) {}
+    Task(QFingerprintImageWriter* writer, QFingerprintImageArchive* archive, const QByteArray& imageData,
+         qint64 timestamp)
+        : m_writer(writer), m_archive(archive), m_imageData(imageData), m_timestamp(timestamp) {}
+
+    void run() override {
+        bool written = this->m_archive ? this->m_archive->append(this->m_imageData, this->m_timestamp)
+                                       : this->m_image.save(this->m_fileName);
+        this->m_writer->finished(written, this->m_archive ? this->m_archive->fileName() : this->m_fileName);
+    }
+
+private:
+    QFingerprintImageWriter* m_writer;
+    QImage m_image;
+    QString m_fileName;
+    QFingerprintImageArchive* m_archive = nullptr;
+    QByteArray m_imageData;
+    qint64 m_timestamp = 0;
+};
+
+
+QFingerprintImageWriter::QFingerprintImageWriter(int threadCount, int maxPending, QObject* parent)
+    : QObject(parent), m_free(qMax(1, maxPending)), m_maxPending(qMax(1, maxPending)), m_written(0), m_failed(0)
+{
+    m_pool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+QFingerprintImageWriter::~QFingerprintImageWriter() {
+    m_pool.waitForDone();
+}
+
+int QFingerprintImageWriter::maxPending() const {
+    return m_maxPending;
+}
+
+int QFingerprintImageWriter::pending() const {
+    return m_maxPending - m_free.available();
+}
+
+quint64 QFingerprintImageWriter::writtenImages() const {
+    return m_written.loadAcquire();
+}
+
+quint64 QFingerprintImageWriter::failedImages() const {
+    return m_failed.loadAcquire();
+}
+
+void QFingerprintImageWriter::write(const QImage& image, const QString& fileName) {
+    m_free.acquire();
+    m_pool.start(new Task(this, image, fileName));
+}
+
+bool QFingerprintImageWriter::tryWrite(const QImage& image, const QString& fileName) {
+    if (!m_free.tryAcquire()) {
+        return false;
+    }
+    m_pool.start(new Task(this, image, fileName));
+    return true;
+}
+
+// The time of the capture is taken before waiting for a free slot
+void QFingerprintImageWriter::append(QFingerprintImageArchive* archive, const QByteArray& imageData, qint64 timestamp) {
+    if (timestamp < 0) {
+        timestamp = QDateTime::currentMSecsSinceEpoch();
+    }
+    m_free.acquire();
+    m_pool.start(new Task(this, archive, imageData, timestamp));
+}
+
+bool QFingerprintImageWriter::tryAppend(QFingerprintImageArchive* archive, const QByteArray& imageData, qint64 timestamp) {
+    if (timestamp < 0) {
+        timestamp = QDateTime::currentMSecsSinceEpoch();
+    }
+    if (!m_free.tryAcquire()) {
+        return false;
+    }
+    m_pool.start(new Task(this, archive, imageData, timestamp));
+    return true;
+}
+
+bool QFingerprintImageWriter::waitForDone(int msecs) {
+    return m_pool.waitForDone(msecs);
+}
+
+void QFingerprintImageWriter::finished(bool written, const QString& fileName) {
+    if (written) {
+        m_written.fetchAndAddRelease(1);
+    }else {
+        m_failed.fetchAndAddRelease(1);
+        emit writeFailed(fileName);
+    }
+    m_free.release();
+}
@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTIMAGEWRITER_H
+#define QFINGERPRINTIMAGEWRITER_H
+
+#include "qfingerprintimagearchive.h"
+#include <QAtomicInteger>
+#include <QImage>
+#include <QObject>
+#include <QSemaphore>
+#include <QThreadPool>
+
+
+// Persists captured images on background threads, so the capture thread
+// pays neither for the codec nor for the disk. write() only takes a reference
+// to the implicitly shared image; a later downloadImage() into the same
+// QImage detaches it. At most maxPending images wait at a time, write() then
+// blocks until one is done and tryWrite() gives up.
+// writeFailed() is emitted from a pool thread.
+class QFingerprintImageWriter : public QObject {
+    Q_OBJECT
+
+public:
+    explicit QFingerprintImageWriter(int threadCount = 1, int maxPending = 16, QObject* parent = nullptr);
+    ~QFingerprintImageWriter();
+
+    int maxPending() const;
+    int pending() const;
+    quint64 writtenImages() const;
+    quint64 failedImages() const;
+
+    // Encodes the image in the format of the file name suffix
+    void write(const QImage& image, const QString& fileName);
+    bool tryWrite(const QImage& image, const QString& fileName);
+    // Appends the raw data of downloadImageData() to the archive. The record
+    // is stamped with the given capture time in msecs since the epoch, by
+    // default with the time of the call.
+    void append(QFingerprintImageArchive* archive, const QByteArray& imageData, qint64 timestamp = -1);
+    bool tryAppend(QFingerprintImageArchive* archive, const QByteArray& imageData, qint64 timestamp = -1);
+
+    bool waitForDone(int msecs = -1);
+
+signals:
+    void writeFailed(const QString& fileName);
+
+private:
+    class Task;
+
+    void finished(bool written, const QString& fileName);
+
+    QThreadPool m_pool;
+    QSemaphore m_free;
+    int m_maxPending;
+    QAtomicInteger<quint64> m_written;
+    QAtomicInteger<quint64> m_failed;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,252 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintmirror.h"
+
+
+QFingerprintMirror::QFingerprintMirror(QFingerprint* primary)
+    : m_primary(primary)
+{
+}
+
+QFingerprint* QFingerprintMirror::primary() const {
+    return this->m_primary;
+}
+
+QList<QFingerprint*> QFingerprintMirror::replicas() const {
+    return this->m_replicas;
+}
+
+void QFingerprintMirror::addReplica(QFingerprint* replica) {
+    if (!this->m_replicas.contains(replica)) {
+        this->m_replicas.append(replica);
+    }
+}
+
+void QFingerprintMirror::removeReplica(QFingerprint* replica) {
+    this->m_replicas.removeAll(replica);
+    this->m_pending.remove(replica);
+}
+
+QFingerprintResult<quint16> QFingerprintMirror::storeTemplate(quint16 positionNumber, uint8_t charBufferNumber) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        return QFingerprintResult<quint16>(QFingerprintError::InvalidArgument, "The given charbuffer number is invalid!");
+    }
+
+    QList<uint8_t> characteristics;
+    try {
+        characteristics = this->m_primary->downloadCharacteristics(charBufferNumber);
+    }catch (const QFingerprintException&) {
+        return QFingerprintResult<quint16>(QFingerprintError::DownloadCharacteristics);
+    }
+
+    QByteArray storePayload;
+    storePayload.append(FINGERPRINT_STORETEMPLATE)
+                .append(charBufferNumber)
+                .append(char(positionNumber >> 8))
+                .append(char(positionNumber));
+    QByteArray uploadPayload;
+    uploadPayload.append(FINGERPRINT_UPLOADCHARACTERISTICS)
+                 .append(charBufferNumber);
+
+    // The primary writes its flash while the replicas receive the data
+    QFingerprintResult<void> written = this->m_primary->tryWritePacket(FINGERPRINT_COMMANDPACKET, storePayload);
+    if (!written) {
+        return QFingerprintResult<quint16>(written.error(), written.errorString());
+    }
+
+    // The packets are split before the upload starts, asking for the packet
+    // size in the middle of a data phase would break it
+    QHash<QFingerprint*, QByteArrayList> packets;
+    QList<QFingerprint*> uploading;
+    for (QFingerprint* replica : this->m_replicas) {
+        try {
+            packets.insert(replica, replica->characteristicsPackets(characteristics));
+        }catch (const QFingerprintException&) {
+            this->markPending(replica, positionNumber);
+            continue;
+        }
+        if (replica->tryWritePacket(FINGERPRINT_COMMANDPACKET, uploadPayload)) {
+            uploading.append(replica);
+        }else {
+            this->markPending(replica, positionNumber);
+        }
+    }
+
+    QList<QFingerprint*> uploaded;
+    for (QFingerprint* replica : uploading) {
+        if (!replica->tryReadAck()) {
+            replica->discardInput();
+            this->markPending(replica, positionNumber);
+            continue;
+        }
+
+        const QByteArrayList& replicaPackets = packets[replica];
+        bool sent = true;
+        for (int i = 0; i < replicaPackets.size() && sent; i++) {
+            uint8_t packetType = i == replicaPackets.size() - 1 ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET;
+            sent = bool(replica->tryWritePacket(packetType, replicaPackets[i]));
+        }
+        replica->characteristicsUploaded(charBufferNumber, characteristics);
+        if (sent) {
+            uploaded.append(replica);
+        }else {
+            this->markPending(replica, positionNumber);
+        }
+    }
+
+    // Replicas store only what the primary holds
+    QFingerprintResult<QByteArray> stored = this->m_primary->tryReadAck();
+    if (!stored) {
+        return QFingerprintResult<quint16>(stored.error(), stored.errorString());
+    }
+    this->m_primary->templateStored(positionNumber, charBufferNumber);
+
+    // The store reply comes only after the data phase, it confirms the upload too
+    QList<QFingerprint*> storing;
+    for (QFingerprint* replica : uploaded) {
+        if (replica->tryWritePacket(FINGERPRINT_COMMANDPACKET, storePayload)) {
+            storing.append(replica);
+        }else {
+            this->markPending(replica, positionNumber);
+        }
+    }
+    for (QFingerprint* replica : storing) {
+        if (replica->tryReadAck()) {
+            replica->templateStored(positionNumber, charBufferNumber);
+        }else {
+            replica->discardInput();
+            this->markPending(replica, positionNumber);
+        }
+    }
+
+    return QFingerprintResult<quint16>(positionNumber);
+}
+
+QFingerprintResult<void> QFingerprintMirror::deleteTemplate(quint16 positionNumber) {
+    QByteArray packetPayload;
+    packetPayload.append(FINGERPRINT_DELETETEMPLATE)
+                 .append(char(positionNumber >> 8))
+                 .append(char(positionNumber))
+                 .append(char(0x00))
+                 .append(char(0x01));
+
+    QFingerprintResult<void> written = this->m_primary->tryWritePacket(FINGERPRINT_COMMANDPACKET, packetPayload);
+    if (!written) {
+        return written;
+    }
+
+    QList<QFingerprint*> deleting;
+    for (QFingerprint* replica : this->m_replicas) {
+        if (replica->tryWritePacket(FINGERPRINT_COMMANDPACKET, packetPayload)) {
+            deleting.append(replica);
+        }else {
+            this->markPending(replica, positionNumber);
+        }
+    }
+
+    QFingerprintResult<QByteArray> deleted = this->m_primary->tryReadAck();
+    if (deleted) {
+        this->m_primary->templatesDeleted(positionNumber, 1);
+    }
+
+    // Even if the primary failed the replicas were asked, catchUp() settles
+    // them on whatever the primary ends up holding
+    for (QFingerprint* replica : deleting) {
+        if (replica->tryReadAck() && deleted) {
+            replica->templatesDeleted(positionNumber, 1);
+        }else {
+            replica->discardInput();
+            this->markPending(replica, positionNumber);
+        }
+    }
+
+    if (!deleted) {
+        return QFingerprintResult<void>(deleted.error(), deleted.errorString());
+    }
+    return QFingerprintResult<void>();
+}
+
+QList<quint16> QFingerprintMirror::pendingPositions(QFingerprint* replica) const {
+    return this->m_pending.value(replica);
+}
+
+bool QFingerprintMirror::isInSync() const {
+    return this->m_pending.isEmpty();
+}
+
+int QFingerprintMirror::catchUp() {
+    int remaining = 0;
+
+    for (QFingerprint* replica : this->m_replicas) {
+        if (!this->m_pending.contains(replica)) {
+            continue;
+        }
+
+        QList<quint16> failed;
+        for (quint16 positionNumber : this->m_pending.value(replica)) {
+            if (!this->catchUpPosition(replica, positionNumber)) {
+                failed.append(positionNumber);
+            }
+        }
+
+        if (failed.isEmpty()) {
+            this->m_pending.remove(replica);
+        }else {
+            this->m_pending.insert(replica, failed);
+        }
+        remaining += failed.size();
+    }
+    return remaining;
+}
+
+void QFingerprintMirror::markPending(QFingerprint* replica, quint16 positionNumber) {
+    QList<quint16>& positions = this->m_pending[replica];
+    if (!positions.contains(positionNumber)) {
+        positions.append(positionNumber);
+    }
+}
+
+// The primary is the reference: its template is copied, an empty primary
+// position is deleted on the replica
+bool QFingerprintMirror::catchUpPosition(QFingerprint* replica, quint16 positionNumber) {
+    try {
+        QFingerprintResult<void> loaded = this->m_primary->tryLoadTemplate(positionNumber, FINGERPRINT_CHARBUFFER1);
+        if (!loaded) {
+            if (loaded.error() != QFingerprintError::LoadTemplate) {
+                return false;
+            }
+            return replica->deleteTemplate(positionNumber, 1);
+        }
+
+        QList<uint8_t> characteristics = this->m_primary->downloadCharacteristics(FINGERPRINT_CHARBUFFER1);
+        if (!replica->uploadCharacteristics(FINGERPRINT_CHARBUFFER1, characteristics)) {
+            return false;
+        }
+        return bool(replica->tryStoreTemplate(positionNumber, FINGERPRINT_CHARBUFFER1));
+    }catch (const QFingerprintException&) {
+        return false;
+    }
+}
@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTMIRROR_H
+#define QFINGERPRINTMIRROR_H
+
+#include "qfingerprint.h"
+#include <QHash>
+#include <QList>
+
+
+// Keeps the template databases of redundant sensors identical. A template
+// enrolled on the primary is downloaded once and written to every replica at
+// the same position. The sensors are driven side by side: every command goes
+// out to all of them before the first reply is read, so the transfers and
+// flash writes overlap and a mirrored store takes about as long as a single
+// one. Replicas which fail are remembered per position and brought up to
+// date from the primary by catchUp().
+class QFingerprintMirror {
+public:
+    explicit QFingerprintMirror(QFingerprint* primary);
+
+    QFingerprint* primary() const;
+    QList<QFingerprint*> replicas() const;
+    void addReplica(QFingerprint* replica);
+    void removeReplica(QFingerprint* replica);
+
+    // Stores the char buffer of the primary, fails only if the primary fails
+    QFingerprintResult<quint16> storeTemplate(quint16 positionNumber,
+                                              uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1);
+    QFingerprintResult<void> deleteTemplate(quint16 positionNumber);
+
+    // Positions a replica has missed, in the order they failed
+    QList<quint16> pendingPositions(QFingerprint* replica) const;
+    bool isInSync() const;
+    // Copies the missed positions from the primary, returns how many are still pending
+    int catchUp();
+
+private:
+    void markPending(QFingerprint* replica, quint16 positionNumber);
+    bool catchUpPosition(QFingerprint* replica, quint16 positionNumber);
+
+    QFingerprint* m_primary;
+    QList<QFingerprint*> m_replicas;
+    QHash<QFingerprint*, QList<quint16>> m_pending;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTMODEL_H
+#define QFINGERPRINTMODEL_H
+
+#include <QtGlobal>
+
+
+// What is known about a sensor model without asking it. A capacity of 0
+// means the capacity is read from the sensor. packetSize is the data packet
+// size the sensor is configured for, 0 means it is read from the sensor.
+struct QFingerprintModel {
+    const char* name;
+    quint16 capacity;
+    quint16 imageWidth;
+    quint16 imageHeight;
+    qint32 baudRate;
+    quint16 packetSize;
+
+    // 256 positions per page of the template index
+    constexpr quint8 indexPages() const {
+        return capacity ? quint8((capacity + 255) / 256) : quint8(4);
+    }
+    // Packed 4 bit pixels
+    constexpr int imageBytes() const {
+        return imageWidth * imageHeight / 2;
+    }
+    constexpr bool isValidPosition(int positionNumber) const {
+        return positionNumber >= 0 && (capacity == 0 || positionNumber < capacity);
+    }
+};
+
+
+// Compile time model policies. Everything is a constant expression, e.g.
+// for buffer sizes and static_assert, and qFingerprintModel<Model>() turns
+// a policy into the QFingerprintModel QFingerprint is configured with.
+template<quint16 Capacity, quint16 ImageWidth = 256, quint16 ImageHeight = 288,
+         qint32 BaudRate = 57600, quint16 PacketSize = 128>
+struct QFingerprintModelPolicy {
+    static_assert(Capacity <= 1024, "The template index has at most four pages");
+    static_assert(PacketSize == 0 || PacketSize == 32 || PacketSize == 64 || PacketSize == 128 || PacketSize == 256,
+                  "The packet size must be 32, 64, 128 or 256 bytes");
+    static_assert(BaudRate % 9600 == 0 && BaudRate >= 9600 && BaudRate <= 115200,
+                  "The baud rate must be a multiple of 9600 up to 115200");
+
+    static constexpr quint16 capacity() { return Capacity; }
+    static constexpr quint8 indexPages() { return Capacity ? quint8((Capacity + 255) / 256) : quint8(4); }
+    static constexpr quint16 imageWidth() { return ImageWidth; }
+    static constexpr quint16 imageHeight() { return ImageHeight; }
+    static constexpr int imageBytes() { return ImageWidth * ImageHeight / 2; }
+    static constexpr qint32 baudRate() { return BaudRate; }
+    static constexpr quint16 packetSize() { return PacketSize; }
+    static constexpr bool isValidPosition(int positionNumber) {
+        return positionNumber >= 0 && (Capacity == 0 || positionNumber < Capacity);
+    }
+};
+
+// Unknown model, capacity and packet size are read from the sensor
+struct QFingerprintZfmAny : QFingerprintModelPolicy<0, 256, 288, 57600, 0> {
+    static constexpr const char* name() { return "ZFM"; }
+};
+
+struct QFingerprintZfm20 : QFingerprintModelPolicy<162> {
+    static constexpr const char* name() { return "ZFM-20"; }
+};
+
+struct QFingerprintZfm60 : QFingerprintModelPolicy<300> {
+    static constexpr const char* name() { return "ZFM-60"; }
+};
+
+struct QFingerprintZfm70 : QFingerprintModelPolicy<1000> {
+    static constexpr const char* name() { return "ZFM-70"; }
+};
+
+struct QFingerprintZfm100 : QFingerprintModelPolicy<1000> {
+    static constexpr const char* name() { return "ZFM-100"; }
+};
+
+template<typename Model>
+constexpr QFingerprintModel qFingerprintModel() {
+    return QFingerprintModel{Model::name(), Model::capacity(), Model::imageWidth(), Model::imageHeight(),
+                             Model::baudRate(), Model::packetSize()};
+}
+
+#endif /* end of include guard */
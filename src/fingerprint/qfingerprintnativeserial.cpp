@@ -0,0 +1,362 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintnativeserial.h"
+#include <QElapsedTimer>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+namespace {
+
+bool baudRateToSpeed(qint32 baudRate, speed_t* speed) {
+    switch (baudRate) {
+    case 9600:   *speed = B9600;   return true;
+    case 19200:  *speed = B19200;  return true;
+    case 38400:  *speed = B38400;  return true;
+    case 57600:  *speed = B57600;  return true;
+    case 115200: *speed = B115200; return true;
+    case 230400: *speed = B230400; return true;
+    default:     return false;
+    }
+}
+
+}
+
+
+QFingerprintNativeSerial::QFingerprintNativeSerial(QObject* parent)
+    : QIODevice(parent)
+{
+}
+
+QFingerprintNativeSerial::QFingerprintNativeSerial(const QString& portName, QObject* parent)
+    : QIODevice(parent)
+    , m_portName(portName)
+{
+}
+
+QFingerprintNativeSerial::~QFingerprintNativeSerial() {
+    this->close();
+}
+
+QString QFingerprintNativeSerial::portName() const {
+    return this->m_portName;
+}
+
+void QFingerprintNativeSerial::setPortName(const QString& portName) {
+    this->m_portName = portName;
+}
+
+qint32 QFingerprintNativeSerial::baudRate() const {
+    return this->m_baudRate;
+}
+
+bool QFingerprintNativeSerial::setBaudRate(qint32 baudRate) {
+    speed_t speed;
+    if (!baudRateToSpeed(baudRate, &speed)) {
+        this->setErrorString(QString("Unsupported baud rate %1").arg(baudRate));
+        return false;
+    }
+
+    this->m_baudRate = baudRate;
+    return this->m_fd < 0 || this->configure();
+}
+
+bool QFingerprintNativeSerial::lowLatency() const {
+    return this->m_lowLatency;
+}
+
+bool QFingerprintNativeSerial::setLowLatency(bool lowLatency) {
+    this->m_lowLatency = lowLatency;
+    return this->m_fd < 0 || this->applyLowLatency();
+}
+
+int QFingerprintNativeSerial::handle() const {
+    return this->m_fd;
+}
+
+bool QFingerprintNativeSerial::clear() {
+    this->m_readBuffer.clear();
+    this->m_writeBuffer.clear();
+    if (this->m_fd >= 0 && ::tcflush(this->m_fd, TCIOFLUSH) < 0) {
+        this->setSystemError("tcflush");
+        return false;
+    }
+    return true;
+}
+
+bool QFingerprintNativeSerial::open(OpenMode mode) {
+    if (this->m_fd >= 0) {
+        this->setErrorString("The port is already open");
+        return false;
+    }
+
+    QByteArray path = this->m_portName.toLocal8Bit();
+    this->m_fd = ::open(path.constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (this->m_fd < 0) {
+        this->setSystemError("open");
+        return false;
+    }
+
+    this->m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    this->m_events = EPOLLIN;
+    if (this->m_epoll < 0 || ::epoll_ctl(this->m_epoll, EPOLL_CTL_ADD, this->m_fd, &event) < 0) {
+        this->setSystemError("epoll");
+        this->close();
+        return false;
+    }
+
+    // Not every driver knows about ASYNC_LOW_LATENCY (ptys and CDC ACM don't),
+    // the port is still usable without it.
+    if (!this->configure()) {
+        this->close();
+        return false;
+    }
+    this->applyLowLatency();
+    ::tcflush(this->m_fd, TCIOFLUSH);
+
+    // The device keeps its own buffers, QIODevice must not buffer on top
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void QFingerprintNativeSerial::close() {
+    if (this->isOpen()) {
+        QIODevice::close();
+    }
+    if (this->m_epoll >= 0) {
+        ::close(this->m_epoll);
+        this->m_epoll = -1;
+    }
+    if (this->m_fd >= 0) {
+        ::close(this->m_fd);
+        this->m_fd = -1;
+    }
+    this->m_readBuffer.clear();
+    this->m_writeBuffer.clear();
+}
+
+bool QFingerprintNativeSerial::isSequential() const {
+    return true;
+}
+
+qint64 QFingerprintNativeSerial::bytesAvailable() const {
+    int pending = 0;
+    if (this->m_fd >= 0) {
+        ::ioctl(this->m_fd, FIONREAD, &pending);
+    }
+    return this->m_readBuffer.size() + pending + QIODevice::bytesAvailable();
+}
+
+qint64 QFingerprintNativeSerial::bytesToWrite() const {
+    return this->m_writeBuffer.size();
+}
+
+bool QFingerprintNativeSerial::waitForReadyRead(int msecs) {
+    if (!this->m_readBuffer.isEmpty()) {
+        return true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        int remaining = msecs < 0 ? -1 : qMax(0, int(msecs - timer.elapsed()));
+        if (!this->waitFor(EPOLLIN, remaining)) {
+            return false;
+        }
+        if (this->fillBuffer()) {
+            emit readyRead();
+            return true;
+        }
+    } while (msecs < 0 || timer.elapsed() < msecs);
+
+    return false;
+}
+
+bool QFingerprintNativeSerial::waitForBytesWritten(int msecs) {
+    return this->flushPending(msecs);
+}
+
+qint64 QFingerprintNativeSerial::readData(char* data, qint64 maxSize) {
+    if (this->m_readBuffer.isEmpty()) {
+        ssize_t size = ::read(this->m_fd, data, size_t(maxSize));
+        if (size < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+            this->setSystemError("read");
+            return -1;
+        }
+        return size;
+    }
+
+    qint64 size = qMin(maxSize, qint64(this->m_readBuffer.size()));
+    memcpy(data, this->m_readBuffer.constData(), size_t(size));
+    this->m_readBuffer.remove(0, int(size));
+    return size;
+}
+
+qint64 QFingerprintNativeSerial::writeData(const char* data, qint64 maxSize) {
+    this->m_writeBuffer.append(data, int(maxSize));
+    if (!this->flushPending(0) && this->m_fd < 0) {
+        return -1;
+    }
+    return maxSize;
+}
+
+bool QFingerprintNativeSerial::configure() {
+    speed_t speed;
+    if (!baudRateToSpeed(this->m_baudRate, &speed)) {
+        this->setErrorString(QString("Unsupported baud rate %1").arg(this->m_baudRate));
+        return false;
+    }
+
+    struct termios options;
+    if (::tcgetattr(this->m_fd, &options) < 0) {
+        this->setSystemError("tcgetattr");
+        return false;
+    }
+
+    // Raw 8N1, reads return immediately with whatever is there
+    ::cfmakeraw(&options);
+    options.c_cflag |= CLOCAL | CREAD;
+    options.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+    options.c_iflag &= ~(IXON | IXOFF | IXANY);
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
+    ::cfsetispeed(&options, speed);
+    ::cfsetospeed(&options, speed);
+
+    if (::tcsetattr(this->m_fd, TCSANOW, &options) < 0) {
+        this->setSystemError("tcsetattr");
+        return false;
+    }
+    return true;
+}
+
+bool QFingerprintNativeSerial::applyLowLatency() {
+    struct serial_struct serial;
+    if (::ioctl(this->m_fd, TIOCGSERIAL, &serial) < 0) {
+        return false;
+    }
+
+    if (this->m_lowLatency) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+    }else {
+        serial.flags &= ~ASYNC_LOW_LATENCY;
+    }
+    return ::ioctl(this->m_fd, TIOCSSERIAL, &serial) == 0;
+}
+
+bool QFingerprintNativeSerial::fillBuffer() {
+    char chunk[4096];
+    bool received = false;
+
+    while (true) {
+        ssize_t size = ::read(this->m_fd, chunk, sizeof(chunk));
+        if (size > 0) {
+            this->m_readBuffer.append(chunk, int(size));
+            received = true;
+            continue;
+        }
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0 && errno != EAGAIN) {
+            this->setSystemError("read");
+        }
+        return received;
+    }
+}
+
+bool QFingerprintNativeSerial::waitFor(quint32 events, int msecs) {
+    struct epoll_event event = {};
+    event.events = events;
+    if (events != this->m_events) {
+        if (::epoll_ctl(this->m_epoll, EPOLL_CTL_MOD, this->m_fd, &event) < 0) {
+            this->setSystemError("epoll_ctl");
+            return false;
+        }
+        this->m_events = events;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (true) {
+        int remaining = msecs < 0 ? -1 : qMax(0, int(msecs - timer.elapsed()));
+        int ready = ::epoll_wait(this->m_epoll, &event, 1, remaining);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+// Writes as much of the pending output as the driver takes, waiting for room
+// up to msecs. With msecs 0 it never blocks.
+bool QFingerprintNativeSerial::flushPending(int msecs) {
+    if (this->m_fd < 0) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!this->m_writeBuffer.isEmpty()) {
+        ssize_t size = ::write(this->m_fd, this->m_writeBuffer.constData(), size_t(this->m_writeBuffer.size()));
+        if (size > 0) {
+            this->m_writeBuffer.remove(0, int(size));
+            emit bytesWritten(size);
+            continue;
+        }
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0 && errno != EAGAIN) {
+            this->setSystemError("write");
+            return false;
+        }
+
+        int remaining = msecs < 0 ? -1 : qMax(0, int(msecs - timer.elapsed()));
+        if (remaining == 0 || !this->waitFor(EPOLLOUT, remaining)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void QFingerprintNativeSerial::setSystemError(const char* operation) {
+    this->setErrorString(QString("%1 failed on %2: %3")
+                         .arg(QString(operation), this->m_portName, QString::fromLocal8Bit(strerror(errno))));
+}
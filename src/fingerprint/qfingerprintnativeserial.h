@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTNATIVESERIAL_H
+#define QFINGERPRINTNATIVESERIAL_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+
+
+// Linux serial transport on plain termios and epoll, for use with
+// QFingerprint::setDevice(). It reads straight from the descriptor in
+// waitForReadyRead() without going through an event loop, and in low latency
+// mode asks the driver for ASYNC_LOW_LATENCY, which drops the latency timer
+// of FTDI style adapters to 1 ms. The port is raw 8N1 without flow control.
+class QFingerprintNativeSerial : public QIODevice {
+    Q_OBJECT
+
+public:
+    explicit QFingerprintNativeSerial(QObject* parent = nullptr);
+    explicit QFingerprintNativeSerial(const QString& portName, QObject* parent = nullptr);
+    ~QFingerprintNativeSerial() override;
+
+    QString portName() const;
+    void setPortName(const QString& portName);
+
+    qint32 baudRate() const;
+    bool setBaudRate(qint32 baudRate);
+
+    bool lowLatency() const;
+    bool setLowLatency(bool lowLatency);
+
+    int handle() const;
+    bool clear();
+
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+    bool waitForReadyRead(int msecs) override;
+    bool waitForBytesWritten(int msecs) override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    bool configure();
+    bool applyLowLatency();
+    bool fillBuffer();
+    bool waitFor(quint32 events, int msecs);
+    bool flushPending(int msecs);
+    void setSystemError(const char* operation);
+
+    QString m_portName;
+    qint32 m_baudRate = 57600;
+    bool m_lowLatency = true;
+    int m_fd = -1;
+    int m_epoll = -1;
+    quint32 m_events = 0;
+    QByteArray m_readBuffer;
+    QByteArray m_writeBuffer;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintpreview.h"
+#include <QMutexLocker>
+
+
+QFingerprintPreview::QFingerprintPreview(QFingerprint* fingerprint, QObject* parent)
+    : QObject(parent), m_fingerprint(fingerprint)
+{
+    m_timer.setInterval(0);
+    connect(&m_timer, &QTimer::timeout, this, [this]() {
+        try {
+            this->captureFrame();
+        } catch (const QFingerprintException& e) {
+            m_timer.stop();
+            emit failed(QString::fromStdString(e.what()));
+        }
+    });
+}
+
+QFingerprint* QFingerprintPreview::fingerprint() const {
+    return m_fingerprint;
+}
+
+bool QFingerprintPreview::isRunning() const {
+    return m_timer.isActive();
+}
+
+QImage QFingerprintPreview::latestFrame() const {
+    QMutexLocker locker(&m_mutex);
+    return m_frames[m_front].copy();
+}
+
+quint64 QFingerprintPreview::capturedFrames() const {
+    return m_captured;
+}
+
+quint64 QFingerprintPreview::deliveredFrames() const {
+    return m_delivered;
+}
+
+quint64 QFingerprintPreview::droppedFrames() const {
+    return m_dropped;
+}
+
+qreal QFingerprintPreview::framesPerSecond() const {
+    qint64 nsecs = m_clock.isValid() ? m_clock.nsecsElapsed() : 0;
+    if (nsecs <= 0) {
+        return 0;
+    }
+    return qreal(m_captured) * 1000000000 / nsecs;
+}
+
+void QFingerprintPreview::resetStatistics() {
+    m_captured = 0;
+    m_delivered = 0;
+    m_dropped = 0;
+    m_clock.start();
+}
+
+void QFingerprintPreview::start() {
+    this->resetStatistics();
+    m_timer.start();
+}
+
+void QFingerprintPreview::stop() {
+    m_timer.stop();
+}
+
+bool QFingerprintPreview::captureFrame() {
+    if (!m_clock.isValid()) {
+        m_clock.start();
+    }
+
+    // A finished frame may have waited for the consumer, hand it out before
+    // the back buffer is overwritten
+    this->publish();
+
+    QFingerprintResult<void> acquired = m_fingerprint->tryReadImage();
+    if (!acquired) {
+        if (acquired.error() == QFingerprintError::NoFinger) {
+            return false;
+        }
+        throw QFingerprintException(acquired.errorString());
+    }
+
+    if (m_backReady) {
+        m_dropped++;
+    }
+    m_backReady = false;
+    m_fingerprint->downloadImage(&m_frames[1 - m_front]);
+    m_backReady = true;
+    m_captured++;
+
+    this->publish();
+    return true;
+}
+
+// Swaps the buffers unless the front frame is still shared with a consumer
+void QFingerprintPreview::publish() {
+    if (!m_backReady) {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        const QImage& front = m_frames[m_front];
+        if (!front.isNull() && !front.isDetached()) {
+            return;
+        }
+        m_front = 1 - m_front;
+        m_backReady = false;
+    }
+
+    m_delivered++;
+    emit frameReady(m_frames[m_front]);
+}
@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTPREVIEW_H
+#define QFINGERPRINTPREVIEW_H
+
+#include "qfingerprint.h"
+#include <QObject>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QTimer>
+
+
+// Live preview: acquires and downloads images back to back into two reused
+// frame buffers. frameReady() hands out the newest complete frame. While the
+// previous frame is still referenced, e.g. by a queued signal the consumer
+// has not processed yet, new frames replace each other in the back buffer and
+// only the newest one is delivered. A consumer keeping a frame beyond its slot
+// therefore takes latestFrame(), which is a copy.
+// Move the preview and its QFingerprint to a worker thread to keep the
+// blocking transfers off the GUI thread.
+class QFingerprintPreview : public QObject {
+    Q_OBJECT
+
+public:
+    explicit QFingerprintPreview(QFingerprint* fingerprint, QObject* parent = nullptr);
+
+    QFingerprint* fingerprint() const;
+    bool isRunning() const;
+
+    QImage latestFrame() const;
+
+    quint64 capturedFrames() const;
+    quint64 deliveredFrames() const;
+    quint64 droppedFrames() const;
+    // Captured frames per second since start() or resetStatistics()
+    qreal framesPerSecond() const;
+    void resetStatistics();
+
+    // One acquisition, false if no finger was on the sensor
+    bool captureFrame();
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void frameReady(const QImage& frame);
+    void failed(QString message);
+
+private:
+    void publish();
+
+    QFingerprint* m_fingerprint;
+    QTimer m_timer;
+    QImage m_frames[2];
+    int m_front = 0;
+    bool m_backReady = false;
+    mutable QMutex m_mutex;
+
+    QElapsedTimer m_clock;
+    quint64 m_captured = 0;
+    quint64 m_delivered = 0;
+    quint64 m_dropped = 0;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,270 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintquality.h"
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define QFINGERPRINT_QUALITY_BLOCK 16
+
+
+#ifdef __SSE2__
+static inline qint32 horizontalSum(__m128i v) {
+    v = _mm_add_epi32(v, _mm_srli_si128(v, 8));
+    v = _mm_add_epi32(v, _mm_srli_si128(v, 4));
+    return _mm_cvtsi128_si32(v);
+}
+#endif
+
+QFingerprintQuality::QFingerprintQuality() {
+}
+
+qreal QFingerprintQuality::minimumContrast() const {
+    return m_minimumContrast;
+}
+
+void QFingerprintQuality::setMinimumContrast(qreal contrast) {
+    m_minimumContrast = contrast;
+}
+
+qreal QFingerprintQuality::minimumCoverage() const {
+    return m_minimumCoverage;
+}
+
+void QFingerprintQuality::setMinimumCoverage(qreal coverage) {
+    m_minimumCoverage = coverage;
+}
+
+qreal QFingerprintQuality::minimumCoherence() const {
+    return m_minimumCoherence;
+}
+
+void QFingerprintQuality::setMinimumCoherence(qreal coherence) {
+    m_minimumCoherence = coherence;
+}
+
+int QFingerprintQuality::blockVariance() const {
+    return m_blockVariance;
+}
+
+void QFingerprintQuality::setBlockVariance(int variance) {
+    m_blockVariance = variance;
+}
+
+// Copies the image with a one pixel border of replicated edge pixels, so the
+// gradient kernels can read the neighbours of every pixel without bounds checks
+void QFingerprintQuality::pad(const QImage& image, std::vector<uchar>* padded) {
+    int width = image.width();
+    int height = image.height();
+    int stride = width + 2;
+    padded->resize(size_t(stride) * (height + 2));
+
+    for (int y = 0; y < height; y++) {
+        const uchar* line = image.constScanLine(y);
+        uchar* row = padded->data() + size_t(y + 1) * stride;
+        std::memcpy(row + 1, line, width);
+        row[0] = line[0];
+        row[width + 1] = line[width - 1];
+    }
+    std::memcpy(padded->data(), padded->data() + stride, stride);
+    std::memcpy(padded->data() + size_t(height + 1) * stride, padded->data() + size_t(height) * stride, stride);
+}
+
+// Pixel sums and gradient moments of the block whose top left pixel is (x, y).
+// Gradients are central differences, which fit 16 bit lanes.
+QFingerprintQuality::BlockSums QFingerprintQuality::blockSums(const uchar* padded, int stride, int x, int y) {
+    BlockSums sums;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    __m128i squares = zero;
+    __m128i gxx = zero;
+    __m128i gyy = zero;
+    __m128i gxy = zero;
+
+    for (int row = 0; row < QFINGERPRINT_QUALITY_BLOCK; row++) {
+        const uchar* center = padded + size_t(y + row + 1) * stride + x + 1;
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center));
+        __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center - 1));
+        __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + 1));
+        __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center - stride));
+        __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + stride));
+
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, zero));
+        __m128i low = _mm_unpacklo_epi8(pixels, zero);
+        __m128i high = _mm_unpackhi_epi8(pixels, zero);
+        squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+
+        __m128i gxLow = _mm_sub_epi16(_mm_unpacklo_epi8(right, zero), _mm_unpacklo_epi8(left, zero));
+        __m128i gxHigh = _mm_sub_epi16(_mm_unpackhi_epi8(right, zero), _mm_unpackhi_epi8(left, zero));
+        __m128i gyLow = _mm_sub_epi16(_mm_unpacklo_epi8(down, zero), _mm_unpacklo_epi8(up, zero));
+        __m128i gyHigh = _mm_sub_epi16(_mm_unpackhi_epi8(down, zero), _mm_unpackhi_epi8(up, zero));
+
+        gxx = _mm_add_epi32(gxx, _mm_add_epi32(_mm_madd_epi16(gxLow, gxLow), _mm_madd_epi16(gxHigh, gxHigh)));
+        gyy = _mm_add_epi32(gyy, _mm_add_epi32(_mm_madd_epi16(gyLow, gyLow), _mm_madd_epi16(gyHigh, gyHigh)));
+        gxy = _mm_add_epi32(gxy, _mm_add_epi32(_mm_madd_epi16(gxLow, gyLow), _mm_madd_epi16(gxHigh, gyHigh)));
+    }
+
+    sums.sum = quint32(_mm_cvtsi128_si32(_mm_add_epi64(sum, _mm_srli_si128(sum, 8))));
+    sums.squares = quint32(horizontalSum(squares));
+    sums.gxx = horizontalSum(gxx);
+    sums.gyy = horizontalSum(gyy);
+    sums.gxy = horizontalSum(gxy);
+#else
+    sums.sum = 0;
+    sums.squares = 0;
+    sums.gxx = 0;
+    sums.gyy = 0;
+    sums.gxy = 0;
+
+    for (int row = 0; row < QFINGERPRINT_QUALITY_BLOCK; row++) {
+        const uchar* center = padded + size_t(y + row + 1) * stride + x + 1;
+        for (int column = 0; column < QFINGERPRINT_QUALITY_BLOCK; column++) {
+            int pixel = center[column];
+            int gx = int(center[column + 1]) - int(center[column - 1]);
+            int gy = int(center[column + stride]) - int(center[column - stride]);
+            sums.sum += pixel;
+            sums.squares += pixel * pixel;
+            sums.gxx += gx * gx;
+            sums.gyy += gy * gy;
+            sums.gxy += gx * gy;
+        }
+    }
+#endif
+
+    return sums;
+}
+
+QFingerprintQualityScore QFingerprintQuality::score(const QImage& image) const {
+    QFingerprintQualityScore score;
+    if (image.format() != QImage::Format_Grayscale8) {
+        QImage grayscale = image.convertToFormat(QImage::Format_Grayscale8);
+        return grayscale.isNull() ? score : this->score(grayscale);
+    }
+
+    int columns = image.width() / QFINGERPRINT_QUALITY_BLOCK;
+    int rows = image.height() / QFINGERPRINT_QUALITY_BLOCK;
+    if (columns == 0 || rows == 0) {
+        return score;
+    }
+
+    std::vector<uchar> padded;
+    pad(image, &padded);
+    int stride = image.width() + 2;
+
+    const qint64 blockPixels = QFINGERPRINT_QUALITY_BLOCK * QFINGERPRINT_QUALITY_BLOCK;
+    const qint64 coveredVariance = qint64(m_blockVariance) * blockPixels * blockPixels;
+    quint64 sum = 0;
+    quint64 squares = 0;
+    int covered = 0;
+    qreal coherence = 0;
+
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            BlockSums block = blockSums(padded.data(), stride,
+                                        column * QFINGERPRINT_QUALITY_BLOCK,
+                                        row * QFINGERPRINT_QUALITY_BLOCK);
+            sum += block.sum;
+            squares += block.squares;
+
+            // blockPixels^2 times the variance, in integers
+            if (qint64(block.squares) * blockPixels - qint64(block.sum) * block.sum < coveredVariance) {
+                continue;
+            }
+            covered++;
+
+            qreal energy = qreal(block.gxx) + block.gyy;
+            if (energy > 0) {
+                qreal difference = qreal(block.gxx) - block.gyy;
+                coherence += std::sqrt(difference * difference + 4 * qreal(block.gxy) * block.gxy) / energy;
+            }
+        }
+    }
+
+    qreal pixels = qreal(rows) * columns * blockPixels;
+    qreal mean = sum / pixels;
+    score.contrast = std::sqrt(qMax<qreal>(0, squares / pixels - mean * mean));
+    score.coverage = qreal(covered) / (rows * columns);
+    score.coherence = covered ? coherence / covered : 0;
+    return score;
+}
+
+bool QFingerprintQuality::isAcceptable(const QFingerprintQualityScore& score) const {
+    return score.contrast >= m_minimumContrast
+        && score.coverage >= m_minimumCoverage
+        && score.coherence >= m_minimumCoherence;
+}
+
+QFingerprintResult<void> QFingerprintQuality::captureAndConvert(QFingerprint* fingerprint,
+                                                                uint8_t charBufferNumber, int maxAttempts) {
+    QFingerprintResult<void> failure(QFingerprintError::MessyImage, "No image passed the quality gate");
+    m_rejected = 0;
+
+    for (int attempt = 0; attempt < maxAttempts; attempt++) {
+        QFingerprintResult<void> acquired = fingerprint->tryReadImage();
+        if (!acquired) {
+            if (acquired.error() != QFingerprintError::NoFinger) {
+                return acquired;
+            }
+            failure = acquired;
+            continue;
+        }
+
+        try {
+            fingerprint->downloadImage(&m_image);
+        } catch (const QFingerprintException&) {
+            return QFingerprintResult<void>(QFingerprintError::DownloadImage);
+        }
+
+        m_lastScore = this->score(m_image);
+        if (!this->isAcceptable(m_lastScore)) {
+            m_rejected++;
+            failure = QFingerprintResult<void>(QFingerprintError::MessyImage, "No image passed the quality gate");
+            continue;
+        }
+
+        // The image buffer of the sensor still holds the scored image
+        return fingerprint->tryConvertImage(charBufferNumber);
+    }
+
+    return failure;
+}
+
+const QImage& QFingerprintQuality::lastImage() const {
+    return m_image;
+}
+
+QFingerprintQualityScore QFingerprintQuality::lastScore() const {
+    return m_lastScore;
+}
+
+int QFingerprintQuality::rejectedImages() const {
+    return m_rejected;
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTQUALITY_H
+#define QFINGERPRINTQUALITY_H
+
+#include "qfingerprint.h"
+#include <QImage>
+#include <vector>
+
+
+struct QFingerprintQualityScore {
+    // Standard deviation of all pixels, 0 to 127.5
+    qreal contrast = 0;
+    // Fraction of the 16x16 blocks that contain ridges
+    qreal coverage = 0;
+    // Mean ridge orientation coherence of the covered blocks, 0 to 1
+    qreal coherence = 0;
+};
+
+// Host side quality gate for downloaded images. score() rates a Grayscale8
+// image, with SSE2 kernels where available. An image that fails the gate is
+// not sent to convertImage(); a new one is acquired instead.
+// The gate needs the image on the host. Downloading it costs far more than a
+// failed convertImage() at low baud rates, so the gate is meant for images
+// that are downloaded anyway, e.g. frames of QFingerprintPreview, or for
+// fast links.
+class QFingerprintQuality {
+public:
+    QFingerprintQuality();
+
+    qreal minimumContrast() const;
+    void setMinimumContrast(qreal contrast);
+    qreal minimumCoverage() const;
+    void setMinimumCoverage(qreal coverage);
+    qreal minimumCoherence() const;
+    void setMinimumCoherence(qreal coherence);
+    // Pixel variance above which a block counts as covered
+    int blockVariance() const;
+    void setBlockVariance(int variance);
+
+    QFingerprintQualityScore score(const QImage& image) const;
+    bool isAcceptable(const QFingerprintQualityScore& score) const;
+
+    // Acquires, downloads and scores images until one passes the gate, then
+    // converts it into charBufferNumber. Gives up after maxAttempts.
+    QFingerprintResult<void> captureAndConvert(QFingerprint* fingerprint,
+                                               uint8_t charBufferNumber = FINGERPRINT_CHARBUFFER1,
+                                               int maxAttempts = 3);
+
+    // Image and score of the last captureAndConvert() attempt
+    const QImage& lastImage() const;
+    QFingerprintQualityScore lastScore() const;
+    int rejectedImages() const;
+
+private:
+    struct BlockSums {
+        quint32 sum;
+        quint32 squares;
+        qint32 gxx;
+        qint32 gyy;
+        qint32 gxy;
+    };
+
+    static void pad(const QImage& image, std::vector<uchar>* padded);
+    static BlockSums blockSums(const uchar* padded, int stride, int x, int y);
+
+    qreal m_minimumContrast = 20;
+    qreal m_minimumCoverage = 0.4;
+    qreal m_minimumCoherence = 0.4;
+    int m_blockVariance = 150;
+
+    QImage m_image;
+    QFingerprintQualityScore m_lastScore;
+    int m_rejected = 0;
+};
+
+#endif /* end of include guard */
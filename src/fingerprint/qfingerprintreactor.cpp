@@ -0,0 +1,370 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintreactor.h"
+#include "qfingerprintnativeserial.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+
+QFingerprintReactor::QFingerprintReactor() {
+    this->m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (this->m_epoll < 0) {
+        throw QFingerprintException("Creating the epoll set failed!");
+    }
+    this->m_clock.start();
+}
+
+QFingerprintReactor::~QFingerprintReactor() {
+    for (Device* device : this->m_devices) {
+        delete device;
+    }
+    ::close(this->m_epoll);
+}
+
+int QFingerprintReactor::addDevice(int fd, quint32 address) {
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    int index = this->m_devices.size();
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = quint32(index);
+    if (::epoll_ctl(this->m_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        return -1;
+    }
+
+    Device* device = new Device();
+    device->fd = fd;
+    device->address = address;
+    device->writable = false;
+    device->busy = false;
+    device->acknowledged = false;
+    device->draining = false;
+    device->drainDataPhase = false;
+    device->drainAcknowledged = false;
+    device->drainTimeout = 0;
+    device->deadline = 0;
+    this->m_devices.append(device);
+    return index;
+}
+
+// The port only lends its descriptor, it must stay open while the device is
+// registered and must not be read from at the same time.
+int QFingerprintReactor::addDevice(QFingerprintNativeSerial* port, quint32 address) {
+    return this->addDevice(port->handle(), address);
+}
+
+void QFingerprintReactor::removeDevice(int device) {
+    this->dropDevice(device, "The device was removed");
+}
+
+void QFingerprintReactor::dropDevice(int device, const char* message) {
+    Device* removed = this->m_devices.value(device);
+    if (!removed) {
+        return;
+    }
+
+    ::epoll_ctl(this->m_epoll, EPOLL_CTL_DEL, removed->fd, nullptr);
+    this->m_devices[device] = nullptr;
+    this->m_pending -= removed->commands.size();
+
+    for (const Command& command : removed->commands) {
+        if (command.callback) {
+            command.callback(QFingerprintResult<QByteArray>(QFingerprintError::Communication, message));
+        }
+    }
+    delete removed;
+}
+
+int QFingerprintReactor::deviceCount() const {
+    return this->m_devices.size() - this->m_devices.count(nullptr);
+}
+
+int QFingerprintReactor::timeout() const {
+    return this->m_timeout;
+}
+
+void QFingerprintReactor::setTimeout(int msecs) {
+    this->m_timeout = msecs;
+}
+
+void QFingerprintReactor::enqueue(int device, const QByteArray& packetPayload, Callback callback,
+                                  bool dataPhase, int timeout) {
+    Device* target = this->m_devices.value(device);
+    if (!target) {
+        if (callback) {
+            callback(QFingerprintResult<QByteArray>(QFingerprintError::InvalidArgument, "Unknown device"));
+        }
+        return;
+    }
+
+    target->commands.enqueue({packetPayload, callback, dataPhase, timeout < 0 ? this->m_timeout : timeout});
+    this->m_pending++;
+    this->startNext(device);
+}
+
+int QFingerprintReactor::pendingCommands() const {
+    return this->m_pending;
+}
+
+quint64 QFingerprintReactor::completedCommands() const {
+    return this->m_completed;
+}
+
+int QFingerprintReactor::processEvents(int msecs) {
+    quint64 completed = this->m_completed;
+
+    int wait = this->nextDeadline();
+    if (msecs >= 0 && (wait < 0 || msecs < wait)) {
+        wait = msecs;
+    }
+
+    struct epoll_event events[64];
+    int ready = ::epoll_wait(this->m_epoll, events, 64, wait);
+    for (int i = 0; i < ready; i++) {
+        int device = int(events[i].data.u32);
+        if (this->m_devices.value(device) && (events[i].events & EPOLLOUT)) {
+            this->flush(device);
+        }
+        if (this->m_devices.value(device) && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            this->receive(device);
+        }
+    }
+
+    this->expire();
+    return int(this->m_completed - completed);
+}
+
+void QFingerprintReactor::run() {
+    while (this->m_pending > 0) {
+        this->processEvents();
+    }
+}
+
+void QFingerprintReactor::startNext(int device) {
+    Device* target = this->m_devices[device];
+    if (target->busy || target->draining || target->commands.isEmpty()) {
+        return;
+    }
+
+    target->busy = true;
+    target->acknowledged = false;
+    target->data.clear();
+    target->output += QFingerprintFrame::encode(target->address, FINGERPRINT_COMMANDPACKET,
+                                                target->commands.head().packetPayload);
+    target->deadline = this->m_clock.elapsed() + target->commands.head().timeout;
+    this->flush(device);
+}
+
+void QFingerprintReactor::flush(int device) {
+    Device* target = this->m_devices[device];
+
+    while (!target->output.isEmpty()) {
+        ssize_t size = ::write(target->fd, target->output.constData(), size_t(target->output.size()));
+        if (size > 0) {
+            target->output.remove(0, int(size));
+        }else if (size < 0 && errno != EINTR) {
+            break;
+        }
+    }
+
+    // Only ask for writability while output is waiting, the set is level triggered
+    bool writable = !target->output.isEmpty();
+    if (writable != target->writable) {
+        struct epoll_event event = {};
+        event.events = writable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.u32 = quint32(device);
+        ::epoll_ctl(this->m_epoll, EPOLL_CTL_MOD, target->fd, &event);
+        target->writable = writable;
+    }
+}
+
+void QFingerprintReactor::receive(int device) {
+    char chunk[4096];
+    Device* target = this->m_devices[device];
+
+    bool hungUp = false;
+
+    while (true) {
+        ssize_t size = ::read(target->fd, chunk, sizeof(chunk));
+        if (size > 0) {
+            target->decoder.feed(chunk, int(size));
+            // A draining line is quiet only once nothing arrives for the timeout
+            if (target->draining) {
+                target->deadline = this->m_clock.elapsed() + target->drainTimeout;
+            }
+        }else if (size < 0 && errno == EINTR) {
+            continue;
+        }else {
+            // End of file or an error other than "no data" stays readable forever
+            hungUp = size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+    }
+
+    QByteArray packet;
+    // A callback may remove the device, look it up again for every packet
+    while ((target = this->m_devices.value(device))) {
+        QFingerprintFrameDecoder::Status status = target->decoder.next(&packet);
+        if (status == QFingerprintFrameDecoder::Incomplete) {
+            break;
+        }
+        if (status == QFingerprintFrameDecoder::Frame) {
+            if (target->draining) {
+                this->drainPacket(device, packet);
+            }else {
+                this->handlePacket(device, packet);
+            }
+        }else if (status == QFingerprintFrameDecoder::BadChecksum && target->busy && !target->draining) {
+            // The rest of the reply may still be on its way
+            this->fail(device, QFingerprintResult<QByteArray>(QFingerprintError::BadPacket));
+        }
+    }
+
+    if (hungUp) {
+        this->dropDevice(device, "The device hung up");
+    }
+}
+
+void QFingerprintReactor::handlePacket(int device, const QByteArray& packet) {
+    Device* target = this->m_devices[device];
+    if (!target->busy) {
+        return;
+    }
+
+    // The timeout is the longest silence between two packets, a long data
+    // phase does not expire while its packets keep arriving
+    const Command& command = target->commands.head();
+    target->deadline = this->m_clock.elapsed() + command.timeout;
+
+    uint8_t packetType = packet[0];
+    bool dataPhase = command.dataPhase;
+
+    if (packetType == FINGERPRINT_ACKPACKET && !target->acknowledged) {
+        uint8_t code = packet.size() > 1 ? uint8_t(packet[1]) : FINGERPRINT_ERROR_BADPACKET;
+        if (code != FINGERPRINT_OK) {
+            this->complete(device, QFingerprintResult<QByteArray>(qFingerprintErrorFromCode(code)));
+        }else if (dataPhase) {
+            target->acknowledged = true;
+        }else {
+            this->complete(device, QFingerprintResult<QByteArray>(packet.mid(2)));
+        }
+    }else if (dataPhase && target->acknowledged
+              && (packetType == FINGERPRINT_DATAPACKET || packetType == FINGERPRINT_ENDDATAPACKET)) {
+        target->data.append(packet.constData() + 1, packet.size() - 1);
+        if (packetType == FINGERPRINT_ENDDATAPACKET) {
+            this->complete(device, QFingerprintResult<QByteArray>(target->data));
+        }
+    }
+}
+
+// Late packets of an expired command are dropped up to its last expected one
+void QFingerprintReactor::drainPacket(int device, const QByteArray& packet) {
+    Device* target = this->m_devices[device];
+    uint8_t packetType = packet[0];
+
+    if (packetType == FINGERPRINT_ACKPACKET && !target->drainAcknowledged) {
+        bool accepted = packet.size() > 1 && uint8_t(packet[1]) == FINGERPRINT_OK;
+        if (accepted && target->drainDataPhase) {
+            target->drainAcknowledged = true;
+        }else {
+            this->finishDrain(device);
+        }
+    }else if (packetType == FINGERPRINT_ENDDATAPACKET && target->drainAcknowledged) {
+        this->finishDrain(device);
+    }
+}
+
+void QFingerprintReactor::finishDrain(int device) {
+    Device* target = this->m_devices[device];
+    target->draining = false;
+    target->drainAcknowledged = false;
+    this->startNext(device);
+}
+
+void QFingerprintReactor::complete(int device, const QFingerprintResult<QByteArray>& reply) {
+    Device* target = this->m_devices[device];
+    Command command = target->commands.dequeue();
+    target->busy = false;
+    target->acknowledged = false;
+    this->m_pending--;
+    this->m_completed++;
+
+    this->startNext(device);
+    if (command.callback) {
+        command.callback(reply);
+    }
+}
+
+int QFingerprintReactor::expire() {
+    int expired = 0;
+    qint64 now = this->m_clock.elapsed();
+
+    for (int device = 0; device < this->m_devices.size(); device++) {
+        Device* target = this->m_devices[device];
+        if (target && target->draining && target->deadline <= now) {
+            // The line stayed quiet, a partial late frame is dropped
+            target->decoder.clear();
+            this->finishDrain(device);
+        }else if (target && target->busy && target->deadline <= now) {
+            this->fail(device, QFingerprintResult<QByteArray>(QFingerprintError::Timeout));
+            expired++;
+        }
+    }
+    return expired;
+}
+
+// Whatever arrives late belongs to the failed command, the next command
+// waits until it has been drained
+void QFingerprintReactor::fail(int device, const QFingerprintResult<QByteArray>& reply) {
+    Device* target = this->m_devices[device];
+    const Command& command = target->commands.head();
+    target->draining = true;
+    target->drainDataPhase = command.dataPhase;
+    target->drainAcknowledged = target->acknowledged;
+    target->drainTimeout = command.timeout;
+    target->deadline = this->m_clock.elapsed() + command.timeout;
+    this->complete(device, reply);
+}
+
+int QFingerprintReactor::nextDeadline() const {
+    qint64 deadline = -1;
+    for (const Device* target : this->m_devices) {
+        if (target && (target->busy || target->draining) && (deadline < 0 || target->deadline < deadline)) {
+            deadline = target->deadline;
+        }
+    }
+
+    if (deadline < 0) {
+        return -1;
+    }
+    return int(qMax(qint64(0), deadline - this->m_clock.elapsed()));
+}
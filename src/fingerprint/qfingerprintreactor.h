@@ -0,0 +1,129 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTREACTOR_H
+#define QFINGERPRINTREACTOR_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QVector>
+
+#include <functional>
+
+#include "qfingerprint.h"
+#include "qfingerprintframe.h"
+
+class QFingerprintNativeSerial;
+
+
+// Drives many sensors from one thread. Every device has its own command
+// queue; one command per device is on the wire at a time, while all devices
+// are served together by a single epoll set. Descriptors are non-blocking,
+// replies are decoded as bytes arrive and every command has a deadline.
+// After a timeout the device is drained: its next command is only sent once
+// the late reply has arrived or the line stayed quiet for the timeout. A
+// device which hangs up is removed and its commands fail.
+//
+// Callbacks run on the thread calling processEvents(). They may queue
+// further commands, also for the same device.
+class QFingerprintReactor {
+public:
+    // The value is the reply payload after the confirmation code, for
+    // commands with a data phase it is the received data.
+    typedef std::function<void(const QFingerprintResult<QByteArray>& reply)> Callback;
+
+    QFingerprintReactor();
+    ~QFingerprintReactor();
+
+    // The descriptor is not owned and is switched to non-blocking mode
+    int addDevice(int fd, quint32 address = 0xFFFFFFFF);
+    int addDevice(QFingerprintNativeSerial* port, quint32 address = 0xFFFFFFFF);
+    void removeDevice(int device);
+    int deviceCount() const;
+
+    int timeout() const;
+    void setTimeout(int msecs);
+
+    // A timeout of -1 uses timeout(). It is the longest silence between two
+    // packets of the reply, a bad packet is drained like a timeout.
+    void enqueue(int device, const QByteArray& packetPayload, Callback callback,
+                 bool dataPhase = false, int timeout = -1);
+    int pendingCommands() const;
+    quint64 completedCommands() const;
+
+    // Waits up to msecs (-1 is forever) for events and handles them,
+    // returns the number of completed commands
+    int processEvents(int msecs = -1);
+    // Processes events until all queued commands are completed
+    void run();
+
+private:
+    struct Command {
+        QByteArray packetPayload;
+        Callback callback;
+        bool dataPhase;
+        int timeout;
+    };
+
+    struct Device {
+        int fd;
+        quint32 address;
+        bool writable;
+        bool busy;
+        bool acknowledged;
+        bool draining;          // Waiting for the reply of an expired command
+        bool drainDataPhase;
+        bool drainAcknowledged;
+        int drainTimeout;
+        qint64 deadline;
+        QByteArray output;
+        QByteArray data;
+        QFingerprintFrameDecoder decoder;
+        QQueue<Command> commands;
+    };
+
+    void dropDevice(int device, const char* message);
+    void startNext(int device);
+    void flush(int device);
+    void receive(int device);
+    void handlePacket(int device, const QByteArray& packet);
+    void fail(int device, const QFingerprintResult<QByteArray>& reply);
+    void drainPacket(int device, const QByteArray& packet);
+    void finishDrain(int device);
+    void complete(int device, const QFingerprintResult<QByteArray>& reply);
+    int expire();
+    int nextDeadline() const;
+
+    int m_epoll;
+    int m_timeout = 500;
+    int m_pending = 0;
+    int m_completedNow = 0;
+    quint64 m_completed = 0;
+    QElapsedTimer m_clock;
+    QVector<Device*> m_devices;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,236 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprintscrubber.h"
+#include "qfingerprinttemplatearchive.h"
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <climits>
+
+
+QFingerprintScrubber::QFingerprintScrubber(QFingerprint* fingerprint, QObject* parent)
+    : QObject(parent), m_fingerprint(fingerprint)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &QFingerprintScrubber::run);
+}
+
+QFingerprint* QFingerprintScrubber::fingerprint() const {
+    return m_fingerprint;
+}
+
+qreal QFingerprintScrubber::budget() const {
+    return m_budget;
+}
+
+void QFingerprintScrubber::setBudget(qreal budget) {
+    m_budget = qBound<qreal>(0.001, budget, 1);
+}
+
+int QFingerprintScrubber::passInterval() const {
+    return m_passInterval;
+}
+
+int QFingerprintScrubber::idleTime() const {
+    return m_idleTime;
+}
+
+void QFingerprintScrubber::setIdleTime(int msecs) {
+    m_idleTime = msecs;
+}
+
+void QFingerprintScrubber::setPassInterval(int msecs) {
+    m_passInterval = msecs;
+}
+
+uint8_t QFingerprintScrubber::charBufferNumber() const {
+    return m_charBufferNumber;
+}
+
+void QFingerprintScrubber::setCharBufferNumber(uint8_t charBufferNumber) {
+    if (charBufferNumber != FINGERPRINT_CHARBUFFER1 && charBufferNumber != FINGERPRINT_CHARBUFFER2) {
+        throw QFingerprintException("The given charbuffer number is invalid!");
+    }
+    m_charBufferNumber = charBufferNumber;
+}
+
+void QFingerprintScrubber::setReferenceDigests(const QHash<quint16, QByteArray>& digests) {
+    m_referenceDigests = digests;
+}
+
+void QFingerprintScrubber::setReference(const QFingerprintTemplateArchive& archive, const QString& sensor) {
+    m_referenceDigests.clear();
+    for (quint16 positionNumber : archive.positions(sensor)) {
+        m_referenceDigests.insert(positionNumber, archive.digest(sensor, positionNumber));
+    }
+}
+
+QByteArray QFingerprintScrubber::digest(const QList<uint8_t>& characteristicsData) {
+    QByteArray data;
+    data.reserve(characteristicsData.size());
+    for (uint8_t byte : characteristicsData) {
+        data.append(char(byte));
+    }
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+void QFingerprintScrubber::start() {
+    m_running = true;
+    m_ownCommandTime = -1;
+    m_timer.start(0);
+}
+
+void QFingerprintScrubber::stop() {
+    m_running = false;
+    m_timer.stop();
+}
+
+bool QFingerprintScrubber::isRunning() const {
+    return m_running;
+}
+
+void QFingerprintScrubber::defer(int msecs) {
+    m_deferred = QDeadlineTimer(msecs);
+}
+
+bool QFingerprintScrubber::step() {
+    // Reading the index is the first step of a pass
+    if (!m_planned) {
+        m_positions = this->occupiedPositions();
+        m_next = 0;
+        m_corrupted.clear();
+        m_planned = true;
+    }
+
+    if (m_next < m_positions.size()) {
+        quint16 positionNumber = m_positions[m_next];
+
+        QFingerprintResult<void> loaded = m_fingerprint->tryLoadTemplate(positionNumber, m_charBufferNumber);
+        if (!loaded) {
+            QFingerprintError error = loaded.error();
+            // The line failed, not the flash; the position is checked again
+            if (error == QFingerprintError::Timeout || error == QFingerprintError::BadPacket
+                || error == QFingerprintError::Communication || error == QFingerprintError::Cancelled) {
+                throw QFingerprintException(loaded.errorString());
+            }
+            this->report(positionNumber, QString::fromLatin1(loaded.errorString()));
+        } else if (m_referenceDigests.contains(positionNumber)) {
+            QList<uint8_t> characteristicsData = m_fingerprint->downloadCharacteristics(m_charBufferNumber);
+            if (digest(characteristicsData) != m_referenceDigests.value(positionNumber)) {
+                this->report(positionNumber, "The template differs from the host copy");
+            }
+        }
+        m_next++;
+    }
+
+    if (m_next < m_positions.size()) {
+        return true;
+    }
+    m_planned = false;
+    emit passFinished(m_positions.size(), m_corrupted.size());
+    return false;
+}
+
+QList<quint16> QFingerprintScrubber::corruptedPositions() const {
+    return m_corrupted;
+}
+
+int QFingerprintScrubber::checkedPositions() const {
+    return m_next;
+}
+
+int QFingerprintScrubber::remainingPositions() const {
+    return m_positions.size() - m_next;
+}
+
+// A command the scrubber did not send means the sensor is in use. Slots of
+// the signals emitted by step() may stop the scrubber.
+void QFingerprintScrubber::run() {
+    if (!m_running) {
+        return;
+    }
+    if (!m_deferred.hasExpired()) {
+        m_timer.start(int(m_deferred.remainingTime()));
+        return;
+    }
+    qint64 lastCommandTime = m_fingerprint->lastCommandTime();
+    if (lastCommandTime != m_ownCommandTime) {
+        qint64 idle = QDeadlineTimer::current().deadline() - lastCommandTime;
+        if (idle < m_idleTime) {
+            m_timer.start(int(m_idleTime - idle));
+            return;
+        }
+    }
+
+    // Exceptions must not leave the event loop, start() resumes the pass
+    QElapsedTimer clock;
+    clock.start();
+    try {
+        bool more = this->step();
+        m_ownCommandTime = m_fingerprint->lastCommandTime();
+        if (!m_running) {
+            return;
+        }
+        if (more) {
+            this->schedule(clock.elapsed());
+        } else {
+            m_timer.start(m_passInterval);
+        }
+    } catch (const QFingerprintException& e) {
+        m_running = false;
+        emit failed(QString::fromStdString(e.what()));
+    }
+}
+
+// The pause after a step is sized so that the step takes budget() of the time
+void QFingerprintScrubber::schedule(qint64 stepTime) {
+    qreal delay = stepTime * (1 - m_budget) / m_budget;
+    m_timer.start(int(qMin<qreal>(delay, INT_MAX)));
+}
+
+void QFingerprintScrubber::report(quint16 positionNumber, const QString& reason) {
+    m_corrupted.append(positionNumber);
+    emit corrupted(positionNumber, reason);
+}
+
+QList<quint16> QFingerprintScrubber::occupiedPositions() {
+    quint16 capacity = m_fingerprint->getStorageCapacity();
+    QList<quint16> positions;
+
+    for (uint8_t page = 0; page < m_fingerprint->model().indexPages(); page++) {
+        QBitArray templateIndex = m_fingerprint->getTemplateIndex(page);
+        for (int i = 0; i < templateIndex.size(); i++) {
+            int positionNumber = templateIndex.size() * page + i;
+            if (positionNumber >= capacity) {
+                return positions;
+            }
+            if (templateIndex[i]) {
+                positions.append(positionNumber);
+            }
+        }
+    }
+    return positions;
+}
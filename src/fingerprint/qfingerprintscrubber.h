@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTSCRUBBER_H
+#define QFINGERPRINTSCRUBBER_H
+
+#include "qfingerprint.h"
+#include <QObject>
+#include <QByteArray>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+
+class QFingerprintTemplateArchive;
+
+
+// Background check of the flash. Every occupied position is loaded into a
+// char buffer, flash errors show up as a failed loadTemplate(). Positions
+// with a host copy are also downloaded and compared by digest. Corrupted
+// positions are reported by corrupted() before a user fails on them.
+//
+// One position is checked per step. The steps are spread so that the
+// scrubber uses at most budget() of the sensor time. Any other command on
+// the sensor keeps the scrubber off it for idleTime(), so an interactive
+// workflow keeps its char buffers; defer() holds it back explicitly.
+class QFingerprintScrubber : public QObject {
+    Q_OBJECT
+
+public:
+    explicit QFingerprintScrubber(QFingerprint* fingerprint, QObject* parent = nullptr);
+
+    QFingerprint* fingerprint() const;
+
+    // Fraction of the time the sensor is busy with the scrubber, 0.05 by default
+    qreal budget() const;
+    void setBudget(qreal budget);
+
+    // Quiet time after another command before a step is taken, 2000 by default
+    int idleTime() const;
+    void setIdleTime(int msecs);
+
+    // Pause between two passes over the flash
+    int passInterval() const;
+    void setPassInterval(int msecs);
+
+    // Overwritten by every step, CHARBUFFER2 by default
+    uint8_t charBufferNumber() const;
+    void setCharBufferNumber(uint8_t charBufferNumber);
+
+    // Host copies as SHA-1 digests of the characteristics by position
+    void setReferenceDigests(const QHash<quint16, QByteArray>& digests);
+    void setReference(const QFingerprintTemplateArchive& archive, const QString& sensor);
+    static QByteArray digest(const QList<uint8_t>& characteristicsData);
+
+    void start();
+    void stop();
+    bool isRunning() const;
+    // No step is taken for the given time, e.g. while a finger is on the sensor
+    void defer(int msecs);
+
+    // Checks the next position, false once the pass is complete
+    bool step();
+
+    QList<quint16> corruptedPositions() const;
+    int checkedPositions() const;
+    int remainingPositions() const;
+
+signals:
+    void corrupted(quint16 positionNumber, QString reason);
+    void passFinished(int checked, int corrupted);
+    void failed(QString message);
+
+private:
+    void run();
+    void schedule(qint64 stepTime);
+    void report(quint16 positionNumber, const QString& reason);
+    QList<quint16> occupiedPositions();
+
+    QFingerprint* m_fingerprint;
+    QTimer m_timer;
+    qreal m_budget = 0.05;
+    int m_passInterval = 3600000;
+    int m_idleTime = 2000;
+    uint8_t m_charBufferNumber = FINGERPRINT_CHARBUFFER2;
+    QHash<quint16, QByteArray> m_referenceDigests;
+    QDeadlineTimer m_deferred;
+    // The last command of the sensor when the scrubber finished its step
+    qint64 m_ownCommandTime = -1;
+    bool m_running = false;
+
+    QList<quint16> m_positions;
+    bool m_planned = false;
+    int m_next = 0;
+    QList<quint16> m_corrupted;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTSEQLOCK_H
+#define QFINGERPRINTSEQLOCK_H
+
+#include <QAtomicInteger>
+#include <atomic>
+
+
+// Sequence number of a ring buffer slot with one writer per write and
+// optimistic readers. The n-th write of the ring holds 2n+1 while the slot is
+// written and 2n+2 once it is complete. A reader copies the slot between
+// beginRead() and endRead() and keeps the copy only if both succeed.
+class QFingerprintSeqLock {
+public:
+    QFingerprintSeqLock() : m_sequence(0) {}
+
+    void beginWrite(quint64 index) {
+        m_sequence.storeRelaxed(2 * index + 1);
+        // The odd sequence is visible before any payload store
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite(quint64 index) {
+        m_sequence.storeRelease(2 * index + 2);
+    }
+
+    bool beginRead(quint64 index) const {
+        return m_sequence.loadAcquire() == 2 * index + 2;
+    }
+
+    bool endRead(quint64 index) const {
+        // The payload loads complete before the sequence is checked again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_sequence.loadRelaxed() == 2 * index + 2;
+    }
+
+private:
+    QAtomicInteger<quint64> m_sequence;
+};
+
+#endif /* end of include guard */
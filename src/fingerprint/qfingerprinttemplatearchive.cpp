@@ -0,0 +1,362 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprinttemplatearchive.h"
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QSaveFile>
+
+// File header: magic, version, number of templates and of entries. Then per
+// template its SHA-1, raw and stored size, per entry the sensor, position and
+// template, and finally the stored templates back to back.
+static const quint32 ArchiveMagic = 0x51465054; // "QFPT"
+static const quint16 ArchiveVersion = 1;
+
+// Codec: a control byte below 0x80 is followed by control + 1 literal bytes,
+// from 0x80 on it stands for (control & 0x7F) + 2 zero bytes
+static const int MaxLiteralRun = 128;
+static const int MaxZeroRun = 129;
+
+
+QFingerprintTemplateArchive::QFingerprintTemplateArchive() {
+}
+
+void QFingerprintTemplateArchive::insert(const QString& sensor, quint16 positionNumber,
+                                         const QList<uint8_t>& characteristicsData) {
+    QByteArray data;
+    data.reserve(characteristicsData.size());
+    for (uint8_t byte : characteristicsData) {
+        data.append(char(byte));
+    }
+
+    QByteArray digest = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+    int index = m_blobIndex.value(digest, -1);
+    if (index < 0) {
+        Blob blob;
+        blob.digest = digest;
+        blob.rawSize = quint32(data.size());
+        blob.data = compress(data);
+        blob.storedSize = quint32(blob.data.size());
+        blob.offset = -1;
+        index = m_blobs.size();
+        m_blobs.append(blob);
+        m_blobIndex.insert(digest, index);
+    }
+    m_entries[sensor].insert(positionNumber, index);
+}
+
+void QFingerprintTemplateArchive::remove(const QString& sensor, quint16 positionNumber) {
+    auto entries = m_entries.find(sensor);
+    if (entries == m_entries.end()) {
+        return;
+    }
+    entries->remove(positionNumber);
+    if (entries->isEmpty()) {
+        m_entries.erase(entries);
+    }
+}
+
+int QFingerprintTemplateArchive::backup(const QString& sensor, QFingerprint* fingerprint) {
+    quint16 capacity = fingerprint->getStorageCapacity();
+    int count = 0;
+
+    for (uint8_t page = 0; page < fingerprint->model().indexPages(); page++) {
+        QBitArray templateIndex = fingerprint->getTemplateIndex(page);
+        for (int i = 0; i < templateIndex.size(); i++) {
+            int positionNumber = templateIndex.size() * page + i;
+            if (positionNumber >= capacity) {
+                return count;
+            }
+            if (templateIndex[i]) {
+                this->insert(sensor, quint16(positionNumber), fingerprint->downloadTemplate(quint16(positionNumber)));
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Only templates that are still referenced are written, in order of first use
+bool QFingerprintTemplateArchive::save(const QString& fileName) {
+    QVector<int> remap(m_blobs.size(), -1);
+    QVector<int> used;
+    for (const QMap<quint16, int>& entries : m_entries) {
+        for (int index : entries) {
+            if (remap[index] < 0) {
+                remap[index] = used.size();
+                used.append(index);
+            }
+        }
+    }
+
+    // The file may be the one the templates are read from
+    QVector<QByteArray> data;
+    data.reserve(used.size());
+    for (int index : used) {
+        data.append(this->blobData(index));
+        if (data.last().size() != int(m_blobs[index].storedSize)) {
+            return false;
+        }
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << ArchiveMagic << ArchiveVersion << quint32(used.size()) << quint32(this->templateCount());
+    for (int index : used) {
+        const Blob& blob = m_blobs[index];
+        stream.writeRawData(blob.digest.constData(), blob.digest.size());
+        stream << blob.rawSize << blob.storedSize;
+    }
+    for (auto entries = m_entries.cbegin(); entries != m_entries.cend(); ++entries) {
+        for (auto entry = entries->cbegin(); entry != entries->cend(); ++entry) {
+            stream << entries.key() << entry.key() << quint32(remap[entry.value()]);
+        }
+    }
+    for (const QByteArray& blobData : data) {
+        stream.writeRawData(blobData.constData(), blobData.size());
+    }
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        return false;
+    }
+
+    // Continue with the compacted tables, the templates stay in memory
+    QVector<Blob> blobs;
+    m_blobIndex.clear();
+    for (int i = 0; i < used.size(); i++) {
+        Blob blob = m_blobs[used[i]];
+        blob.data = data[i];
+        blob.offset = -1;
+        m_blobIndex.insert(blob.digest, blobs.size());
+        blobs.append(blob);
+    }
+    m_blobs = blobs;
+    for (QMap<quint16, int>& entries : m_entries) {
+        for (int& index : entries) {
+            index = remap[index];
+        }
+    }
+    m_file.close();
+    return true;
+}
+
+bool QFingerprintTemplateArchive::open(const QString& fileName) {
+    this->clear();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&m_file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic, blobCount, entryCount;
+    quint16 version;
+    stream >> magic >> version >> blobCount >> entryCount;
+    if (stream.status() != QDataStream::Ok || magic != ArchiveMagic || version != ArchiveVersion) {
+        this->clear();
+        return false;
+    }
+
+    for (quint32 i = 0; i < blobCount && stream.status() == QDataStream::Ok; i++) {
+        Blob blob;
+        blob.digest.resize(20);
+        stream.readRawData(blob.digest.data(), blob.digest.size());
+        stream >> blob.rawSize >> blob.storedSize;
+        blob.offset = -1;
+        m_blobIndex.insert(blob.digest, m_blobs.size());
+        m_blobs.append(blob);
+    }
+    for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; i++) {
+        QString sensor;
+        quint16 positionNumber;
+        quint32 index;
+        stream >> sensor >> positionNumber >> index;
+        if (index >= quint32(m_blobs.size())) {
+            this->clear();
+            return false;
+        }
+        m_entries[sensor].insert(positionNumber, int(index));
+    }
+    if (stream.status() != QDataStream::Ok) {
+        this->clear();
+        return false;
+    }
+
+    qint64 offset = m_file.pos();
+    for (Blob& blob : m_blobs) {
+        blob.offset = offset;
+        offset += blob.storedSize;
+    }
+    if (offset > m_file.size()) {
+        this->clear();
+        return false;
+    }
+    return true;
+}
+
+void QFingerprintTemplateArchive::clear() {
+    m_blobs.clear();
+    m_blobIndex.clear();
+    m_entries.clear();
+    m_file.close();
+}
+
+bool QFingerprintTemplateArchive::contains(const QString& sensor, quint16 positionNumber) const {
+    return m_entries.value(sensor).contains(positionNumber);
+}
+
+QList<uint8_t> QFingerprintTemplateArchive::characteristics(const QString& sensor, quint16 positionNumber) const {
+    QList<uint8_t> characteristicsData;
+    int index = m_entries.value(sensor).value(positionNumber, -1);
+    if (index < 0) {
+        return characteristicsData;
+    }
+
+    // A template damaged on disk is not handed out
+    QByteArray data = decompress(this->blobData(index), int(m_blobs[index].rawSize));
+    if (QCryptographicHash::hash(data, QCryptographicHash::Sha1) != m_blobs[index].digest) {
+        return characteristicsData;
+    }
+    characteristicsData.reserve(data.size());
+    for (char byte : data) {
+        characteristicsData.append(uint8_t(byte));
+    }
+    return characteristicsData;
+}
+
+QByteArray QFingerprintTemplateArchive::digest(const QString& sensor, quint16 positionNumber) const {
+    int index = m_entries.value(sensor).value(positionNumber, -1);
+    return index < 0 ? QByteArray() : m_blobs[index].digest;
+}
+
+QStringList QFingerprintTemplateArchive::sensors() const {
+    return m_entries.keys();
+}
+
+QList<quint16> QFingerprintTemplateArchive::positions(const QString& sensor) const {
+    return m_entries.value(sensor).keys();
+}
+
+int QFingerprintTemplateArchive::templateCount() const {
+    int count = 0;
+    for (const QMap<quint16, int>& entries : m_entries) {
+        count += entries.size();
+    }
+    return count;
+}
+
+int QFingerprintTemplateArchive::uniqueTemplateCount() const {
+    return m_blobs.size();
+}
+
+qint64 QFingerprintTemplateArchive::rawSize() const {
+    qint64 size = 0;
+    for (const QMap<quint16, int>& entries : m_entries) {
+        for (int index : entries) {
+            size += m_blobs[index].rawSize;
+        }
+    }
+    return size;
+}
+
+qint64 QFingerprintTemplateArchive::storedSize() const {
+    qint64 size = 0;
+    for (const Blob& blob : m_blobs) {
+        size += blob.storedSize;
+    }
+    return size;
+}
+
+QByteArray QFingerprintTemplateArchive::blobData(int index) const {
+    const Blob& blob = m_blobs[index];
+    if (blob.offset < 0) {
+        return blob.data;
+    }
+    if (!m_file.seek(blob.offset)) {
+        return QByteArray();
+    }
+    return m_file.read(blob.storedSize);
+}
+
+QByteArray QFingerprintTemplateArchive::compress(const QByteArray& data) {
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    const int size = data.size();
+    QByteArray compressed;
+    compressed.reserve(size / 2);
+
+    int i = 0;
+    while (i < size) {
+        int zeros = 0;
+        while (i + zeros < size && bytes[i + zeros] == 0 && zeros < MaxZeroRun) {
+            zeros++;
+        }
+        if (zeros >= 2) {
+            compressed.append(char(0x80 | (zeros - 2)));
+            i += zeros;
+            continue;
+        }
+
+        // Literals up to the next pair of zeros
+        int start = i;
+        while (i < size && i - start < MaxLiteralRun && !(bytes[i] == 0 && i + 1 < size && bytes[i + 1] == 0)) {
+            i++;
+        }
+        compressed.append(char(i - start - 1));
+        compressed.append(data.constData() + start, i - start);
+    }
+    return compressed;
+}
+
+// Returns an empty array for corrupt data
+QByteArray QFingerprintTemplateArchive::decompress(const QByteArray& data, int size) {
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    QByteArray decompressed;
+    decompressed.reserve(size);
+
+    int i = 0;
+    while (i < data.size()) {
+        int control = bytes[i++];
+        if (control & 0x80) {
+            decompressed.append(QByteArray((control & 0x7F) + 2, 0));
+        }else {
+            int count = control + 1;
+            if (i + count > data.size()) {
+                return QByteArray();
+            }
+            decompressed.append(data.constData() + i, count);
+            i += count;
+        }
+        if (decompressed.size() > size) {
+            return QByteArray();
+        }
+    }
+    return decompressed.size() == size ? decompressed : QByteArray();
+}
@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTTEMPLATEARCHIVE_H
+#define QFINGERPRINTTEMPLATEARCHIVE_H
+
+#include "qfingerprint.h"
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+#include <QVector>
+
+
+// Backup of the characteristics of many sensors. Templates are stored once
+// per content, mirrored sensors share them, and compressed by collapsing the
+// zero runs characteristics data is full of. An opened archive only reads the
+// tables; characteristics() reads and expands a single template.
+class QFingerprintTemplateArchive {
+public:
+    QFingerprintTemplateArchive();
+
+    void insert(const QString& sensor, quint16 positionNumber, const QList<uint8_t>& characteristicsData);
+    void remove(const QString& sensor, quint16 positionNumber);
+    // Downloads every stored template of the sensor, returns their number
+    int backup(const QString& sensor, QFingerprint* fingerprint);
+
+    bool save(const QString& fileName);
+    bool open(const QString& fileName);
+    void clear();
+
+    bool contains(const QString& sensor, quint16 positionNumber) const;
+    // Empty if the archive holds no such template or its data does not match the SHA-1
+    QList<uint8_t> characteristics(const QString& sensor, quint16 positionNumber) const;
+    // SHA-1 of the characteristics, read from the tables only
+    QByteArray digest(const QString& sensor, quint16 positionNumber) const;
+    QStringList sensors() const;
+    QList<quint16> positions(const QString& sensor) const;
+
+    int templateCount() const;
+    int uniqueTemplateCount() const;
+    // Bytes of characteristics before and after deduplication and compression
+    qint64 rawSize() const;
+    qint64 storedSize() const;
+
+    static QByteArray compress(const QByteArray& data);
+    static QByteArray decompress(const QByteArray& data, int size);
+
+private:
+    struct Blob {
+        QByteArray digest;
+        quint32 rawSize;
+        quint32 storedSize;
+        // Position in the opened file, data is empty until read
+        qint64 offset;
+        QByteArray data;
+    };
+
+    QByteArray blobData(int index) const;
+
+    QVector<Blob> m_blobs;
+    QHash<QByteArray, int> m_blobIndex;
+    QMap<QString, QMap<quint16, int>> m_entries;
+    mutable QFile m_file;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprinttemplatecache.h"
+
+
+QFingerprintTemplateCache::QFingerprintTemplateCache(int maxEntries)
+    : m_entries(maxEntries)
+{
+}
+
+int QFingerprintTemplateCache::maxEntries() const {
+    return m_entries.maxCost();
+}
+
+void QFingerprintTemplateCache::setMaxEntries(int maxEntries) {
+    m_entries.setMaxCost(maxEntries);
+}
+
+bool QFingerprintTemplateCache::lookup(quint16 positionNumber, QList<uint8_t>* characteristicsData) {
+    QList<uint8_t>* entry = m_entries.object(Key(positionNumber, this->generation(positionNumber)));
+    if (!entry) {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    if (characteristicsData) {
+        *characteristicsData = *entry;
+    }
+    return true;
+}
+
+void QFingerprintTemplateCache::insert(quint16 positionNumber, const QList<uint8_t>& characteristicsData) {
+    m_entries.insert(Key(positionNumber, this->generation(positionNumber)), new QList<uint8_t>(characteristicsData));
+}
+
+void QFingerprintTemplateCache::invalidate(quint16 positionNumber, quint16 count) {
+    for (quint32 i = positionNumber; i < (quint32)positionNumber + count; i++) {
+        m_entries.remove(Key(i, this->generation(i)));
+        m_generations.insert(i, ++m_lastGeneration);
+    }
+}
+
+void QFingerprintTemplateCache::clear() {
+    m_entries.clear();
+    m_generations.clear();
+    m_clearGeneration = ++m_lastGeneration;
+}
+
+quint32 QFingerprintTemplateCache::generation(quint16 positionNumber) const {
+    return m_generations.value(positionNumber, m_clearGeneration);
+}
+
+int QFingerprintTemplateCache::size() const {
+    return m_entries.size();
+}
+
+quint64 QFingerprintTemplateCache::hits() const {
+    return m_hits;
+}
+
+quint64 QFingerprintTemplateCache::misses() const {
+    return m_misses;
+}
+
+void QFingerprintTemplateCache::resetStatistics() {
+    m_hits = 0;
+    m_misses = 0;
+}
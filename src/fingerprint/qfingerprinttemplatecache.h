@@ -0,0 +1,69 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTTEMPLATECACHE_H
+#define QFINGERPRINTTEMPLATECACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QPair>
+
+
+// Bounded LRU cache of downloaded characteristics, keyed by sensor position
+// and the content generation of that position. QFingerprint bumps the
+// generation whenever the position is written, deleted or cleared, so a
+// stale entry can never be returned.
+class QFingerprintTemplateCache {
+public:
+    explicit QFingerprintTemplateCache(int maxEntries = 64);
+
+    int maxEntries() const;
+    void setMaxEntries(int maxEntries);
+
+    bool lookup(quint16 positionNumber, QList<uint8_t>* characteristicsData);
+    void insert(quint16 positionNumber, const QList<uint8_t>& characteristicsData);
+    void invalidate(quint16 positionNumber, quint16 count = 1);
+    void clear();
+
+    quint32 generation(quint16 positionNumber) const;
+    int size() const;
+
+    quint64 hits() const;
+    quint64 misses() const;
+    void resetStatistics();
+
+private:
+    typedef QPair<quint16, quint32> Key;
+
+    QCache<Key, QList<uint8_t>> m_entries;
+    QHash<quint16, quint32> m_generations;
+    quint32 m_clearGeneration = 0;
+    quint32 m_lastGeneration = 0;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,274 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qfingerprinttrace.h"
+#include "qfingerprint.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <algorithm>
+
+namespace {
+
+// Traces are told apart by id, an address may be reused by a later trace
+QAtomicInteger<quint64> nextTraceId(1);
+
+// The ring of the last trace the thread recorded into
+struct RingCache {
+    quint64 trace = 0;
+    void* ring = nullptr;
+};
+thread_local RingCache ringCache;
+
+struct InstructionName {
+    quint8 instruction;
+    const char* name;
+};
+
+const InstructionName INSTRUCTION_NAMES[] = {
+    {FINGERPRINT_VERIFYPASSWORD, "verifyPassword"},
+    {FINGERPRINT_SETPASSWORD, "setPassword"},
+    {FINGERPRINT_SETADDRESS, "setAddress"},
+    {FINGERPRINT_SETSYSTEMPARAMETER, "setSystemParameter"},
+    {FINGERPRINT_GETSYSTEMPARAMETERS, "getSystemParameters"},
+    {FINGERPRINT_TEMPLATEINDEX, "getTemplateIndex"},
+    {FINGERPRINT_TEMPLATECOUNT, "getTemplateCount"},
+    {FINGERPRINT_READIMAGE, "readImage"},
+    {FINGERPRINT_DOWNLOADIMAGE, "downloadImage"},
+    {FINGERPRINT_CONVERTIMAGE, "convertImage"},
+    {FINGERPRINT_CREATETEMPLATE, "createTemplate"},
+    {FINGERPRINT_STORETEMPLATE, "storeTemplate"},
+    {FINGERPRINT_SEARCHTEMPLATE, "searchTemplate"},
+    {FINGERPRINT_LOADTEMPLATE, "loadTemplate"},
+    {FINGERPRINT_DELETETEMPLATE, "deleteTemplate"},
+    {FINGERPRINT_CLEARDATABASE, "clearDatabase"},
+    {FINGERPRINT_GENERATERANDOMNUMBER, "generateRandomNumber"},
+    {FINGERPRINT_COMPARECHARACTERISTICS, "compareCharacteristics"},
+    {FINGERPRINT_UPLOADCHARACTERISTICS, "uploadCharacteristics"},
+    {FINGERPRINT_DOWNLOADCHARACTERISTICS, "downloadCharacteristics"},
+};
+
+void appendEscaped(QByteArray* json, const QByteArray& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            json->append('\\').append(c);
+        } else if (uchar(c) >= 0x20) {
+            json->append(c);
+        }
+    }
+}
+
+// Trace event timestamps are microseconds
+QByteArray microseconds(qint64 nsecs) {
+    return QByteArray::number(double(nsecs) / 1000, 'f', 3);
+}
+
+}
+
+
+QFingerprintTrace::QFingerprintTrace(int capacityPerThread)
+    : m_capacity(qMax(1, capacityPerThread)), m_id(nextTraceId.fetchAndAddRelaxed(1))
+{
+    m_clock.start();
+}
+
+QFingerprintTrace::~QFingerprintTrace() {
+    for (Ring* ring : m_rings) {
+        delete[] ring->entries;
+        delete ring;
+    }
+}
+
+int QFingerprintTrace::capacityPerThread() const {
+    return m_capacity;
+}
+
+qint64 QFingerprintTrace::now() const {
+    return m_clock.nsecsElapsed();
+}
+
+// Lock-free after the first span of the thread: one writer per ring, the
+// sequence number tells readers whether a slot is complete
+void QFingerprintTrace::record(const char* name, const char* category, qint64 start, quint32 address,
+                               quint8 instruction, int size) {
+    qint64 end = this->now();
+    Ring* ring = this->ring();
+
+    quint64 index = ring->head.loadRelaxed();
+    Slot& slot = ring->entries[index % m_capacity];
+
+    slot.sequence.beginWrite(index);
+    slot.span.start = start;
+    slot.span.duration = end - start;
+    slot.span.name = name;
+    slot.span.category = category;
+    slot.span.address = address;
+    slot.span.instruction = instruction;
+    slot.span.size = size;
+    slot.span.thread = ring->thread;
+    slot.sequence.endWrite(index);
+    ring->head.storeRelease(index + 1);
+}
+
+void QFingerprintTrace::setThreadName(const QString& name) {
+    Ring* ring = this->ring();
+    QMutexLocker locker(&m_mutex);
+    ring->name = name;
+}
+
+QFingerprintTrace::Ring* QFingerprintTrace::ring() {
+    if (ringCache.trace == m_id) {
+        return static_cast<Ring*>(ringCache.ring);
+    }
+
+    Qt::HANDLE threadId = QThread::currentThreadId();
+    QMutexLocker locker(&m_mutex);
+    Ring* found = nullptr;
+    for (Ring* ring : m_rings) {
+        if (ring->threadId == threadId) {
+            found = ring;
+            break;
+        }
+    }
+
+    // A finished thread's id may be taken by a new thread, which continues
+    // its ring; there is still only one writer
+    if (!found) {
+        found = new Ring;
+        found->threadId = threadId;
+        found->thread = m_rings.size() + 1;
+        found->name = QString("Thread %1").arg(found->thread);
+        found->entries = new Slot[m_capacity];
+        found->head.storeRelaxed(0);
+        found->cleared.storeRelaxed(0);
+        m_rings.append(found);
+    }
+
+    ringCache.trace = m_id;
+    ringCache.ring = found;
+    return found;
+}
+
+QList<QFingerprintTraceSpan> QFingerprintTrace::spans() const {
+    QList<QFingerprintTraceSpan> snapshot;
+    QMutexLocker locker(&m_mutex);
+
+    for (const Ring* ring : m_rings) {
+        quint64 head = ring->head.loadAcquire();
+        quint64 first = head > (quint64)m_capacity ? head - m_capacity : 0;
+        first = qMax(first, ring->cleared.loadAcquire());
+
+        for (quint64 index = first; index < head; index++) {
+            const Slot& slot = ring->entries[index % m_capacity];
+            // Still being written or already overwritten
+            if (!slot.sequence.beginRead(index)) {
+                continue;
+            }
+
+            QFingerprintTraceSpan span = slot.span;
+            if (slot.sequence.endRead(index)) {
+                snapshot.append(span);
+            }
+        }
+    }
+
+    std::sort(snapshot.begin(), snapshot.end(), [](const QFingerprintTraceSpan& a, const QFingerprintTraceSpan& b) {
+        return a.start < b.start;
+    });
+    return snapshot;
+}
+
+quint64 QFingerprintTrace::recordedSpans() const {
+    QMutexLocker locker(&m_mutex);
+    quint64 recorded = 0;
+    for (const Ring* ring : m_rings) {
+        recorded += ring->head.loadAcquire() - ring->cleared.loadAcquire();
+    }
+    return recorded;
+}
+
+// Writers keep going, spans before the mark are just no longer exported
+void QFingerprintTrace::clear() {
+    QMutexLocker locker(&m_mutex);
+    for (Ring* ring : m_rings) {
+        ring->cleared.storeRelease(ring->head.loadAcquire());
+    }
+}
+
+QByteArray QFingerprintTrace::toChromeTrace() const {
+    QList<QFingerprintTraceSpan> snapshot = this->spans();
+
+    QByteArray json;
+    json.reserve(160 * (snapshot.size() + 1));
+    json.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const Ring* ring : m_rings) {
+            json.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":")
+                .append(QByteArray::number(ring->thread))
+                .append(",\"args\":{\"name\":\"");
+            appendEscaped(&json, ring->name.toUtf8());
+            json.append("\"}},\n");
+        }
+    }
+
+    for (const QFingerprintTraceSpan& span : snapshot) {
+        json.append("{\"name\":\"");
+        appendEscaped(&json, span.name);
+        json.append("\",\"cat\":\"");
+        appendEscaped(&json, span.category);
+        json.append("\",\"ph\":\"X\",\"ts\":").append(microseconds(span.start))
+            .append(",\"dur\":").append(microseconds(span.duration))
+            .append(",\"pid\":1,\"tid\":").append(QByteArray::number(span.thread))
+            .append(",\"args\":{\"address\":\"0x").append(QByteArray::number(span.address, 16))
+            .append("\",\"command\":\"").append(instructionName(span.instruction))
+            .append("\",\"bytes\":").append(QByteArray::number(span.size))
+            .append("}},\n");
+    }
+
+    if (json.endsWith(",\n")) {
+        json.chop(2);
+    }
+    json.append("\n]}\n");
+    return json;
+}
+
+bool QFingerprintTrace::exportChromeTrace(const QString& fileName) const {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    QByteArray json = this->toChromeTrace();
+    return file.write(json) == json.size();
+}
+
+const char* QFingerprintTrace::instructionName(quint8 instruction) {
+    for (const InstructionName& entry : INSTRUCTION_NAMES) {
+        if (entry.instruction == instruction) {
+            return entry.name;
+        }
+    }
+    return "unknown";
+}
@@ -0,0 +1,111 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QFINGERPRINTTRACE_H
+#define QFINGERPRINTTRACE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+
+#include "qfingerprintseqlock.h"
+
+
+struct QFingerprintTraceSpan {
+    qint64 start;           // Nanoseconds since the trace was created
+    qint64 duration;
+    const char* name;       // Static strings, see QFingerprintTrace::record()
+    const char* category;
+    quint32 address;
+    quint8 instruction;     // Instruction of the command the span belongs to
+    int size;               // Bytes written or received
+    int thread;             // Index of the recording thread, from 1
+};
+
+
+// Timeline of the commands of one or more QFingerprint objects. QFingerprint
+// records a span for every packet it writes and for every wait on a packet
+// it reads, e.g. the ack of a command and each data packet of a download.
+// Every thread records into a ring of its own with plain stores and a
+// sequence number, the oldest spans are overwritten when it is full. Only
+// the first span of a thread takes a lock to register its ring.
+//
+// toChromeTrace() writes the Chrome trace event format, which is opened by
+// chrome://tracing and https://ui.perfetto.dev.
+class QFingerprintTrace {
+public:
+    // Each ring keeps at least one span
+    explicit QFingerprintTrace(int capacityPerThread = 16384);
+    ~QFingerprintTrace();
+
+    int capacityPerThread() const;
+    qint64 now() const;
+
+    void record(const char* name, const char* category, qint64 start, quint32 address,
+                quint8 instruction, int size);
+    // Shown as the name of the calling thread in the exported trace
+    void setThreadName(const QString& name);
+
+    QList<QFingerprintTraceSpan> spans() const;
+    quint64 recordedSpans() const;
+    void clear();
+
+    QByteArray toChromeTrace() const;
+    bool exportChromeTrace(const QString& fileName) const;
+
+    // Name of a command instruction, e.g. "downloadImage"
+    static const char* instructionName(quint8 instruction);
+
+private:
+    struct Slot {
+        QFingerprintSeqLock sequence;
+        QFingerprintTraceSpan span;
+    };
+
+    struct Ring {
+        Qt::HANDLE threadId;
+        int thread;
+        QString name;
+        Slot* entries;
+        QAtomicInteger<quint64> head;   // Written by the owning thread only
+        QAtomicInteger<quint64> cleared;
+    };
+
+    Ring* ring();
+
+    int m_capacity;
+    quint64 m_id;
+    QElapsedTimer m_clock;
+    mutable QMutex m_mutex;
+    QList<Ring*> m_rings;
+
+    Q_DISABLE_COPY(QFingerprintTrace)
+};
+
+#endif /* end of include guard */
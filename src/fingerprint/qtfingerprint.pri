@@ -3,8 +3,53 @@ DEPENDPATH += $$PWD
 
 QT += core gui serialport
 
-HEADERS += $$PWD/qfingerprint.h
+HEADERS += $$PWD/qfingerprint.h \
+           $$PWD/qfingerprintframe.h \
+           $$PWD/qfingerprintmodel.h \
+           $$PWD/qfingerprintcapture.h \
+           $$PWD/qfingerprintseqlock.h \
+           $$PWD/qfingerprinttemplatecache.h \
+           $$PWD/qfingerprintcascadesearch.h \
+           $$PWD/qfingerprintcompactor.h \
+           $$PWD/qfingerprintdiscovery.h \
+           $$PWD/qfingerprintmirror.h \
+           $$PWD/qfingerprintpreview.h \
+           $$PWD/qfingerprintquality.h \
+           $$PWD/qfingerprinthostmatcher.h \
+           $$PWD/qfingerprintimagearchive.h \
+           $$PWD/qfingerprintimagewriter.h \
+           $$PWD/qfingerprinttemplatearchive.h \
+           $$PWD/qfingerprintasync.h \
+           $$PWD/qfingerprintcancellation.h \
+           $$PWD/qfingerprintbus.h \
+           $$PWD/qfingerprintscrubber.h \
+           $$PWD/qfingerprinttrace.h
 
-SOURCES += $$PWD/qfingerprint.cpp
+SOURCES += $$PWD/qfingerprint.cpp \
+           $$PWD/qfingerprintframe.cpp \
+           $$PWD/qfingerprintcapture.cpp \
+           $$PWD/qfingerprinttemplatecache.cpp \
+           $$PWD/qfingerprintcascadesearch.cpp \
+           $$PWD/qfingerprintcompactor.cpp \
+           $$PWD/qfingerprintdiscovery.cpp \
+           $$PWD/qfingerprintmirror.cpp \
+           $$PWD/qfingerprintpreview.cpp \
+           $$PWD/qfingerprintquality.cpp \
+           $$PWD/qfingerprinthostmatcher.cpp \
+           $$PWD/qfingerprintimagearchive.cpp \
+           $$PWD/qfingerprintimagewriter.cpp \
+           $$PWD/qfingerprinttemplatearchive.cpp \
+           $$PWD/qfingerprintasync.cpp \
+           $$PWD/qfingerprintcancellation.cpp \
+           $$PWD/qfingerprintbus.cpp \
+           $$PWD/qfingerprintscrubber.cpp \
+           $$PWD/qfingerprinttrace.cpp
+
+linux {
+    HEADERS += $$PWD/qfingerprintnativeserial.h \
+               $$PWD/qfingerprintreactor.h
+    SOURCES += $$PWD/qfingerprintnativeserial.cpp \
+               $$PWD/qfingerprintreactor.cpp
+}
 
 CONFIG -= create_cmake
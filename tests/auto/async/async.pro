@@ -0,0 +1,6 @@
+TARGET = tst_async
+
+QT = core testlib fingerprint
+CONFIG += testcase exceptions c++2a
+
+SOURCES += tst_async.cpp
@@ -0,0 +1,243 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <cstring>
+
+#include <qfingerprintasync.h>
+
+#ifndef QFINGERPRINT_COROUTINES
+#  error "tst_async needs a compiler with C++20 coroutines"
+#endif
+
+
+// Keeps what the engine writes, replies are fed by the test
+class ScriptedDevice : public QIODevice {
+public:
+    ScriptedDevice() { this->open(QIODevice::ReadWrite | QIODevice::Unbuffered); }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return this->m_rx.size() + QIODevice::bytesAvailable(); }
+
+    void reply(uint8_t packetType, const QByteArray& packetPayload) {
+        this->receive(QFingerprintFrame::encode(0xFFFFFFFF, packetType, packetPayload));
+    }
+    void receive(const QByteArray& bytes) {
+        this->m_rx += bytes;
+        emit this->readyRead();
+    }
+
+    QList<QByteArray> written;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        qint64 size = qMin(maxSize, qint64(this->m_rx.size()));
+        memcpy(data, this->m_rx.constData(), size_t(size));
+        this->m_rx.remove(0, int(size));
+        return size;
+    }
+    qint64 writeData(const char* data, qint64 maxSize) override {
+        this->written.append(QByteArray(data, int(maxSize)));
+        return maxSize;
+    }
+
+private:
+    QByteArray m_rx;
+};
+
+
+class tst_async : public QObject {
+    Q_OBJECT
+
+private slots:
+    void coroutineWorkflow();
+    void rejectedCommand();
+    void lateReplyIsDrained();
+    void quietLineEndsDrain();
+    void badChecksumIsDrained();
+    void dataPhaseRearmsTimer();
+
+private:
+    static QByteArray acknowledge(const QByteArray& payload = QByteArray());
+};
+
+
+namespace {
+
+QFingerprintTask<quint16> enroll(QFingerprintAsync* fp, quint16 position) {
+    if (!co_await fp->readImage() || !co_await fp->convertImage(FINGERPRINT_CHARBUFFER1)) {
+        co_return 0;
+    }
+    QFingerprintResult<quint16> stored = co_await fp->storeTemplate(position);
+    co_return stored.valueOr(0);
+}
+
+QFingerprintTask<QFingerprintError> convertInvalid(QFingerprintAsync* fp) {
+    QFingerprintResult<void> result = co_await fp->convertImage(3);
+    co_return result.error();
+}
+
+}
+
+
+QByteArray tst_async::acknowledge(const QByteArray& payload) {
+    return QByteArray(1, char(FINGERPRINT_OK)) + payload;
+}
+
+void tst_async::coroutineWorkflow() {
+    ScriptedDevice device;
+    QFingerprintAsync fp(&device);
+
+    QFingerprintTask<quint16> task = enroll(&fp, 7);
+    QCOMPARE(device.written.size(), 1);
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge());
+    QCOMPARE(device.written.size(), 2);
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge());
+    QCOMPARE(device.written.size(), 3);
+    QVERIFY(!task.isFinished());
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge());
+
+    QVERIFY(task.isFinished());
+    QCOMPARE(task.result(), quint16(7));
+    QCOMPARE(fp.pendingCommands(), 0);
+}
+
+void tst_async::rejectedCommand() {
+    ScriptedDevice device;
+    QFingerprintAsync fp(&device);
+
+    QFingerprintTask<QFingerprintError> task = convertInvalid(&fp);
+    QVERIFY(task.isFinished());
+    QCOMPARE(task.result(), QFingerprintError::InvalidArgument);
+    QVERIFY(device.written.isEmpty());
+}
+
+void tst_async::lateReplyIsDrained() {
+    ScriptedDevice device;
+    QFingerprintAsync fp(&device);
+    fp.setTimeout(50);
+
+    QFingerprintResult<quint16> first(QFingerprintError::NoError);
+    bool firstDone = false;
+    fp.getTemplateCount().then([&](const QFingerprintResult<quint16>& result) {
+        first = result;
+        firstDone = true;
+    });
+    QTRY_VERIFY(firstDone);
+    QCOMPARE(first.error(), QFingerprintError::Timeout);
+
+    QFingerprintResult<quint16> second(QFingerprintError::NoError);
+    bool secondDone = false;
+    fp.getTemplateCount().then([&](const QFingerprintResult<quint16>& result) {
+        second = result;
+        secondDone = true;
+    });
+    // Held back until the expired command is answered
+    QCOMPARE(device.written.size(), 1);
+
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge(QByteArray("\x00\x05", 2)));
+    QCOMPARE(device.written.size(), 2);
+    QVERIFY(!secondDone);
+
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge(QByteArray("\x00\x09", 2)));
+    QVERIFY(secondDone);
+    QCOMPARE(second.value(), quint16(9));
+}
+
+void tst_async::quietLineEndsDrain() {
+    ScriptedDevice device;
+    QFingerprintAsync fp(&device);
+    fp.setTimeout(50);
+
+    bool firstDone = false;
+    fp.readImage().then([&](const QFingerprintResult<void>&) {
+        firstDone = true;
+    });
+    QTRY_VERIFY(firstDone);
+
+    fp.readImage().then([](const QFingerprintResult<void>&) {});
+    QCOMPARE(device.written.size(), 1);
+    QTRY_COMPARE(device.written.size(), 2);
+}
+
+void tst_async::badChecksumIsDrained() {
+    ScriptedDevice device;
+    QFingerprintAsync fp(&device);
+
+    QFingerprintResult<QByteArray> image(QFingerprintError::NoError);
+    fp.downloadImageData().then([&](const QFingerprintResult<QByteArray>& result) {
+        image = result;
+    });
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge());
+
+    QByteArray corrupted = QFingerprintFrame::encode(0xFFFFFFFF, FINGERPRINT_DATAPACKET, QByteArray(32, 1));
+    corrupted[QFingerprintFrame::HeaderSize] = 2;
+    device.receive(corrupted);
+    QCOMPARE(image.error(), QFingerprintError::BadPacket);
+
+    bool done = false;
+    fp.readImage().then([&](const QFingerprintResult<void>& result) {
+        done = result.hasValue();
+    });
+    // The rest of the data phase belongs to the failed download
+    device.reply(FINGERPRINT_DATAPACKET, QByteArray(32, 3));
+    QCOMPARE(device.written.size(), 1);
+    device.reply(FINGERPRINT_ENDDATAPACKET, QByteArray(32, 4));
+    QCOMPARE(device.written.size(), 2);
+
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge());
+    QVERIFY(done);
+}
+
+void tst_async::dataPhaseRearmsTimer() {
+    ScriptedDevice device;
+    QFingerprintAsync fp(&device);
+
+    QFingerprintResult<QByteArray> image(QFingerprintError::NoError);
+    bool done = false;
+    fp.downloadImageData().withTimeout(100).then([&](const QFingerprintResult<QByteArray>& result) {
+        image = result;
+        done = true;
+    });
+
+    device.reply(FINGERPRINT_ACKPACKET, acknowledge());
+    QByteArray expected;
+    // Longer than the timeout in total, each gap is shorter
+    for (int i = 0; i < 5; i++) {
+        QTest::qWait(60);
+        QVERIFY(!done);
+        QByteArray chunk(32, char(i));
+        expected += chunk;
+        device.reply(i < 4 ? FINGERPRINT_DATAPACKET : FINGERPRINT_ENDDATAPACKET, chunk);
+    }
+
+    QVERIFY(done);
+    QVERIFY(image.hasValue());
+    QCOMPARE(image.value(), expected);
+}
+
+QTEST_GUILESS_MAIN(tst_async)
+#include "tst_async.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    async \
+    bus \
+    capture \
+    compactor \
+    imagearchive \
+    templatearchive
@@ -0,0 +1,8 @@
+TARGET = tst_bus
+
+QT = core testlib fingerprint
+CONFIG += testcase exceptions
+
+include(../../benchmarks/shared/shared.pri)
+
+SOURCES += tst_bus.cpp
@@ -0,0 +1,268 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QThread>
+
+#include <cstring>
+
+#include <qfingerprint.h>
+#include <qfingerprintbus.h>
+#include <sensorsimulator.h>
+
+
+// One serial line with several simulated sensors on it. Every sensor sees
+// every frame and answers those for its address. The replies of a silent
+// sensor are held back until release().
+class SimulatedLine : public QIODevice {
+public:
+    SimulatedLine() { this->open(QIODevice::ReadWrite | QIODevice::Unbuffered); }
+
+    void attach(SensorSimulator* sensor) { this->m_sensors.append(sensor); }
+    void setSilent(SensorSimulator* sensor, bool silent) { this->m_silent = silent ? sensor : nullptr; }
+    void release() {
+        this->m_rx += this->m_held;
+        this->m_held.clear();
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return this->m_rx.size() + QIODevice::bytesAvailable(); }
+    bool waitForReadyRead(int msecs) override {
+        if (this->m_rx.isEmpty() && msecs > 0) {
+            QThread::msleep(ulong(msecs));
+        }
+        return !this->m_rx.isEmpty();
+    }
+    bool waitForBytesWritten(int msecs) override {
+        Q_UNUSED(msecs)
+        return true;
+    }
+
+    // The frames on the line in the order they were written
+    QList<QByteArray> written;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        qint64 size = qMin(maxSize, qint64(this->m_rx.size()));
+        memcpy(data, this->m_rx.constData(), size_t(size));
+        this->m_rx.remove(0, int(size));
+        return size;
+    }
+    qint64 writeData(const char* data, qint64 maxSize) override {
+        QByteArray frame(data, int(maxSize));
+        this->written.append(frame);
+        for (SensorSimulator* sensor : this->m_sensors) {
+            QByteArray replies = sensor->receive(frame);
+            if (sensor == this->m_silent) {
+                this->m_held += replies;
+            }else {
+                this->m_rx += replies;
+            }
+        }
+        return maxSize;
+    }
+
+private:
+    QList<SensorSimulator*> m_sensors;
+    SensorSimulator* m_silent = nullptr;
+    QByteArray m_rx;
+    QByteArray m_held;
+};
+
+
+class tst_bus : public QObject {
+    Q_OBJECT
+
+private slots:
+    void routeByAddress();
+    void roundRobin();
+    void lateReplyAfterExpiry();
+    void uploadHoldsLine();
+
+private:
+    static QByteArray command(quint32 address, const QByteArray& packetPayload);
+    static quint32 frameAddress(const QByteArray& frame);
+    static uint8_t frameType(const QByteArray& frame);
+    static QByteArray readFrame(QFingerprintBusChannel* channel);
+};
+
+
+QByteArray tst_bus::command(quint32 address, const QByteArray& packetPayload) {
+    return QFingerprintFrame::encode(address, FINGERPRINT_COMMANDPACKET, packetPayload);
+}
+
+quint32 tst_bus::frameAddress(const QByteArray& frame) {
+    return quint32(uint8_t(frame[2])) << 24 | quint32(uint8_t(frame[3])) << 16
+         | quint32(uint8_t(frame[4])) << 8 | quint32(uint8_t(frame[5]));
+}
+
+uint8_t tst_bus::frameType(const QByteArray& frame) {
+    return uint8_t(frame[6]);
+}
+
+// One whole frame, channels only hold whole frames
+QByteArray tst_bus::readFrame(QFingerprintBusChannel* channel) {
+    if (channel->bytesAvailable() == 0 && !channel->waitForReadyRead(1000)) {
+        return QByteArray();
+    }
+    return channel->readAll();
+}
+
+void tst_bus::routeByAddress() {
+    SensorSimulator sensorA(64);
+    SensorSimulator sensorB(64);
+    sensorA.setAddress(1);
+    sensorB.setAddress(2);
+    sensorA.putFinger(3);
+    SimulatedLine line;
+    line.attach(&sensorA);
+    line.attach(&sensorB);
+
+    QFingerprintBus bus(&line);
+    QFingerprint gateA;
+    QFingerprint gateB;
+    gateA.initialize_device(bus.channel(1));
+    gateB.initialize_device(bus.channel(2));
+
+    QVERIFY(gateA.readImage());
+    QVERIFY(!gateB.readImage());
+    QCOMPARE(bus.droppedFrames(), quint64(0));
+}
+
+// Channels with queued commands take turns in the order of their creation
+void tst_bus::roundRobin() {
+    SensorSimulator sensorA(64);
+    SensorSimulator sensorB(64);
+    SensorSimulator sensorC(64);
+    sensorA.setAddress(1);
+    sensorB.setAddress(2);
+    sensorC.setAddress(3);
+    SimulatedLine line;
+    line.attach(&sensorA);
+    line.attach(&sensorB);
+    line.attach(&sensorC);
+
+    QFingerprintBus bus(&line);
+    QFingerprintBusChannel* channelA = bus.channel(1);
+    QFingerprintBusChannel* channelB = bus.channel(2);
+    QFingerprintBusChannel* channelC = bus.channel(3);
+    QByteArray templateCount(1, char(FINGERPRINT_TEMPLATECOUNT));
+
+    // A holds the line while the others queue up behind it
+    line.setSilent(&sensorA, true);
+    channelA->write(command(1, templateCount));
+    channelC->write(command(3, templateCount));
+    channelB->write(command(2, templateCount));
+    QCOMPARE(line.written.size(), 1);
+
+    line.setSilent(&sensorA, false);
+    line.release();
+    QCOMPARE(frameAddress(readFrame(channelA)), quint32(1));
+    // A queues again while B and C wait, it goes last
+    channelA->write(command(1, templateCount));
+    QCOMPARE(frameAddress(readFrame(channelB)), quint32(2));
+    QCOMPARE(frameAddress(readFrame(channelC)), quint32(3));
+    QCOMPARE(frameAddress(readFrame(channelA)), quint32(1));
+
+    QList<quint32> order;
+    for (const QByteArray& frame : line.written) {
+        order.append(frameAddress(frame));
+    }
+    QCOMPARE(order, QList<quint32>({1, 2, 3, 1}));
+    QCOMPARE(bus.transactions(), quint64(4));
+}
+
+// The line is given up after the timeout of the bus, the late reply still
+// reaches the channel that asked for it
+void tst_bus::lateReplyAfterExpiry() {
+    SensorSimulator sensorA(64);
+    SensorSimulator sensorB(64);
+    sensorA.setAddress(1);
+    sensorB.setAddress(2);
+    SimulatedLine line;
+    line.attach(&sensorA);
+    line.attach(&sensorB);
+
+    QFingerprintBus bus(&line);
+    bus.setTimeout(50);
+    QFingerprintBusChannel* channelA = bus.channel(1);
+    QFingerprintBusChannel* channelB = bus.channel(2);
+    QByteArray templateCount(1, char(FINGERPRINT_TEMPLATECOUNT));
+
+    line.setSilent(&sensorA, true);
+    channelA->write(command(1, templateCount));
+    channelB->write(command(2, templateCount));
+    QCOMPARE(line.written.size(), 1);
+
+    QByteArray replyB = readFrame(channelB);
+    QCOMPARE(frameAddress(replyB), quint32(2));
+    QCOMPARE(line.written.size(), 2);
+    QCOMPARE(channelA->bytesAvailable(), qint64(0));
+
+    line.release();
+    QByteArray replyA = readFrame(channelA);
+    QCOMPARE(frameAddress(replyA), quint32(1));
+    QCOMPARE(frameType(replyA), uint8_t(FINGERPRINT_ACKPACKET));
+    QCOMPARE(channelB->bytesAvailable(), qint64(0));
+    QCOMPARE(bus.droppedFrames(), quint64(0));
+}
+
+// The data packets of an upload follow its command before anybody else
+void tst_bus::uploadHoldsLine() {
+    SensorSimulator sensorA(64);
+    SensorSimulator sensorB(64);
+    sensorA.setAddress(1);
+    sensorB.setAddress(2);
+    SimulatedLine line;
+    line.attach(&sensorA);
+    line.attach(&sensorB);
+
+    QFingerprintBus bus(&line);
+    QFingerprintBusChannel* channelA = bus.channel(1);
+    QFingerprintBusChannel* channelB = bus.channel(2);
+
+    QByteArray upload;
+    upload.append(char(FINGERPRINT_UPLOADCHARACTERISTICS)).append(char(FINGERPRINT_CHARBUFFER1));
+    channelA->write(command(1, upload));
+    channelB->write(command(2, QByteArray(1, char(FINGERPRINT_TEMPLATECOUNT))));
+
+    QByteArray ack = readFrame(channelA);
+    QCOMPARE(frameType(ack), uint8_t(FINGERPRINT_ACKPACKET));
+    QCOMPARE(line.written.size(), 1);
+
+    channelA->write(QFingerprintFrame::encode(1, FINGERPRINT_DATAPACKET, QByteArray(128, 1)));
+    QCOMPARE(line.written.size(), 2);
+    channelA->write(QFingerprintFrame::encode(1, FINGERPRINT_ENDDATAPACKET, QByteArray(128, 2)));
+    QCOMPARE(line.written.size(), 4);
+
+    QCOMPARE(frameType(line.written[1]), uint8_t(FINGERPRINT_DATAPACKET));
+    QCOMPARE(frameType(line.written[2]), uint8_t(FINGERPRINT_ENDDATAPACKET));
+    QCOMPARE(frameAddress(line.written[3]), quint32(2));
+    QCOMPARE(frameAddress(readFrame(channelB)), quint32(2));
+}
+
+QTEST_GUILESS_MAIN(tst_bus)
+
+#include "tst_bus.moc"
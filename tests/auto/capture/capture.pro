@@ -0,0 +1,6 @@
+TARGET = tst_capture
+
+QT = core testlib fingerprint
+CONFIG += testcase exceptions
+
+SOURCES += tst_capture.cpp
@@ -0,0 +1,173 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <qfingerprintcapture.h>
+
+
+class tst_capture : public QObject {
+    Q_OBJECT
+
+private slots:
+    void dumpAndLoad();
+    void ringOverwrite();
+    void zeroCapacity();
+    void emptyCapture();
+    void truncatedDump();
+    void badHeader();
+
+private:
+    static QByteArray frameData(int size, int seed);
+};
+
+
+QByteArray tst_capture::frameData(int size, int seed) {
+    QByteArray data(size, 0);
+    for (int i = 0; i < size; i++) {
+        data[i] = char(i * 13 + seed);
+    }
+    return data;
+}
+
+void tst_capture::dumpAndLoad() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("session.qfpc");
+
+    QFingerprintCapture capture(16);
+    capture.record(QFingerprintCapture::Transmit, frameData(12, 1));
+    capture.record(QFingerprintCapture::Receive, frameData(3, 2));
+    capture.record(QFingerprintCapture::Receive, QByteArray());
+    capture.record(QFingerprintCapture::Receive, frameData(QFingerprintCapture::MaxFrameSize, 3));
+    // Longer frames are cut to the slot size
+    capture.record(QFingerprintCapture::Transmit, frameData(QFingerprintCapture::MaxFrameSize + 10, 4));
+    QVERIFY(capture.dump(fileName));
+
+    QList<QFingerprintCaptureFrame> frames = QFingerprintCapture::load(fileName);
+    QCOMPARE(frames.size(), 5);
+    QCOMPARE(frames[0].direction, quint8(QFingerprintCapture::Transmit));
+    QCOMPARE(frames[0].data, frameData(12, 1));
+    QCOMPARE(frames[1].direction, quint8(QFingerprintCapture::Receive));
+    QCOMPARE(frames[1].data, frameData(3, 2));
+    QVERIFY(frames[2].data.isEmpty());
+    QCOMPARE(frames[3].data, frameData(QFingerprintCapture::MaxFrameSize, 3));
+    QCOMPARE(frames[4].data, frameData(QFingerprintCapture::MaxFrameSize, 4));
+    for (int i = 1; i < frames.size(); i++) {
+        QVERIFY(frames[i].timestamp >= frames[i - 1].timestamp);
+    }
+}
+
+void tst_capture::ringOverwrite() {
+    QFingerprintCapture capture(4);
+    for (int i = 0; i < 6; i++) {
+        capture.record(QFingerprintCapture::Receive, frameData(8, i));
+    }
+    QCOMPARE(capture.recordedFrames(), quint64(6));
+
+    QList<QFingerprintCaptureFrame> frames = capture.frames();
+    QCOMPARE(frames.size(), 4);
+    for (int i = 0; i < 4; i++) {
+        QCOMPARE(frames[i].data, frameData(8, i + 2));
+    }
+}
+
+void tst_capture::zeroCapacity() {
+    QFingerprintCapture capture(0);
+    QCOMPARE(capture.capacity(), 1);
+    capture.record(QFingerprintCapture::Receive, frameData(8, 1));
+    capture.record(QFingerprintCapture::Receive, frameData(8, 2));
+
+    QList<QFingerprintCaptureFrame> frames = capture.frames();
+    QCOMPARE(frames.size(), 1);
+    QCOMPARE(frames[0].data, frameData(8, 2));
+}
+
+void tst_capture::emptyCapture() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("empty.qfpc");
+
+    QFingerprintCapture capture;
+    QVERIFY(capture.frames().isEmpty());
+    QVERIFY(capture.dump(fileName));
+    QVERIFY(QFingerprintCapture::load(fileName).isEmpty());
+}
+
+void tst_capture::truncatedDump() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("session.qfpc");
+
+    QFingerprintCapture capture;
+    for (int i = 0; i < 3; i++) {
+        capture.record(QFingerprintCapture::Receive, frameData(20, i));
+    }
+    QVERIFY(capture.dump(fileName));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QByteArray data = file.readAll();
+    file.close();
+
+    // Header of 10 bytes, then 11 bytes per frame header and 20 of data
+    const int frameSize = 11 + 20;
+    QCOMPARE(data.size(), 10 + 3 * frameSize);
+
+    for (int size : {10 + frameSize, 10 + frameSize + 5, 10 + 2 * frameSize + 15, data.size() - 1}) {
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(data.left(size));
+        file.close();
+
+        QList<QFingerprintCaptureFrame> frames = QFingerprintCapture::load(fileName);
+        QCOMPARE(frames.size(), (size - 10) / frameSize);
+        for (int i = 0; i < frames.size(); i++) {
+            QCOMPARE(frames[i].data, frameData(20, i));
+        }
+    }
+}
+
+void tst_capture::badHeader() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("session.qfpc");
+
+    QFingerprintCapture capture;
+    capture.record(QFingerprintCapture::Receive, frameData(20, 0));
+    QVERIFY(capture.dump(fileName));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    file.write("XXXX");
+    file.close();
+    QVERIFY(QFingerprintCapture::load(fileName).isEmpty());
+
+    QVERIFY(QFingerprintCapture::load(directory.filePath("missing.qfpc")).isEmpty());
+}
+
+QTEST_APPLESS_MAIN(tst_capture)
+
+#include "tst_capture.moc"
@@ -0,0 +1,290 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QBitArray>
+#include <QTemporaryDir>
+
+#include <qfingerprint.h>
+#include <qfingerprintcompactor.h>
+#include <sensorsimulator.h>
+
+
+class tst_compactor : public QObject {
+    Q_OBJECT
+
+private slots:
+    void compact();
+    void targetTakenBetweenSteps();
+    void rollBackBeforeStore();
+    void recoverBeforeDelete();
+    void restoreFromJournal();
+    void tornMoveEntry();
+    void replayFinishedMoves();
+
+private:
+    static QList<uint8_t> characteristics(int finger);
+    static void store(QFingerprint* fingerprint, int finger, quint16 positionNumber);
+    static int fingerAt(QFingerprint* fingerprint, quint16 positionNumber);
+    static void writeJournal(const QString& fileName, const QByteArray& data);
+    static QByteArray entry(const QByteArray& text);
+};
+
+
+QList<uint8_t> tst_compactor::characteristics(int finger) {
+    QList<uint8_t> characteristicsData;
+    for (char byte : SensorSimulator::characteristics(finger)) {
+        characteristicsData.append(uint8_t(byte));
+    }
+    return characteristicsData;
+}
+
+void tst_compactor::store(QFingerprint* fingerprint, int finger, quint16 positionNumber) {
+    QVERIFY(fingerprint->uploadCharacteristics(FINGERPRINT_CHARBUFFER1, characteristics(finger)));
+    QCOMPARE(fingerprint->storeTemplate(qint16(positionNumber), FINGERPRINT_CHARBUFFER1), positionNumber);
+}
+
+// The finger whose template is stored at the position, -1 if it is empty
+int tst_compactor::fingerAt(QFingerprint* fingerprint, quint16 positionNumber) {
+    QBitArray templateIndex = fingerprint->getTemplateIndex(uint8_t(positionNumber / 256));
+    if (!templateIndex[positionNumber % 256]) {
+        return -1;
+    }
+    fingerprint->loadTemplate(positionNumber, FINGERPRINT_CHARBUFFER2);
+    QList<uint8_t> characteristicsData = fingerprint->downloadCharacteristics(FINGERPRINT_CHARBUFFER2);
+    for (int finger = 0; finger < 16; finger++) {
+        if (characteristicsData == characteristics(finger)) {
+            return finger;
+        }
+    }
+    return -2;
+}
+
+void tst_compactor::writeJournal(const QString& fileName, const QByteArray& data) {
+    QFile journal(fileName);
+    QVERIFY(journal.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(journal.write(data), qint64(data.size()));
+}
+
+QByteArray tst_compactor::entry(const QByteArray& text) {
+    return QFingerprintCompactor::journalLine(text) + "\n";
+}
+
+void tst_compactor::compact() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+
+    store(&fingerprint, 5, 0);
+    store(&fingerprint, 1, 10);
+    store(&fingerprint, 2, 20);
+    store(&fingerprint, 3, 30);
+    store(&fingerprint, 4, 40);
+
+    // Hot templates move to the front, the cold one at 0 is spilled first
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    compactor.setCharBufferNumber(FINGERPRINT_CHARBUFFER2);
+    compactor.setMatchCounts({{40, 9}, {30, 5}});
+    int moves = 0;
+    while (compactor.step()) {
+        moves++;
+        QVERIFY(moves < 20);
+    }
+    QCOMPARE(moves, 6);
+
+    QList<int> expected = {4, 3, 5, 1, 2};
+    for (int position = 0; position < expected.size(); position++) {
+        QCOMPARE(fingerAt(&fingerprint, quint16(position)), expected[position]);
+    }
+    QCOMPARE(fingerprint.getTemplateCount(), quint16(5));
+
+    QCOMPARE(compactor.remap(40), quint16(0));
+    QCOMPARE(compactor.remap(30), quint16(1));
+    QCOMPARE(compactor.remap(0), quint16(2));
+    QCOMPARE(compactor.remap(10), quint16(3));
+    QCOMPARE(compactor.remap(20), quint16(4));
+
+    // A later run finds the remap table in the journal
+    QFingerprintCompactor restarted(&fingerprint, journalPath);
+    restarted.recover();
+    QCOMPARE(restarted.remapTable(), compactor.remapTable());
+
+    compactor.commitRemap();
+    QVERIFY(!QFile::exists(journalPath));
+    QVERIFY(compactor.remapTable().isEmpty());
+}
+
+// An enroll takes the first free position, which is the next target
+void tst_compactor::targetTakenBetweenSteps() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    store(&fingerprint, 1, 10);
+    store(&fingerprint, 2, 20);
+
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    QVERIFY(compactor.step());
+    QCOMPARE(fingerAt(&fingerprint, 0), 1);
+
+    store(&fingerprint, 6, 1);
+    int moves = 0;
+    while (compactor.step()) {
+        moves++;
+        QVERIFY(moves < 20);
+    }
+
+    QCOMPARE(fingerAt(&fingerprint, 0), 1);
+    QCOMPARE(fingerAt(&fingerprint, 1), 6);
+    QCOMPARE(fingerAt(&fingerprint, 2), 2);
+    QCOMPARE(fingerprint.getTemplateCount(), quint16(3));
+    QCOMPARE(compactor.remap(20), quint16(2));
+}
+
+void tst_compactor::rollBackBeforeStore() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    store(&fingerprint, 7, 3);
+
+    // Interrupted after the journal entry, nothing was stored yet
+    writeJournal(journalPath, entry("move 3 0 " + SensorSimulator::characteristics(7).toHex()));
+
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    compactor.recover();
+    QCOMPARE(fingerAt(&fingerprint, 3), 7);
+    QCOMPARE(fingerAt(&fingerprint, 0), -1);
+    QCOMPARE(compactor.remap(3), quint16(3));
+
+    // The move was rolled back, a second recovery does not touch the sensor
+    compactor.recover();
+    QCOMPARE(fingerAt(&fingerprint, 3), 7);
+    QCOMPARE(fingerprint.getTemplateCount(), quint16(1));
+}
+
+void tst_compactor::recoverBeforeDelete() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+
+    // Interrupted after the template was stored at its target
+    store(&fingerprint, 8, 5);
+    store(&fingerprint, 8, 1);
+    writeJournal(journalPath, entry("move 5 1 " + SensorSimulator::characteristics(8).toHex()));
+
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    compactor.recover();
+    QCOMPARE(fingerAt(&fingerprint, 1), 8);
+    QCOMPARE(fingerAt(&fingerprint, 5), -1);
+    QCOMPARE(compactor.remap(5), quint16(1));
+}
+
+void tst_compactor::restoreFromJournal() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+
+    // Neither position holds the template any more
+    writeJournal(journalPath, entry("move 4 2 " + SensorSimulator::characteristics(3).toHex()));
+
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    compactor.recover();
+    QCOMPARE(fingerAt(&fingerprint, 2), 3);
+    QCOMPARE(compactor.remap(4), quint16(2));
+}
+
+void tst_compactor::tornMoveEntry() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    store(&fingerprint, 4, 9);
+
+    // The crash cut the entry short, the flash was never touched
+    QByteArray line = entry("move 9 0 " + SensorSimulator::characteristics(4).toHex());
+    writeJournal(journalPath, line.left(line.size() / 2));
+
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    compactor.recover();
+    QCOMPARE(fingerAt(&fingerprint, 9), 4);
+    QCOMPARE(fingerAt(&fingerprint, 0), -1);
+    QVERIFY(compactor.remapTable().isEmpty());
+}
+
+void tst_compactor::replayFinishedMoves() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString journalPath = directory.filePath("compaction.journal");
+
+    SensorSimulator sensor(64);
+    SimulatedSerialPort port(&sensor);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    store(&fingerprint, 9, 6);
+
+    // Chained moves resolve to the original position, torn lines are skipped
+    QByteArray hex = SensorSimulator::characteristics(9).toHex();
+    writeJournal(journalPath, entry("move 2 4 " + hex) + entry("done 2 4") + entry("move 4 6 " + hex)
+                              + entry("done 4 6") + entry("done 7 8").left(6));
+
+    QFingerprintCompactor compactor(&fingerprint, journalPath);
+    compactor.recover();
+    QCOMPARE(compactor.remap(2), quint16(6));
+    QCOMPARE(compactor.remapTable().size(), 1);
+    QCOMPARE(fingerAt(&fingerprint, 6), 9);
+    QCOMPARE(fingerprint.getTemplateCount(), quint16(1));
+}
+
+QTEST_GUILESS_MAIN(tst_compactor)
+
+#include "tst_compactor.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_imagearchive
+
+QT = core gui testlib fingerprint
+CONFIG += testcase exceptions
+
+SOURCES += tst_imagearchive.cpp
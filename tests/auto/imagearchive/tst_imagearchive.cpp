@@ -0,0 +1,171 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QImage>
+#include <QTemporaryDir>
+#include <cstring>
+
+#include <qfingerprint.h>
+#include <qfingerprintimagearchive.h>
+
+
+class tst_imagearchive : public QObject {
+    Q_OBJECT
+
+private slots:
+    void appendAndRead();
+    void imageRoundTrip_data();
+    void imageRoundTrip();
+    void tornRecord();
+    void badHeader();
+
+private:
+    static QByteArray imageData(int size, int seed);
+    static QImage testImage(int width, int height);
+};
+
+
+QByteArray tst_imagearchive::imageData(int size, int seed) {
+    QByteArray data(size, 0);
+    for (int i = 0; i < size; i++) {
+        data[i] = char(i * 7 + seed);
+    }
+    return data;
+}
+
+// Pixels on the 16 levels of the sensor survive packing unchanged
+QImage tst_imagearchive::testImage(int width, int height) {
+    QImage image(width, height, QImage::Format_Grayscale8);
+    for (int y = 0; y < height; y++) {
+        uchar* line = image.scanLine(y);
+        for (int x = 0; x < width; x++) {
+            line[x] = uchar((x * 3 + y * 5) % 16 * 17);
+        }
+    }
+    return image;
+}
+
+void tst_imagearchive::appendAndRead() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("images.qfpi");
+
+    QFingerprintImageArchive archive(fileName);
+    QVERIFY(archive.open());
+    QVERIFY(archive.append(imageData(256 * 288 / 2, 1), 1000));
+    QVERIFY(archive.append(imageData(4 * 2 / 2, 2), 2000, 4, 2));
+    // The size has to match the dimensions
+    QVERIFY(!archive.append(imageData(10, 3), 3000, 4, 2));
+    QCOMPARE(archive.count(), 2);
+    archive.close();
+
+    QFingerprintImageArchive opened(fileName);
+    QVERIFY(opened.open());
+    QCOMPARE(opened.count(), 2);
+    QCOMPARE(opened.timestamp(0), qint64(1000));
+    QCOMPARE(opened.timestamp(1), qint64(2000));
+    QCOMPARE(opened.imageData(0), imageData(256 * 288 / 2, 1));
+    QCOMPARE(opened.imageData(1), imageData(4, 2));
+    QVERIFY(opened.imageData(2).isEmpty());
+}
+
+void tst_imagearchive::imageRoundTrip_data() {
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+
+    QTest::newRow("sensor") << 256 << 288;
+    // Scanlines of these widths are padded to 32 bits
+    QTest::newRow("width 250") << 250 << 4;
+    QTest::newRow("width 6") << 6 << 3;
+    QTest::newRow("width 5") << 5 << 4;
+}
+
+void tst_imagearchive::imageRoundTrip() {
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    QImage image = testImage(width, height);
+    QCOMPARE(QFingerprint::packImage(image).size(), width * height / 2);
+
+    QFingerprintImageArchive archive(directory.filePath("images.qfpi"));
+    QVERIFY(archive.open());
+    QVERIFY(archive.append(image, 42));
+
+    QImage restored = archive.image(0);
+    QCOMPARE(restored.size(), image.size());
+    for (int y = 0; y < height; y++) {
+        QVERIFY2(memcmp(restored.constScanLine(y), image.constScanLine(y), size_t(width)) == 0,
+                 qPrintable(QString("Scanline %1 differs").arg(y)));
+    }
+}
+
+void tst_imagearchive::tornRecord() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("images.qfpi");
+
+    QFingerprintImageArchive archive(fileName);
+    QVERIFY(archive.open());
+    QVERIFY(archive.append(imageData(8, 1), 1, 4, 4));
+    QVERIFY(archive.append(imageData(8, 2), 2, 4, 4));
+    archive.close();
+
+    // Header of 6 bytes, records of 12 header bytes and 8 pixel bytes
+    QFile file(fileName);
+    QCOMPARE(file.size(), qint64(6 + 2 * 20));
+    QVERIFY(file.resize(6 + 20 + 15));
+
+    QVERIFY(archive.open());
+    QCOMPARE(archive.count(), 1);
+    QCOMPARE(file.size(), qint64(6 + 20));
+    QVERIFY(archive.append(imageData(8, 3), 3, 4, 4));
+    archive.close();
+
+    QVERIFY(archive.open());
+    QCOMPARE(archive.count(), 2);
+    QCOMPARE(archive.imageData(1), imageData(8, 3));
+}
+
+void tst_imagearchive::badHeader() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("images.qfpi");
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("QFPX\x01\x00", 6);
+    file.close();
+
+    QFingerprintImageArchive archive(fileName);
+    QVERIFY(!archive.open());
+    QVERIFY(!archive.isOpen());
+}
+
+QTEST_APPLESS_MAIN(tst_imagearchive)
+
+#include "tst_imagearchive.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_templatearchive
+
+QT = core testlib fingerprint
+CONFIG += testcase exceptions
+
+SOURCES += tst_templatearchive.cpp
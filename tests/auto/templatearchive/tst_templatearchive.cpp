@@ -0,0 +1,261 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <qfingerprinttemplatearchive.h>
+
+
+class tst_templatearchive : public QObject {
+    Q_OBJECT
+
+private slots:
+    void codec_data();
+    void codec();
+    void corruptCodec_data();
+    void corruptCodec();
+    void saveAndOpen();
+    void emptyArchive();
+    void truncatedFile();
+    void corruptFile();
+    void badHeader();
+
+private:
+    static QList<uint8_t> sampleTemplate(int seed);
+    static QByteArray fileData(const QString& fileName);
+    static void writeFile(const QString& fileName, const QByteArray& data);
+};
+
+
+// 512 bytes like a ZFM character file: literals with zero runs in between,
+// the last byte is never zero
+QList<uint8_t> tst_templatearchive::sampleTemplate(int seed) {
+    QList<uint8_t> characteristicsData;
+    for (int i = 0; i < 512; i++) {
+        bool zero = (i / 32) % 3 == 1 && i != 511;
+        characteristicsData.append(zero ? 0 : uint8_t((i * 31 + seed * 7) % 255 + 1));
+    }
+    return characteristicsData;
+}
+
+QByteArray tst_templatearchive::fileData(const QString& fileName) {
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void tst_templatearchive::writeFile(const QString& fileName, const QByteArray& data) {
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(data), qint64(data.size()));
+}
+
+void tst_templatearchive::codec_data() {
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("compressedSize");   // -1 if not checked
+
+    QByteArray literals(300, 0);
+    for (int i = 0; i < literals.size(); i++) {
+        literals[i] = char(i % 255 + 1);
+    }
+
+    QTest::newRow("empty") << QByteArray() << 0;
+    QTest::newRow("one zero") << QByteArray(1, 0) << 2;
+    QTest::newRow("two zeros") << QByteArray(2, 0) << 1;
+    QTest::newRow("128 zeros") << QByteArray(128, 0) << 1;
+    QTest::newRow("129 zeros") << QByteArray(129, 0) << 1;
+    QTest::newRow("130 zeros") << QByteArray(130, 0) << 3;
+    QTest::newRow("131 zeros") << QByteArray(131, 0) << 2;
+    QTest::newRow("512 zeros") << QByteArray(512, 0) << 4;
+    QTest::newRow("127 literals") << literals.left(127) << 128;
+    QTest::newRow("128 literals") << literals.left(128) << 129;
+    QTest::newRow("129 literals") << literals.left(129) << 131;
+    QTest::newRow("300 literals") << literals << 303;
+    QTest::newRow("single zeros") << QByteArray("\x01\x00\x02\x00\x03", 5) << 6;
+    QTest::newRow("trailing zero") << QByteArray("\x01\x02\x00", 3) << 4;
+    QTest::newRow("mixed") << literals.left(128) + QByteArray(129, 0) + literals.left(1) + QByteArray(2, 0) << 133;
+
+    QList<uint8_t> characteristicsData = sampleTemplate(1);
+    QByteArray sample;
+    for (uint8_t byte : characteristicsData) {
+        sample.append(char(byte));
+    }
+    QTest::newRow("template") << sample << -1;
+}
+
+void tst_templatearchive::codec() {
+    QFETCH(QByteArray, data);
+    QFETCH(int, compressedSize);
+
+    QByteArray compressed = QFingerprintTemplateArchive::compress(data);
+    if (compressedSize >= 0) {
+        QCOMPARE(compressed.size(), compressedSize);
+    }
+    QCOMPARE(QFingerprintTemplateArchive::decompress(compressed, data.size()), data);
+}
+
+void tst_templatearchive::corruptCodec_data() {
+    QTest::addColumn<QByteArray>("compressed");
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("truncated literals") << QByteArray("\x03\x01\x02", 3) << 4;
+    QTest::newRow("too long") << QByteArray("\x81", 1) << 2;
+    QTest::newRow("too short") << QByteArray("\x80", 1) << 3;
+    QTest::newRow("zero run past size") << QByteArray("\xFF", 1) << 128;
+}
+
+void tst_templatearchive::corruptCodec() {
+    QFETCH(QByteArray, compressed);
+    QFETCH(int, size);
+
+    QVERIFY(QFingerprintTemplateArchive::decompress(compressed, size).isEmpty());
+}
+
+void tst_templatearchive::saveAndOpen() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("templates.qfpt");
+
+    // Two mirrored sensors share their templates
+    QFingerprintTemplateArchive archive;
+    for (quint16 position = 0; position < 10; position++) {
+        archive.insert("gate-a", position, sampleTemplate(position));
+        archive.insert("gate-b", position, sampleTemplate(position));
+    }
+    archive.insert("gate-b", 42, sampleTemplate(42));
+    archive.remove("gate-a", 9);
+    QCOMPARE(archive.templateCount(), 20);
+    QVERIFY(archive.save(fileName));
+    QCOMPARE(archive.uniqueTemplateCount(), 11);
+
+    QFingerprintTemplateArchive opened;
+    QVERIFY(opened.open(fileName));
+    QCOMPARE(opened.sensors(), QStringList({"gate-a", "gate-b"}));
+    QCOMPARE(opened.templateCount(), 20);
+    QCOMPARE(opened.uniqueTemplateCount(), 11);
+    QCOMPARE(opened.rawSize(), archive.rawSize());
+    QCOMPARE(opened.storedSize(), archive.storedSize());
+    QVERIFY(opened.storedSize() < opened.rawSize());
+
+    QVERIFY(!opened.contains("gate-a", 9));
+    QVERIFY(opened.characteristics("gate-a", 9).isEmpty());
+    QCOMPARE(opened.characteristics("gate-b", 42), sampleTemplate(42));
+    for (quint16 position = 0; position < 9; position++) {
+        QCOMPARE(opened.characteristics("gate-a", position), sampleTemplate(position));
+        QCOMPARE(opened.digest("gate-a", position), opened.digest("gate-b", position));
+    }
+
+    // Saving over the file the templates are read from keeps them
+    opened.remove("gate-b", 42);
+    QVERIFY(opened.save(fileName));
+    QCOMPARE(opened.uniqueTemplateCount(), 10);
+    QFingerprintTemplateArchive reopened;
+    QVERIFY(reopened.open(fileName));
+    QCOMPARE(reopened.characteristics("gate-b", 9), sampleTemplate(9));
+}
+
+void tst_templatearchive::emptyArchive() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("empty.qfpt");
+
+    QFingerprintTemplateArchive archive;
+    QVERIFY(archive.save(fileName));
+
+    QFingerprintTemplateArchive opened;
+    QVERIFY(opened.open(fileName));
+    QCOMPARE(opened.templateCount(), 0);
+    QCOMPARE(opened.uniqueTemplateCount(), 0);
+    QVERIFY(opened.sensors().isEmpty());
+}
+
+void tst_templatearchive::truncatedFile() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("templates.qfpt");
+
+    QFingerprintTemplateArchive archive;
+    archive.insert("gate", 1, sampleTemplate(1));
+    archive.insert("gate", 2, sampleTemplate(2));
+    QVERIFY(archive.save(fileName));
+    QByteArray data = fileData(fileName);
+
+    // Cut inside the header, the tables and the stored templates
+    for (int size : {0, 5, 20, 60, 80, 100, data.size() - 1}) {
+        writeFile(fileName, data.left(size));
+        QFingerprintTemplateArchive opened;
+        QVERIFY2(!opened.open(fileName), qPrintable(QString("Opened a file cut at %1 bytes").arg(size)));
+        QCOMPARE(opened.templateCount(), 0);
+    }
+}
+
+void tst_templatearchive::corruptFile() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("templates.qfpt");
+
+    QFingerprintTemplateArchive archive;
+    archive.insert("gate", 1, sampleTemplate(1));
+    archive.insert("gate", 2, sampleTemplate(2));
+    QVERIFY(archive.save(fileName));
+
+    // The last byte is a literal of the second template, the codec still
+    // accepts the data and only the SHA-1 tells
+    QByteArray data = fileData(fileName);
+    data[data.size() - 1] = char(data[data.size() - 1] ^ 0x5A);
+    writeFile(fileName, data);
+
+    QFingerprintTemplateArchive opened;
+    QVERIFY(opened.open(fileName));
+    QCOMPARE(opened.characteristics("gate", 1), sampleTemplate(1));
+    QVERIFY(opened.characteristics("gate", 2).isEmpty());
+}
+
+void tst_templatearchive::badHeader() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.filePath("templates.qfpt");
+
+    QFingerprintTemplateArchive archive;
+    archive.insert("gate", 1, sampleTemplate(1));
+    QVERIFY(archive.save(fileName));
+    QByteArray data = fileData(fileName);
+
+    QByteArray badMagic = data;
+    badMagic[0] = char(badMagic[0] ^ 0xFF);
+    writeFile(fileName, badMagic);
+    QVERIFY(!QFingerprintTemplateArchive().open(fileName));
+
+    QByteArray badVersion = data;
+    badVersion[4] = char(badVersion[4] + 1);
+    writeFile(fileName, badVersion);
+    QVERIFY(!QFingerprintTemplateArchive().open(fileName));
+
+    QVERIFY(!QFingerprintTemplateArchive().open(directory.filePath("missing.qfpt")));
+}
+
+QTEST_APPLESS_MAIN(tst_templatearchive)
+
+#include "tst_templatearchive.moc"
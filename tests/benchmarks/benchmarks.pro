@@ -0,0 +1,10 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    protocol \
+    workflows \
+    hostmatcher
+
+linux: SUBDIRS += \
+    nativeserial \
+    reactor
@@ -0,0 +1,6 @@
+TARGET = tst_bench_hostmatcher
+
+QT = core gui testlib fingerprint
+CONFIG += benchmark exceptions
+
+SOURCES += tst_bench_hostmatcher.cpp
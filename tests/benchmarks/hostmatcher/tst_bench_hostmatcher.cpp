@@ -0,0 +1,186 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include <qfingerprinthostmatcher.h>
+
+#include <cmath>
+#include <random>
+
+
+// Host side matching. extraction measures minutiae extraction from one
+// sensor sized image. identify reports the templates compared per second and
+// thread, for growing galleries and thread counts.
+class tst_bench_hostmatcher : public QObject {
+    Q_OBJECT
+
+private slots:
+    void extraction();
+    void identify_data();
+    void identify();
+
+private:
+    static QImage syntheticImage(unsigned seed);
+    static QVector<QFingerprintMinutia> randomMinutiae(std::mt19937* generator, int count);
+    static QVector<QFingerprintMinutia> displaced(const QVector<QFingerprintMinutia>& minutiae, std::mt19937* generator);
+};
+
+
+// Parallel ridges with phase vortices, every vortex leaves a ridge ending or bifurcation
+QImage tst_bench_hostmatcher::syntheticImage(unsigned seed) {
+    const float pi = 3.14159265f;
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> uniform(0, 1);
+
+    float vortexX[8];
+    float vortexY[8];
+    float vortexSign[8];
+    for (int i = 0; i < 8; i++) {
+        vortexX[i] = 40 + uniform(generator) * 176;
+        vortexY[i] = 40 + uniform(generator) * 208;
+        vortexSign[i] = uniform(generator) < 0.5f ? 1 : -1;
+    }
+    float direction = uniform(generator) * pi;
+
+    QImage image(256, 288, QImage::Format_Grayscale8);
+    for (int y = 0; y < image.height(); y++) {
+        uchar* line = image.scanLine(y);
+        for (int x = 0; x < image.width(); x++) {
+            float phase = 2 * pi / 9 * (x * std::cos(direction) + y * std::sin(direction));
+            for (int i = 0; i < 8; i++) {
+                phase += vortexSign[i] * std::atan2(y - vortexY[i], x - vortexX[i]);
+            }
+            line[x] = uchar(128 + 100 * std::cos(phase));
+        }
+    }
+    return image;
+}
+
+QVector<QFingerprintMinutia> tst_bench_hostmatcher::randomMinutiae(std::mt19937* generator, int count) {
+    std::uniform_int_distribution<int> x(16, 239);
+    std::uniform_int_distribution<int> y(16, 271);
+    std::uniform_real_distribution<float> angle(0, 3.14159265f);
+
+    QVector<QFingerprintMinutia> minutiae;
+    for (int i = 0; i < count; i++) {
+        QFingerprintMinutia minutia;
+        minutia.x = qint16(x(*generator));
+        minutia.y = qint16(y(*generator));
+        minutia.angle = angle(*generator);
+        minutia.type = i % 2 ? QFingerprintMinutia::Bifurcation : QFingerprintMinutia::Ending;
+        minutiae.append(minutia);
+    }
+    return minutiae;
+}
+
+// The same finger placed again: rotated, shifted, with a few minutiae missing
+QVector<QFingerprintMinutia> tst_bench_hostmatcher::displaced(const QVector<QFingerprintMinutia>& minutiae,
+                                                              std::mt19937* generator) {
+    const float pi = 3.14159265f;
+    const float rotation = 0.3f;
+    std::uniform_int_distribution<int> jitter(-1, 1);
+
+    QVector<QFingerprintMinutia> result;
+    for (int i = 0; i < minutiae.size(); i++) {
+        if (i % 10 == 9) {
+            continue;
+        }
+        QFingerprintMinutia minutia = minutiae[i];
+        float x = minutia.x - 128;
+        float y = minutia.y - 144;
+        minutia.x = qint16(std::lround(128 + 7 + x * std::cos(rotation) - y * std::sin(rotation)) + jitter(*generator));
+        minutia.y = qint16(std::lround(144 - 5 + x * std::sin(rotation) + y * std::cos(rotation)) + jitter(*generator));
+        minutia.angle = std::fmod(minutia.angle + rotation, pi);
+        result.append(minutia);
+    }
+    return result;
+}
+
+void tst_bench_hostmatcher::extraction() {
+    QImage image = syntheticImage(1);
+    QVector<QFingerprintMinutia> minutiae;
+
+    QBENCHMARK {
+        minutiae = QFingerprintHostMatcher::extractMinutiae(image);
+    }
+    QVERIFY(!minutiae.isEmpty());
+}
+
+void tst_bench_hostmatcher::identify_data() {
+    QTest::addColumn<int>("gallerySize");
+    QTest::addColumn<int>("threadCount");
+
+    QList<int> threadCounts = {1, 2, 4};
+    if (!threadCounts.contains(QThread::idealThreadCount())) {
+        threadCounts.append(QThread::idealThreadCount());
+    }
+    for (int gallerySize : {1000, 10000, 100000}) {
+        for (int threadCount : threadCounts) {
+            QByteArray name = QByteArray::number(gallerySize) + "/" + QByteArray::number(threadCount);
+            QTest::newRow(name.constData()) << gallerySize << threadCount;
+        }
+    }
+}
+
+void tst_bench_hostmatcher::identify() {
+    QFETCH(int, gallerySize);
+    QFETCH(int, threadCount);
+    const int minutiaCount = 40;
+    const int probes = 20;
+
+    std::mt19937 generator(42);
+    QFingerprintHostMatcher matcher;
+    matcher.setThreadCount(threadCount);
+    matcher.reserve(gallerySize, gallerySize * minutiaCount);
+
+    QList<int> enrolled;
+    QList<QVector<QFingerprintMinutia>> probeMinutiae;
+    for (int i = 0; i < gallerySize; i++) {
+        QVector<QFingerprintMinutia> minutiae = randomMinutiae(&generator, minutiaCount);
+        matcher.addTemplate(quint32(i), minutiae);
+        if (i % (gallerySize / probes) == 0) {
+            enrolled.append(i);
+            probeMinutiae.append(displaced(minutiae, &generator));
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < probeMinutiae.size(); i++) {
+        QFingerprintHostMatch match = matcher.identify(probeMinutiae[i]);
+        QCOMPARE(match.index, enrolled[i]);
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+
+    QTest::setBenchmarkResult(qreal(gallerySize) * probeMinutiae.size() * 1000000000 / qMax(nsecs, qint64(1)) / threadCount,
+                              QTest::Events);
+}
+
+QTEST_MAIN(tst_bench_hostmatcher)
+
+#include "tst_bench_hostmatcher.moc"
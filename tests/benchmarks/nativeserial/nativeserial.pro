@@ -0,0 +1,10 @@
+requires(linux)
+
+TARGET = tst_bench_nativeserial
+
+QT = core gui serialport testlib fingerprint
+CONFIG += benchmark exceptions
+
+include(../shared/shared.pri)
+
+SOURCES += tst_bench_nativeserial.cpp
@@ -0,0 +1,124 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <qfingerprint.h>
+#include <qfingerprintnativeserial.h>
+#include <ptysensorfarm.h>
+
+
+// Per command round trip over a pty through QSerialPort and through the
+// native termios/epoll transport.
+class tst_bench_nativeserial : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void roundTrip_data();
+    void roundTrip();
+    void downloadTemplate_data();
+    void downloadTemplate();
+
+private:
+    void transports();
+    void openTransport(QFingerprint* fingerprint, bool native);
+
+    PtySensorFarm* m_pty = nullptr;
+    QFingerprintNativeSerial* m_native = nullptr;
+};
+
+
+void tst_bench_nativeserial::initTestCase() {
+    this->m_pty = new PtySensorFarm(1);
+    if (this->m_pty->count() == 0) {
+        QSKIP("No pty available");
+    }
+    this->m_pty->start();
+}
+
+void tst_bench_nativeserial::cleanupTestCase() {
+    delete this->m_native;
+    delete this->m_pty;
+}
+
+void tst_bench_nativeserial::transports() {
+    QTest::addColumn<bool>("native");
+
+    QTest::newRow("QSerialPort") << false;
+    QTest::newRow("native") << true;
+}
+
+void tst_bench_nativeserial::openTransport(QFingerprint* fingerprint, bool native) {
+    if (!native) {
+        fingerprint->initialize_device(this->m_pty->slaveName(0), 57600);
+        return;
+    }
+
+    delete this->m_native;
+    this->m_native = new QFingerprintNativeSerial(this->m_pty->slaveName(0));
+    this->m_native->setBaudRate(57600);
+    this->m_native->setLowLatency(true);
+    QVERIFY2(this->m_native->open(QIODevice::ReadWrite), qPrintable(this->m_native->errorString()));
+    fingerprint->setDevice(this->m_native);
+}
+
+void tst_bench_nativeserial::roundTrip_data() {
+    this->transports();
+}
+
+void tst_bench_nativeserial::roundTrip() {
+    QFETCH(bool, native);
+    QFingerprint fingerprint;
+    this->openTransport(&fingerprint, native);
+
+    QBENCHMARK {
+        QVERIFY(fingerprint.verifyPassword());
+    }
+}
+
+void tst_bench_nativeserial::downloadTemplate_data() {
+    this->transports();
+}
+
+void tst_bench_nativeserial::downloadTemplate() {
+    QFETCH(bool, native);
+    QFingerprint fingerprint;
+    this->openTransport(&fingerprint, native);
+
+    this->m_pty->sensor(0)->putFinger(7);
+    fingerprint.readImage();
+    fingerprint.convertImage(FINGERPRINT_CHARBUFFER1);
+    fingerprint.storeTemplate(7);
+
+    QBENCHMARK {
+        QCOMPARE(fingerprint.downloadTemplate(7, FINGERPRINT_CHARBUFFER1).size(), 512);
+    }
+}
+
+QTEST_MAIN(tst_bench_nativeserial)
+
+#include "tst_bench_nativeserial.moc"
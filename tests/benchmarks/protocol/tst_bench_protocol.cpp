@@ -0,0 +1,206 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QImage>
+#include <QTemporaryDir>
+
+#include <qfingerprint.h>
+#include <qfingerprintframe.h>
+#include <qfingerprintimagearchive.h>
+
+
+class tst_bench_protocol : public QObject {
+    Q_OBJECT
+
+private slots:
+    void encodeFrame_data();
+    void encodeFrame();
+    void decodeFrames_data();
+    void decodeFrames();
+    void checksum_data();
+    void checksum();
+    void unpackImage();
+    void persistImage_data();
+    void persistImage();
+    void templateToPayload();
+    void payloadToTemplate();
+
+private:
+    void payloadSizes();
+};
+
+
+void tst_bench_protocol::payloadSizes() {
+    QTest::addColumn<int>("payloadSize");
+
+    QTest::newRow("32") << 32;
+    QTest::newRow("64") << 64;
+    QTest::newRow("128") << 128;
+    QTest::newRow("256") << 256;
+}
+
+void tst_bench_protocol::encodeFrame_data() {
+    this->payloadSizes();
+}
+
+void tst_bench_protocol::encodeFrame() {
+    QFETCH(int, payloadSize);
+    QByteArray payload(payloadSize, char(0xA5));
+    QByteArray frame;
+
+    QBENCHMARK {
+        frame = QFingerprintFrame::encode(0xFFFFFFFF, FINGERPRINT_DATAPACKET, payload);
+    }
+    QCOMPARE(frame.size(), QFingerprintFrame::MinimumSize - 1 + payloadSize);
+}
+
+// A template download at the given packet size, fed in 64 byte reads the
+// way a serial port hands them out.
+void tst_bench_protocol::decodeFrames_data() {
+    this->payloadSizes();
+}
+
+void tst_bench_protocol::decodeFrames() {
+    QFETCH(int, payloadSize);
+    QByteArray stream;
+    int frameCount = 512 / payloadSize;
+    for (int i = 0; i < frameCount; i++) {
+        uint8_t packetType = i == frameCount - 1 ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET;
+        stream += QFingerprintFrame::encode(0xFFFFFFFF, packetType, QByteArray(payloadSize, char(i)));
+    }
+
+    QFingerprintFrameDecoder decoder;
+    QByteArray packet;
+    int decoded = 0;
+
+    QBENCHMARK {
+        decoded = 0;
+        for (int offset = 0; offset < stream.size(); offset += 64) {
+            decoder.feed(stream.constData() + offset, qMin(64, stream.size() - offset));
+            while (decoder.next(&packet) == QFingerprintFrameDecoder::Frame) {
+                decoded++;
+            }
+        }
+    }
+    QCOMPARE(decoded, frameCount);
+}
+
+void tst_bench_protocol::checksum_data() {
+    this->payloadSizes();
+}
+
+void tst_bench_protocol::checksum() {
+    QFETCH(int, payloadSize);
+    QByteArray payload(payloadSize, char(0xA5));
+    quint16 sum = 0;
+
+    QBENCHMARK {
+        sum = QFingerprintFrame::checksum(FINGERPRINT_DATAPACKET, quint16(payloadSize + 2),
+                                          payload.constData(), payload.size());
+    }
+    QVERIFY(sum != 0);
+}
+
+void tst_bench_protocol::unpackImage() {
+    QByteArray imageData(256 * 288 / 2, char(0xF0));
+    QImage image(256, 288, QImage::Format_Grayscale8);
+
+    QBENCHMARK {
+        QFingerprint::unpackImage(imageData, &image);
+    }
+    QCOMPARE(int(image.constBits()[0]), 0);
+    QCOMPARE(int(image.constBits()[1]), 255);
+}
+
+// The work QFingerprintImageWriter takes off the capture thread: encoding
+// and writing one PNG file, or appending the raw data to an archive
+void tst_bench_protocol::persistImage_data() {
+    QTest::addColumn<bool>("raw");
+
+    QTest::newRow("png") << false;
+    QTest::newRow("raw4bpp") << true;
+}
+
+void tst_bench_protocol::persistImage() {
+    QFETCH(bool, raw);
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    QByteArray imageData(256 * 288 / 2, 0);
+    for (int i = 0; i < imageData.size(); i++) {
+        imageData[i] = char(i * 7 + i / 256);
+    }
+    QImage image(256, 288, QImage::Format_Grayscale8);
+    QFingerprint::unpackImage(imageData, &image);
+
+    QFingerprintImageArchive archive(directory.filePath("images.qfpi"));
+    QVERIFY(archive.open());
+    QString fileName = directory.filePath("image.png");
+    bool written = true;
+
+    QBENCHMARK {
+        written = written && (raw ? archive.append(imageData, 0) : image.save(fileName));
+    }
+    QVERIFY(written);
+    if (raw) {
+        QCOMPARE(archive.image(0).constBits()[0], image.constBits()[0]);
+    }
+}
+
+// Templates travel as QList<uint8_t> in the API and as QByteArray on the
+// wire, these are the copies done for every upload and download.
+void tst_bench_protocol::templateToPayload() {
+    QList<uint8_t> characteristics;
+    for (int i = 0; i < 512; i++) {
+        characteristics.append(uint8_t(i));
+    }
+    QByteArray payload;
+
+    QBENCHMARK {
+        payload.clear();
+        for (uint8_t byte : characteristics) {
+            payload.append(byte);
+        }
+    }
+    QCOMPARE(payload.size(), 512);
+}
+
+void tst_bench_protocol::payloadToTemplate() {
+    QByteArray payload(512, char(0x3C));
+    QList<uint8_t> characteristics;
+
+    QBENCHMARK {
+        characteristics.clear();
+        for (char byte : payload) {
+            characteristics.append(uint8_t(byte));
+        }
+    }
+    QCOMPARE(characteristics.size(), 512);
+}
+
+QTEST_MAIN(tst_bench_protocol)
+
+#include "tst_bench_protocol.moc"
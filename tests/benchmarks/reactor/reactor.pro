@@ -0,0 +1,10 @@
+requires(linux)
+
+TARGET = tst_bench_reactor
+
+QT = core gui testlib fingerprint
+CONFIG += benchmark exceptions
+
+include(../shared/shared.pri)
+
+SOURCES += tst_bench_reactor.cpp
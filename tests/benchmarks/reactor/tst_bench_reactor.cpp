@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QElapsedTimer>
+
+#include <qfingerprint.h>
+#include <qfingerprintnativeserial.h>
+#include <qfingerprintreactor.h>
+#include <ptysensorfarm.h>
+
+
+// Aggregate command throughput of one reactor thread against a growing number
+// of simulated sensors on ptys. The result is completed commands per second.
+class tst_bench_reactor : public QObject {
+    Q_OBJECT
+
+private slots:
+    void throughput_data();
+    void throughput();
+};
+
+
+void tst_bench_reactor::throughput_data() {
+    QTest::addColumn<int>("deviceCount");
+
+    for (int deviceCount : {1, 2, 4, 8, 16, 32, 64}) {
+        QTest::newRow(QByteArray::number(deviceCount).constData()) << deviceCount;
+    }
+}
+
+void tst_bench_reactor::throughput() {
+    QFETCH(int, deviceCount);
+    const int commandsPerDevice = 200;
+
+    PtySensorFarm farm(deviceCount);
+    if (farm.count() < deviceCount) {
+        QSKIP("Not enough ptys available");
+    }
+
+    QFingerprintReactor reactor;
+    QList<QFingerprintNativeSerial*> ports;
+    for (int i = 0; i < deviceCount; i++) {
+        QFingerprintNativeSerial* port = new QFingerprintNativeSerial(farm.slaveName(i));
+        ports.append(port);
+        QVERIFY2(port->open(QIODevice::ReadWrite), qPrintable(port->errorString()));
+        QVERIFY(reactor.addDevice(port) >= 0);
+    }
+    farm.start();
+
+    QByteArray verifyPassword;
+    verifyPassword.append(char(FINGERPRINT_VERIFYPASSWORD)).append(QByteArray(4, 0));
+    int failed = 0;
+    auto countFailures = [&failed](const QFingerprintResult<QByteArray>& reply) {
+        failed += reply.hasValue() ? 0 : 1;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int command = 0; command < commandsPerDevice; command++) {
+        for (int device = 0; device < deviceCount; device++) {
+            reactor.enqueue(device, verifyPassword, countFailures);
+        }
+    }
+    reactor.run();
+    qint64 nsecs = timer.nsecsElapsed();
+
+    farm.stop();
+    qDeleteAll(ports);
+
+    QCOMPARE(failed, 0);
+    QTest::setBenchmarkResult(qreal(deviceCount) * commandsPerDevice * 1000000000 / qMax(nsecs, qint64(1)),
+                              QTest::Events);
+}
+
+QTEST_MAIN(tst_bench_reactor)
+
+#include "tst_bench_reactor.moc"
@@ -0,0 +1,121 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "ptysensorfarm.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+PtySensorFarm::PtySensorFarm(int count) {
+    for (int i = 0; i < count; i++) {
+        int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0) {
+            if (master >= 0) {
+                ::close(master);
+            }
+            break;
+        }
+        // Holding the slave open keeps the master from reporting a hangup
+        // while the library has its side closed
+        QByteArray slaveName(::ptsname(master));
+        int slave = ::open(slaveName.constData(), O_RDWR | O_NOCTTY);
+        struct termios options;
+        if (slave >= 0 && ::tcgetattr(slave, &options) == 0) {
+            ::cfmakeraw(&options);
+            ::tcsetattr(slave, TCSANOW, &options);
+        }
+
+        this->m_masters.append(master);
+        this->m_slaves.append(slave);
+        this->m_slaveNames.append(QString::fromLocal8Bit(slaveName.constData()));
+        this->m_sensors.append(new SensorSimulator(1000, 128));
+    }
+}
+
+PtySensorFarm::~PtySensorFarm() {
+    this->stop();
+    for (int master : this->m_masters) {
+        ::close(master);
+    }
+    for (int slave : this->m_slaves) {
+        if (slave >= 0) {
+            ::close(slave);
+        }
+    }
+    qDeleteAll(this->m_sensors);
+}
+
+int PtySensorFarm::count() const {
+    return this->m_masters.size();
+}
+
+QString PtySensorFarm::slaveName(int index) const {
+    return this->m_slaveNames.at(index);
+}
+
+SensorSimulator* PtySensorFarm::sensor(int index) {
+    return this->m_sensors.at(index);
+}
+
+void PtySensorFarm::stop() {
+    this->m_stop.storeRelaxed(1);
+    this->wait();
+}
+
+void PtySensorFarm::run() {
+    QVector<struct pollfd> pollFds;
+    for (int master : this->m_masters) {
+        pollFds.append({master, POLLIN, 0});
+    }
+
+    char chunk[4096];
+    while (!this->m_stop.loadRelaxed()) {
+        if (::poll(pollFds.data(), nfds_t(pollFds.size()), 20) <= 0) {
+            continue;
+        }
+
+        for (int i = 0; i < pollFds.size(); i++) {
+            if (!(pollFds[i].revents & POLLIN)) {
+                continue;
+            }
+            ssize_t size = ::read(pollFds[i].fd, chunk, sizeof(chunk));
+            if (size <= 0) {
+                continue;
+            }
+
+            QByteArray replies = this->m_sensors[i]->receive(QByteArray(chunk, int(size)));
+            for (int offset = 0; offset < replies.size();) {
+                ssize_t written = ::write(pollFds[i].fd, replies.constData() + offset, size_t(replies.size() - offset));
+                if (written > 0) {
+                    offset += int(written);
+                }
+            }
+        }
+    }
+}
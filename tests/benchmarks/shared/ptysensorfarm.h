@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef PTYSENSORFARM_H
+#define PTYSENSORFARM_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QStringList>
+#include <QVector>
+
+#include "sensorsimulator.h"
+
+
+// Simulated sensors on the master sides of ptys, all served by one thread.
+// The library opens the slave sides like real serial ports.
+class PtySensorFarm : public QThread {
+public:
+    explicit PtySensorFarm(int count = 1);
+    ~PtySensorFarm() override;
+
+    int count() const;
+    QString slaveName(int index) const;
+    SensorSimulator* sensor(int index);
+
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    QVector<int> m_masters;
+    QVector<int> m_slaves;
+    QStringList m_slaveNames;
+    QVector<SensorSimulator*> m_sensors;
+    QAtomicInt m_stop;
+};
+
+#endif /* end of include guard */
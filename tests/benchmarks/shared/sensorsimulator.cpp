@@ -0,0 +1,371 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "sensorsimulator.h"
+
+#include <qfingerprint.h>
+
+#include <cstring>
+
+
+namespace {
+
+const int CharacteristicsSize = 512;
+const int ImageSize = 256 * 288 / 2;
+
+quint16 readWord(const QByteArray& payload, int index) {
+    return (quint16(uint8_t(payload[index])) << 8) | uint8_t(payload[index + 1]);
+}
+
+void appendWord(QByteArray* data, quint16 value) {
+    data->append(char(value >> 8)).append(char(value));
+}
+
+}
+
+
+SensorSimulator::SensorSimulator(quint16 capacity, quint16 packetSize)
+    : m_packetSize(packetSize)
+    , m_flash(capacity)
+{
+}
+
+quint16 SensorSimulator::capacity() const {
+    return quint16(this->m_flash.size());
+}
+
+quint32 SensorSimulator::address() const {
+    return this->m_address;
+}
+
+void SensorSimulator::setAddress(quint32 address) {
+    this->m_address = address;
+}
+
+quint16 SensorSimulator::packetSize() const {
+    return this->m_packetSize;
+}
+
+void SensorSimulator::setPacketSize(quint16 packetSize) {
+    this->m_packetSize = packetSize;
+}
+
+void SensorSimulator::putFinger(int finger) {
+    this->m_finger = finger;
+}
+
+void SensorSimulator::liftFinger() {
+    this->m_finger = -1;
+}
+
+void SensorSimulator::clear() {
+    for (QByteArray& slot : this->m_flash) {
+        slot.clear();
+    }
+    this->m_charBuffers[0].clear();
+    this->m_charBuffers[1].clear();
+}
+
+// Deterministic stand-in for the feature extraction: a pseudo random body
+// seeded by the finger, with the zero runs real templates have.
+QByteArray SensorSimulator::characteristics(int finger) {
+    QByteArray data(CharacteristicsSize, 0);
+    quint32 state = 0x9E3779B9u ^ quint32(finger);
+    for (int i = 0; i < CharacteristicsSize; i++) {
+        state = state * 1664525u + 1013904223u;
+        if ((i & 63) < 40) {
+            data[i] = char(state >> 24);
+        }
+    }
+    return data;
+}
+
+QByteArray SensorSimulator::receive(const QByteArray& bytes) {
+    QByteArray replies;
+    QByteArray packet;
+    quint32 address = 0;
+
+    this->m_decoder.feed(bytes);
+    QFingerprintFrameDecoder::Status status;
+    while ((status = this->m_decoder.next(&packet, &address)) != QFingerprintFrameDecoder::Incomplete) {
+        if (status != QFingerprintFrameDecoder::Frame || address != this->m_address) {
+            continue;
+        }
+
+        uint8_t packetType = packet[0];
+        if (packetType == FINGERPRINT_COMMANDPACKET) {
+            replies += this->handleCommand(packet.mid(1));
+        } else if (this->m_uploadBuffer != 0
+                   && (packetType == FINGERPRINT_DATAPACKET || packetType == FINGERPRINT_ENDDATAPACKET)) {
+            this->m_upload.append(packet.constData() + 1, packet.size() - 1);
+            if (packetType == FINGERPRINT_ENDDATAPACKET) {
+                this->m_charBuffers[this->m_uploadBuffer - 1] = this->m_upload;
+                this->m_upload.clear();
+                this->m_uploadBuffer = 0;
+            }
+        }
+    }
+    return replies;
+}
+
+QByteArray SensorSimulator::handleCommand(const QByteArray& payload) {
+    uint8_t instruction = payload[0];
+
+    switch (instruction) {
+    case FINGERPRINT_VERIFYPASSWORD:
+    case FINGERPRINT_SETPASSWORD:
+        return this->reply(FINGERPRINT_OK);
+
+    case FINGERPRINT_SETSYSTEMPARAMETER:
+        if (uint8_t(payload[1]) == FINGERPRINT_SETSYSTEMPARAMETER_PACKAGE_SIZE) {
+            this->m_packetSize = quint16(32 << uint8_t(payload[2]));
+        }
+        return this->reply(FINGERPRINT_OK);
+
+    case FINGERPRINT_GETSYSTEMPARAMETERS: {
+        QByteArray parameters;
+        appendWord(&parameters, 0);                     // Status register
+        appendWord(&parameters, 0);                     // System id
+        appendWord(&parameters, this->capacity());
+        appendWord(&parameters, 3);                     // Security level
+        appendWord(&parameters, quint16(this->m_address >> 16));
+        appendWord(&parameters, quint16(this->m_address));
+        quint16 packetSizeType = 0;
+        while ((32 << packetSizeType) < this->m_packetSize) {
+            packetSizeType++;
+        }
+        appendWord(&parameters, packetSizeType);
+        appendWord(&parameters, 6);                     // 57600 baud
+        return this->reply(FINGERPRINT_OK, parameters);
+    }
+
+    case FINGERPRINT_TEMPLATEINDEX: {
+        int page = uint8_t(payload[1]);
+        QByteArray index(32, 0);
+        for (int i = 0; i < 256; i++) {
+            int position = page * 256 + i;
+            if (position < this->m_flash.size() && !this->m_flash[position].isEmpty()) {
+                index[i / 8] = char(uint8_t(index[i / 8]) | (1 << (i % 8)));
+            }
+        }
+        return this->reply(FINGERPRINT_OK, index);
+    }
+
+    case FINGERPRINT_TEMPLATECOUNT: {
+        quint16 count = 0;
+        for (const QByteArray& slot : this->m_flash) {
+            count += slot.isEmpty() ? 0 : 1;
+        }
+        QByteArray data;
+        appendWord(&data, count);
+        return this->reply(FINGERPRINT_OK, data);
+    }
+
+    case FINGERPRINT_READIMAGE:
+        if (this->m_finger < 0) {
+            return this->reply(FINGERPRINT_ERROR_NOFINGER);
+        }
+        this->m_imageFinger = this->m_finger;
+        return this->reply(FINGERPRINT_OK);
+
+    case FINGERPRINT_DOWNLOADIMAGE: {
+        QByteArray image(ImageSize, char(0x77));
+        return this->reply(FINGERPRINT_OK) + this->dataPackets(image);
+    }
+
+    case FINGERPRINT_CONVERTIMAGE: {
+        int buffer = uint8_t(payload[1]);
+        if (this->m_imageFinger < 0) {
+            return this->reply(FINGERPRINT_ERROR_INVALIDIMAGE);
+        }
+        this->m_charBuffers[buffer - 1] = characteristics(this->m_imageFinger);
+        return this->reply(FINGERPRINT_OK);
+    }
+
+    case FINGERPRINT_CREATETEMPLATE:
+        if (this->m_charBuffers[0] != this->m_charBuffers[1]) {
+            return this->reply(FINGERPRINT_ERROR_CHARACTERISTICSMISMATCH);
+        }
+        return this->reply(FINGERPRINT_OK);
+
+    case FINGERPRINT_STORETEMPLATE: {
+        int buffer = uint8_t(payload[1]);
+        quint16 position = readWord(payload, 2);
+        if (position >= this->m_flash.size()) {
+            return this->reply(FINGERPRINT_ERROR_INVALIDPOSITION);
+        }
+        this->m_flash[position] = this->m_charBuffers[buffer - 1];
+        return this->reply(FINGERPRINT_OK);
+    }
+
+    case FINGERPRINT_LOADTEMPLATE: {
+        int buffer = uint8_t(payload[1]);
+        quint16 position = readWord(payload, 2);
+        if (position >= this->m_flash.size() || this->m_flash[position].isEmpty()) {
+            return this->reply(FINGERPRINT_ERROR_LOADTEMPLATE);
+        }
+        this->m_charBuffers[buffer - 1] = this->m_flash[position];
+        return this->reply(FINGERPRINT_OK);
+    }
+
+    case FINGERPRINT_SEARCHTEMPLATE: {
+        const QByteArray& probe = this->m_charBuffers[uint8_t(payload[1]) - 1];
+        int start = readWord(payload, 2);
+        int end = qMin(start + int(readWord(payload, 4)), int(this->m_flash.size()));
+        for (int position = start; position < end; position++) {
+            if (!probe.isEmpty() && this->m_flash[position] == probe) {
+                QByteArray data;
+                appendWord(&data, quint16(position));
+                appendWord(&data, 100);
+                return this->reply(FINGERPRINT_OK, data);
+            }
+        }
+        return this->reply(FINGERPRINT_ERROR_NOTEMPLATEFOUND, QByteArray(4, 0));
+    }
+
+    case FINGERPRINT_DELETETEMPLATE: {
+        int position = readWord(payload, 1);
+        int end = qMin(position + int(readWord(payload, 3)), int(this->m_flash.size()));
+        if (position >= this->m_flash.size()) {
+            return this->reply(FINGERPRINT_ERROR_DELETETEMPLATE);
+        }
+        for (; position < end; position++) {
+            this->m_flash[position].clear();
+        }
+        return this->reply(FINGERPRINT_OK);
+    }
+
+    case FINGERPRINT_CLEARDATABASE:
+        this->clear();
+        return this->reply(FINGERPRINT_OK);
+
+    case FINGERPRINT_GENERATERANDOMNUMBER:
+        return this->reply(FINGERPRINT_OK, QByteArray(4, char(0x5A)));
+
+    case FINGERPRINT_COMPARECHARACTERISTICS: {
+        if (this->m_charBuffers[0] != this->m_charBuffers[1]) {
+            return this->reply(FINGERPRINT_ERROR_NOTMATCHING, QByteArray(2, 0));
+        }
+        QByteArray data;
+        appendWord(&data, 100);
+        return this->reply(FINGERPRINT_OK, data);
+    }
+
+    case FINGERPRINT_UPLOADCHARACTERISTICS:
+        this->m_uploadBuffer = uint8_t(payload[1]);
+        this->m_upload.clear();
+        return this->reply(FINGERPRINT_OK);
+
+    case FINGERPRINT_DOWNLOADCHARACTERISTICS: {
+        QByteArray data = this->m_charBuffers[uint8_t(payload[1]) - 1];
+        if (data.isEmpty()) {
+            return this->reply(FINGERPRINT_ERROR_DOWNLOADCHARACTERISTICS);
+        }
+        return this->reply(FINGERPRINT_OK) + this->dataPackets(data);
+    }
+
+    default:
+        return this->reply(FINGERPRINT_PACKETRESPONSEFAIL);
+    }
+}
+
+QByteArray SensorSimulator::reply(uint8_t code, const QByteArray& data) const {
+    QByteArray payload;
+    payload.append(char(code)).append(data);
+    return QFingerprintFrame::encode(this->m_address, FINGERPRINT_ACKPACKET, payload);
+}
+
+QByteArray SensorSimulator::dataPackets(const QByteArray& data) const {
+    QByteArray frames;
+    int offset = 0;
+    while (data.size() - offset > this->m_packetSize) {
+        frames += QFingerprintFrame::encode(this->m_address, FINGERPRINT_DATAPACKET,
+                                            data.mid(offset, this->m_packetSize));
+        offset += this->m_packetSize;
+    }
+    frames += QFingerprintFrame::encode(this->m_address, FINGERPRINT_ENDDATAPACKET, data.mid(offset));
+    return frames;
+}
+
+
+SimulatedSerialPort::SimulatedSerialPort(SensorSimulator* sensor, qint32 baudRate, QObject* parent)
+    : QIODevice(parent)
+    , m_sensor(sensor)
+    , m_baudRate(baudRate)
+{
+    this->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+qint32 SimulatedSerialPort::baudRate() const {
+    return this->m_baudRate;
+}
+
+void SimulatedSerialPort::setBaudRate(qint32 baudRate) {
+    this->m_baudRate = baudRate;
+}
+
+qint64 SimulatedSerialPort::wireNsecs() const {
+    return this->m_wireNsecs;
+}
+
+void SimulatedSerialPort::resetWireNsecs() {
+    this->m_wireNsecs = 0;
+}
+
+bool SimulatedSerialPort::isSequential() const {
+    return true;
+}
+
+qint64 SimulatedSerialPort::bytesAvailable() const {
+    return this->m_rx.size() + QIODevice::bytesAvailable();
+}
+
+bool SimulatedSerialPort::waitForReadyRead(int msecs) {
+    Q_UNUSED(msecs)
+    return !this->m_rx.isEmpty();
+}
+
+bool SimulatedSerialPort::waitForBytesWritten(int msecs) {
+    Q_UNUSED(msecs)
+    return true;
+}
+
+qint64 SimulatedSerialPort::readData(char* data, qint64 maxSize) {
+    qint64 size = qMin(maxSize, qint64(this->m_rx.size()));
+    memcpy(data, this->m_rx.constData(), size_t(size));
+    this->m_rx.remove(0, int(size));
+    return size;
+}
+
+qint64 SimulatedSerialPort::writeData(const char* data, qint64 maxSize) {
+    QByteArray replies = this->m_sensor->receive(QByteArray(data, int(maxSize)));
+    this->m_wireNsecs += this->transferNsecs(maxSize + replies.size());
+    this->m_rx += replies;
+    return maxSize;
+}
+
+qint64 SimulatedSerialPort::transferNsecs(qint64 bytes) const {
+    return bytes * 10 * Q_INT64_C(1000000000) / this->m_baudRate;
+}
@@ -0,0 +1,107 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SENSORSIMULATOR_H
+#define SENSORSIMULATOR_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QVector>
+
+#include <qfingerprintframe.h>
+
+
+// In-process model of a ZFM sensor. Command frames go in, the reply frames
+// come out, including the data phases of image and template transfers.
+// Characteristics are derived from the finger that is put on the sensor, so
+// an enrolled finger is found again by a later search.
+class SensorSimulator {
+public:
+    explicit SensorSimulator(quint16 capacity = 1000, quint16 packetSize = 128);
+
+    quint16 capacity() const;
+    // Frames for other addresses are ignored, as on a shared line
+    quint32 address() const;
+    void setAddress(quint32 address);
+    quint16 packetSize() const;
+    void setPacketSize(quint16 packetSize);
+
+    void putFinger(int finger);
+    void liftFinger();
+
+    void clear();
+    QByteArray receive(const QByteArray& bytes);
+
+    static QByteArray characteristics(int finger);
+
+private:
+    QByteArray handleCommand(const QByteArray& payload);
+    QByteArray reply(uint8_t code, const QByteArray& data = QByteArray()) const;
+    QByteArray dataPackets(const QByteArray& data) const;
+
+    quint32 m_address = 0xFFFFFFFF;
+    quint16 m_packetSize;
+    int m_finger = -1;
+    int m_imageFinger = -1;
+    int m_uploadBuffer = 0;
+    QByteArray m_upload;
+    QByteArray m_charBuffers[2];
+    QVector<QByteArray> m_flash;
+    QFingerprintFrameDecoder m_decoder;
+};
+
+
+// Serial line in front of a SensorSimulator. Replies are available right
+// after a write, the time the bytes would have spent on the wire at the
+// configured baud rate is added up instead (10 bit per byte, 8N1).
+class SimulatedSerialPort : public QIODevice {
+public:
+    explicit SimulatedSerialPort(SensorSimulator* sensor, qint32 baudRate = 57600, QObject* parent = nullptr);
+
+    qint32 baudRate() const;
+    void setBaudRate(qint32 baudRate);
+
+    qint64 wireNsecs() const;
+    void resetWireNsecs();
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    bool waitForReadyRead(int msecs) override;
+    bool waitForBytesWritten(int msecs) override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    qint64 transferNsecs(qint64 bytes) const;
+
+    SensorSimulator* m_sensor;
+    qint32 m_baudRate;
+    qint64 m_wireNsecs = 0;
+    QByteArray m_rx;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,10 @@
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/sensorsimulator.h
+
+SOURCES += $$PWD/sensorsimulator.cpp
+
+linux {
+    HEADERS += $$PWD/ptysensorfarm.h
+    SOURCES += $$PWD/ptysensorfarm.cpp
+}
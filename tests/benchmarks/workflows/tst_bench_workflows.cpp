@@ -0,0 +1,228 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+
+#include <qfingerprint.h>
+#include <qfingerprintpreview.h>
+#include <sensorsimulator.h>
+
+#include <functional>
+
+
+// End to end workflows against the simulated sensor. The reported time per
+// workflow is the host time plus the time the exchanged bytes would take on
+// a serial line at the row's baud rate.
+class tst_bench_workflows : public QObject {
+    Q_OBJECT
+
+private slots:
+    void enroll_data();
+    void enroll();
+    void identify_data();
+    void identify();
+    void downloadTemplate_data();
+    void downloadTemplate();
+    void downloadImage_data();
+    void downloadImage();
+    void preview_data();
+    void preview();
+
+private:
+    void links();
+    bool measure(SimulatedSerialPort* port, int repetitions, const std::function<bool(int)>& workflow);
+    void enrollFingers(QFingerprint* fingerprint, SensorSimulator* sensor, int count);
+};
+
+
+void tst_bench_workflows::links() {
+    QTest::addColumn<int>("baudRate");
+    QTest::addColumn<int>("packetSize");
+
+    for (int baudRate : {9600, 57600, 115200}) {
+        for (int packetSize : {32, 64, 128, 256}) {
+            QByteArray name = QByteArray::number(baudRate) + "/" + QByteArray::number(packetSize);
+            QTest::newRow(name.constData()) << baudRate << packetSize;
+        }
+    }
+}
+
+bool tst_bench_workflows::measure(SimulatedSerialPort* port, int repetitions,
+                                  const std::function<bool(int)>& workflow) {
+    port->resetWireNsecs();
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < repetitions; i++) {
+        if (!workflow(i)) {
+            return false;
+        }
+    }
+
+    qint64 nsecs = timer.nsecsElapsed() + port->wireNsecs();
+    QTest::setBenchmarkResult(qreal(nsecs) / repetitions / 1000000, QTest::WalltimeMilliseconds);
+    return true;
+}
+
+void tst_bench_workflows::enrollFingers(QFingerprint* fingerprint, SensorSimulator* sensor, int count) {
+    for (int finger = 0; finger < count; finger++) {
+        sensor->putFinger(finger);
+        fingerprint->readImage();
+        fingerprint->convertImage(FINGERPRINT_CHARBUFFER1);
+        fingerprint->storeTemplate(qint16(finger));
+    }
+    sensor->liftFinger();
+}
+
+void tst_bench_workflows::enroll_data() {
+    this->links();
+}
+
+void tst_bench_workflows::enroll() {
+    QFETCH(int, baudRate);
+    QFETCH(int, packetSize);
+    SensorSimulator sensor(1000, quint16(packetSize));
+    SimulatedSerialPort port(&sensor, baudRate);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+
+    bool ok = this->measure(&port, 50, [&](int finger) {
+        sensor.putFinger(finger);
+        bool enrolled = fingerprint.readImage()
+                && fingerprint.convertImage(FINGERPRINT_CHARBUFFER1)
+                && fingerprint.readImage()
+                && fingerprint.convertImage(FINGERPRINT_CHARBUFFER2)
+                && fingerprint.createTemplate();
+        return enrolled && fingerprint.storeTemplate() == finger;
+    });
+    QVERIFY(ok);
+}
+
+void tst_bench_workflows::identify_data() {
+    this->links();
+}
+
+void tst_bench_workflows::identify() {
+    QFETCH(int, baudRate);
+    QFETCH(int, packetSize);
+    SensorSimulator sensor(1000, quint16(packetSize));
+    SimulatedSerialPort port(&sensor, baudRate);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    this->enrollFingers(&fingerprint, &sensor, 200);
+
+    bool ok = this->measure(&port, 50, [&](int i) {
+        int finger = (i * 37) % 200;
+        sensor.putFinger(finger);
+        fingerprint.readImage();
+        fingerprint.convertImage(FINGERPRINT_CHARBUFFER1);
+        return fingerprint.searchTemplate().value(0) == finger;
+    });
+    QVERIFY(ok);
+}
+
+void tst_bench_workflows::downloadTemplate_data() {
+    this->links();
+}
+
+void tst_bench_workflows::downloadTemplate() {
+    QFETCH(int, baudRate);
+    QFETCH(int, packetSize);
+    SensorSimulator sensor(1000, quint16(packetSize));
+    SimulatedSerialPort port(&sensor, baudRate);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    this->enrollFingers(&fingerprint, &sensor, 20);
+
+    bool ok = this->measure(&port, 20, [&](int position) {
+        QList<uint8_t> characteristics = fingerprint.downloadTemplate(quint16(position), FINGERPRINT_CHARBUFFER1);
+        return characteristics.size() == SensorSimulator::characteristics(position).size();
+    });
+    QVERIFY(ok);
+}
+
+void tst_bench_workflows::downloadImage_data() {
+    this->links();
+}
+
+void tst_bench_workflows::downloadImage() {
+    QFETCH(int, baudRate);
+    QFETCH(int, packetSize);
+    SensorSimulator sensor(1000, quint16(packetSize));
+    SimulatedSerialPort port(&sensor, baudRate);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    sensor.putFinger(0);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString imagePath = directory.filePath("image.png");
+
+    bool ok = this->measure(&port, 3, [&](int) {
+        fingerprint.readImage();
+        fingerprint.downloadImage(imagePath);
+        return QFile::exists(imagePath);
+    });
+    QVERIFY(ok);
+}
+
+void tst_bench_workflows::preview_data() {
+    this->links();
+}
+
+// Sustained live preview rate, reported in frames per second
+void tst_bench_workflows::preview() {
+    QFETCH(int, baudRate);
+    QFETCH(int, packetSize);
+    SensorSimulator sensor(1000, quint16(packetSize));
+    SimulatedSerialPort port(&sensor, baudRate);
+    QFingerprint fingerprint;
+    fingerprint.setDevice(&port);
+    sensor.putFinger(0);
+
+    QFingerprintPreview preview(&fingerprint);
+    quint64 received = 0;
+    QObject::connect(&preview, &QFingerprintPreview::frameReady, [&received](const QImage&) {
+        received++;
+    });
+
+    const int frames = 3;
+    port.resetWireNsecs();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < frames; i++) {
+        QVERIFY(preview.captureFrame());
+    }
+    qint64 nsecs = timer.nsecsElapsed() + port.wireNsecs();
+
+    QCOMPARE(received, quint64(frames));
+    QTest::setBenchmarkResult(qreal(frames) * 1000000000 / nsecs, QTest::FramesPerSecond);
+}
+
+QTEST_MAIN(tst_bench_workflows)
+
+#include "tst_bench_workflows.moc"
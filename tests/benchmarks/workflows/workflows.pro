@@ -0,0 +1,8 @@
+TARGET = tst_bench_workflows
+
+QT = core gui testlib fingerprint
+CONFIG += benchmark exceptions
+
+include(../shared/shared.pri)
+
+SOURCES += tst_bench_workflows.cpp
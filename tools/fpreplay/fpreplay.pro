@@ -0,0 +1,10 @@
+TARGET = fpreplay
+
+QT = core fingerprint
+CONFIG += console
+
+QMAKE_TARGET_DESCRIPTION = "Fingerprint wire capture replay tool"
+
+SOURCES += main.cpp
+
+load(qt_tool)
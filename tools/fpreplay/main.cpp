@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** This file is part of the QtFingerprint module for Qt5.
+** Copyright (C) 2020 Dawit Abate.
+** Contact: dawitabate2@gmail.com
+**
+** $QT_BEGIN_LICENSE:GPLV3$
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTextStream>
+#include <algorithm>
+
+#include <qfingerprint.h>
+#include <qfingerprintcapture.h>
+#include <qfingerprintframe.h>
+
+
+// Replays a capture written by QFingerprintCapture::dump(): the received
+// bytes are fed through the frame decoder at full speed and the command
+// round trips of the recorded session are summarized per instruction.
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QStringList arguments = app.arguments();
+    if (arguments.size() < 2) {
+        out << "Usage: fpreplay <capture file> [iterations] [chunk size]\n";
+        return 1;
+    }
+
+    QList<QFingerprintCaptureFrame> frames = QFingerprintCapture::load(arguments[1]);
+    int iterations = arguments.size() > 2 ? arguments[2].toInt() : 1000;
+    int chunkSize = arguments.size() > 3 ? arguments[3].toInt() : 64;
+    if (frames.isEmpty() || iterations < 1 || chunkSize < 1) {
+        out << "Nothing to replay in " << arguments[1] << "\n";
+        return 1;
+    }
+
+    // Recorded session: round trip from a command frame to its first reply
+    QHash<uint8_t, QList<qint64>> roundTrips;
+    QByteArray received;
+    int receivedFrames = 0;
+    qint64 commandTimestamp = -1;
+    uint8_t instruction = 0;
+
+    for (const QFingerprintCaptureFrame& frame : frames) {
+        if (frame.direction == QFingerprintCapture::Receive) {
+            received.append(frame.data);
+            receivedFrames++;
+            // Skipped garbage is fed to the decoder but is no reply
+            bool reply = frame.data.size() >= QFingerprintFrame::MinimumSize
+                    && (uint8_t)frame.data[0] == (FINGERPRINT_STARTCODE >> 8)
+                    && (uint8_t)frame.data[1] == (FINGERPRINT_STARTCODE & 0xFF);
+            if (reply && commandTimestamp >= 0) {
+                roundTrips[instruction].append(frame.timestamp - commandTimestamp);
+                commandTimestamp = -1;
+            }
+        } else if (frame.data.size() > QFingerprintFrame::HeaderSize
+                   && (uint8_t)frame.data[6] == FINGERPRINT_COMMANDPACKET) {
+            commandTimestamp = frame.timestamp;
+            instruction = frame.data[QFingerprintFrame::HeaderSize];
+        }
+    }
+
+    out << frames.size() << " frames, " << receivedFrames << " received ("
+        << received.size() << " bytes)\n\n";
+
+    out << "instruction  commands  avg ms  max ms\n";
+    QList<uint8_t> instructions = roundTrips.keys();
+    std::sort(instructions.begin(), instructions.end());
+    for (uint8_t code : instructions) {
+        const QList<qint64>& times = roundTrips[code];
+        qint64 total = 0, maximum = 0;
+        for (qint64 time : times) {
+            total += time;
+            maximum = qMax(maximum, time);
+        }
+        out << QString("0x%1").arg(code, 2, 16, QLatin1Char('0')).leftJustified(13)
+            << QString::number(times.size()).leftJustified(10)
+            << QString::number(total / 1e6 / times.size(), 'f', 2).leftJustified(8)
+            << QString::number(maximum / 1e6, 'f', 2) << "\n";
+    }
+
+    // Decoder throughput over the received byte stream
+    QFingerprintFrameDecoder decoder;
+    QByteArray packet;
+    qint64 decodedFrames = 0, badFrames = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; i++) {
+        for (int offset = 0; offset < received.size(); offset += chunkSize) {
+            decoder.feed(received.constData() + offset, qMin(chunkSize, received.size() - offset));
+
+            QFingerprintFrameDecoder::Status status;
+            while ((status = decoder.next(&packet)) != QFingerprintFrameDecoder::Incomplete) {
+                if (status == QFingerprintFrameDecoder::Frame) {
+                    decodedFrames++;
+                } else {
+                    badFrames++;
+                }
+            }
+        }
+    }
+    qint64 elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+
+    out << "\n" << decodedFrames << " frames decoded (" << badFrames << " dropped) in "
+        << QString::number(elapsed / 1e6, 'f', 2) << " ms: "
+        << QString::number(decodedFrames * 1e9 / elapsed, 'f', 0) << " frames/s, "
+        << QString::number(qint64(received.size()) * iterations * 1e3 / elapsed, 'f', 1) << " MB/s\n";
+
+    return 0;
+}